@@ -51,6 +51,10 @@ struct CAddressUnspentKey {
         txhash.SetNull();
         index = 0;
     }
+
+    bool IsNull() const {
+        return type == 0;
+    }
 };
 
 struct CAddressUnspentValue {
@@ -149,6 +153,10 @@ struct CAddressIndexKey {
         spending = false;
     }
 
+    bool IsNull() const {
+        return type == 0;
+    }
+
 };
 
 struct CAddressIndexIteratorKey {
@@ -222,6 +230,43 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/**
+ * Running totals of the address index deltas of an address, as kept by the
+ * address balance index. nHeight is the height of the last block applied to
+ * them, for information only.
+ */
+struct CAddressBalance {
+    CAmount balance;
+    CAmount received;
+    int64_t txcount;
+    int nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(VARINT(txcount));
+        READWRITE(nHeight);
+    }
+
+    CAddressBalance() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txcount = 0;
+        nHeight = -1;
+    }
+
+    bool IsNull() const {
+        return txcount == 0 && balance == 0 && received == 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -4,6 +4,8 @@
 
 #include <bench/bench.h>
 
+#include <chainparams.h>
+#include <hashblock.h>
 #include <key.h>
 #include <main.h>
 #include <util.h>
@@ -14,6 +16,8 @@ main(int argc, char** argv)
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::MAIN);
+    Hash9AutoDetect();
 
     benchmark::BenchRunner::RunAll();
 
@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <kernel.h>
+#include <main.h>
+#include <random.h>
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+/* Number of staking coins searched per iteration */
+static const unsigned int STAKE_COINS = 10000;
+/* A target no kernel can meet, so every iteration walks the whole coin set */
+static const unsigned int STAKE_BITS = 0x03000001;
+static const unsigned int STAKE_TIME = 1500000000;
+
+static void SetupStakeCoins(CBlockIndex& indexPrev, std::vector<CStakeKernelCoin>& vCoins)
+{
+    indexPrev.nHeight = 1000000;
+    indexPrev.nTime = STAKE_TIME;
+    indexPrev.nStakeModifier = GetRand(std::numeric_limits<uint64_t>::max());
+
+    vCoins.clear();
+    for (unsigned int i = 0; i < STAKE_COINS; i++)
+        vCoins.push_back(CStakeKernelCoin(COutPoint(GetRandHash(), i % 4), STAKE_TIME - 30 * 24 * 60 * 60,
+                                          STAKE_TIME - 30 * 24 * 60 * 60, (i + 1) * COIN));
+}
+
+// The loop of CWallet::CreateCoinStake before the kernel search engine: one
+// CheckStakeKernelHash call per coin, rebuilding the target every time.
+static void StakeKernelLegacyLoop(benchmark::State& state)
+{
+    CBlockIndex indexPrev;
+    std::vector<CStakeKernelCoin> vCoins;
+    SetupStakeCoins(indexPrev, vCoins);
+
+    std::vector<CTransaction> vTxPrev;
+    std::vector<CBlockIndex> vBlockFrom(vCoins.size());
+    for (unsigned int i = 0; i < vCoins.size(); i++) {
+        CMutableTransaction tx;
+        tx.nTime = vCoins[i].nTimeTxPrev;
+        tx.vout.resize(vCoins[i].prevout.n + 1);
+        tx.vout[vCoins[i].prevout.n].nValue = vCoins[i].nValue;
+        vTxPrev.push_back(CTransaction(tx));
+        vBlockFrom[i].nTime = vCoins[i].nTimeBlockFrom;
+    }
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < vCoins.size(); i++) {
+            arith_uint256 hashProofOfStake, targetProofOfStake;
+            CheckStakeKernelHash(&indexPrev, STAKE_BITS, vBlockFrom[i], vTxPrev[i], vCoins[i].prevout, STAKE_TIME,
+                                 hashProofOfStake, targetProofOfStake);
+        }
+    }
+}
+
+static void StakeKernelSearch(benchmark::State& state)
+{
+    CBlockIndex indexPrev;
+    std::vector<CStakeKernelCoin> vCoins;
+    SetupStakeCoins(indexPrev, vCoins);
+
+    CStakeKernelSearch search(&indexPrev, STAKE_BITS);
+    size_t nKernel;
+    unsigned int nTimeKernel;
+    while (state.KeepRunning())
+        assert(!search.Search(vCoins, STAKE_TIME, 1, nKernel, nTimeKernel));
+}
+
+// Same search with the kernel prefixes and weighted targets rebuilt every time
+static void StakeKernelSearchUnprepared(benchmark::State& state)
+{
+    CBlockIndex indexPrev;
+    std::vector<CStakeKernelCoin> vCoins;
+    SetupStakeCoins(indexPrev, vCoins);
+
+    CStakeKernelSearch search(&indexPrev, STAKE_BITS);
+    size_t nKernel;
+    unsigned int nTimeKernel;
+    while (state.KeepRunning()) {
+        for (CStakeKernelCoin& coin: vCoins)
+            coin.fPrepared = false;
+        assert(!search.Search(vCoins, STAKE_TIME, 1, nKernel, nTimeKernel));
+    }
+}
+
+static void StakeKernelSearchParallel(benchmark::State& state)
+{
+    int nStakerThreadsPrev = nStakerThreads;
+    nStakerThreads = std::max(2, std::min(GetNumCores(), MAX_STAKER_THREADS));
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nStakerThreads - 1; i++)
+        threadGroup.create_thread(&ThreadStakeKernelCheck);
+
+    CBlockIndex indexPrev;
+    std::vector<CStakeKernelCoin> vCoins;
+    SetupStakeCoins(indexPrev, vCoins);
+
+    CStakeKernelSearch search(&indexPrev, STAKE_BITS);
+    size_t nKernel;
+    unsigned int nTimeKernel;
+    while (state.KeepRunning())
+        assert(!search.Search(vCoins, STAKE_TIME, 1, nKernel, nTimeKernel));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nStakerThreads = nStakerThreadsPrev;
+}
+
+BENCHMARK(StakeKernelLegacyLoop);
+BENCHMARK(StakeKernelSearch);
+BENCHMARK(StakeKernelSearchUnprepared);
+BENCHMARK(StakeKernelSearchParallel);
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <main.h>
+#include <random.h>
+#include <test/testutil.h>
+
+#include <vector>
+
+/* Number of blocks of the synthetic chain the stake modifiers are computed for */
+static const unsigned int MODIFIER_CHAIN_BLOCKS = 4000;
+static const int64_t MODIFIER_CHAIN_TIME = 1500000000;
+
+static void BuildModifierChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHash, unsigned int nBlocks, int64_t nSpacing)
+{
+    std::vector<int64_t> vTime;
+    for (unsigned int i = 0; i < nBlocks; i++)
+        vTime.push_back(MODIFIER_CHAIN_TIME + nSpacing * i + (int64_t)GetRand(61) - 30);
+    BuildModifierChain(vIndex, vHash, vTime, false);
+}
+
+// Connect the next block of the chain, starting over once the end is reached
+static void ConnectNextModifier(std::vector<CBlockIndex>& vIndex, unsigned int& nNext, bool fCheckpoints)
+{
+    if (nNext == vIndex.size()) {
+        for (unsigned int i = 1; i < vIndex.size(); i++) {
+            vIndex[i].nFlags &= ~BLOCK_STAKE_MODIFIER;
+            vIndex[i].pstakemodifier = NULL;
+        }
+        nNext = 1;
+    }
+
+    uint64_t nStakeModifier;
+    bool fGenerated;
+    ComputeNextStakeModifier(&vIndex[nNext - 1], nStakeModifier, fGenerated);
+    vIndex[nNext].SetStakeModifier(nStakeModifier, fGenerated);
+    if (fCheckpoints)
+        vIndex[nNext].BuildStakeModifierCheckpoint();
+    nNext++;
+}
+
+// Stake modifiers of consecutive blocks, as computed while reindexing
+static void StakeModifierConnect(benchmark::State& state)
+{
+    std::vector<CBlockIndex> vIndex;
+    std::vector<uint256> vHash;
+    BuildModifierChain(vIndex, vHash, MODIFIER_CHAIN_BLOCKS, 30);
+
+    unsigned int nNext = 1;
+    while (state.KeepRunning())
+        ConnectNextModifier(vIndex, nNext, true);
+}
+
+// The same without modifier checkpoints, and with a candidate window which
+// has to be collected and sorted again every time, like before the window
+// was kept between blocks
+static void StakeModifierConnectNoCache(benchmark::State& state)
+{
+    std::vector<CBlockIndex> vIndex, vIndexOther;
+    std::vector<uint256> vHash, vHashOther;
+    BuildModifierChain(vIndex, vHash, MODIFIER_CHAIN_BLOCKS, 30);
+    // A day apart, so the second block computes a new modifier from a tiny window
+    BuildModifierChain(vIndexOther, vHashOther, 2, 24 * 60 * 60);
+
+    unsigned int nNext = 1;
+    uint64_t nStakeModifier;
+    bool fGenerated;
+    while (state.KeepRunning()) {
+        ConnectNextModifier(vIndex, nNext, false);
+        ComputeNextStakeModifier(&vIndexOther[1], nStakeModifier, fGenerated);
+    }
+}
+
+BENCHMARK(StakeModifierConnect);
+BENCHMARK(StakeModifierConnectNoCache);
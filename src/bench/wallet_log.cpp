@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <clientversion.h>
+#include <random.h>
+#include <util.h>
+#include <wallet/walletlog.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/* Records written per iteration, about what a busy staking wallet writes in a minute */
+static const int WALLET_LOG_WRITES = 100;
+/* Records in the wallet loaded by WalletLogLoad */
+static const int WALLET_LOG_RECORDS = 20000;
+/* Size of a typical serialized wallet transaction */
+static const size_t WALLET_LOG_VALUE_SIZE = 600;
+
+static boost::filesystem::path GetBenchLogPath()
+{
+    return boost::filesystem::temp_directory_path() / strprintf("bench_walletlog_%s.wlog", GetRandHash().ToString());
+}
+
+static void WriteTxRecord(CWalletLog& log, const std::vector<unsigned char>& vchValue)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << std::make_pair(std::string("tx"), GetRandHash());
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssValue << vchValue;
+
+    CWalletLogBatch batch;
+    batch.Write(ssKey, ssValue);
+    log.Write(batch);
+}
+
+// Every write synced on its own, as a Berkeley DB checkpoint on each CWalletDB close does
+static void WalletLogWriteSyncEach(benchmark::State& state)
+{
+    boost::filesystem::path path = GetBenchLogPath();
+    CWalletLog log;
+    log.Create(path);
+    std::vector<unsigned char> vchValue(WALLET_LOG_VALUE_SIZE, 0x55);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < WALLET_LOG_WRITES; i++) {
+            WriteTxRecord(log, vchValue);
+            log.Sync(true);
+        }
+    }
+
+    log.Close();
+    boost::filesystem::remove(path);
+}
+
+// Writes committed to disk together, once per WALLET_LOG_SYNC_INTERVAL
+static void WalletLogWriteGroupCommit(benchmark::State& state)
+{
+    boost::filesystem::path path = GetBenchLogPath();
+    CWalletLog log;
+    log.Create(path);
+    std::vector<unsigned char> vchValue(WALLET_LOG_VALUE_SIZE, 0x55);
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < WALLET_LOG_WRITES; i++) {
+            WriteTxRecord(log, vchValue);
+            log.Sync(false);
+        }
+    }
+
+    log.Close();
+    boost::filesystem::remove(path);
+}
+
+static void WalletLogLoad(benchmark::State& state)
+{
+    boost::filesystem::path path = GetBenchLogPath();
+    {
+        CWalletLog log;
+        log.Create(path);
+        std::vector<unsigned char> vchValue(WALLET_LOG_VALUE_SIZE, 0x55);
+        for (int i = 0; i < WALLET_LOG_RECORDS; i++)
+            WriteTxRecord(log, vchValue);
+    }
+
+    std::string strError;
+    while (state.KeepRunning()) {
+        CWalletLog log;
+        log.Load(path, strError);
+    }
+
+    boost::filesystem::remove(path);
+}
+
+BENCHMARK(WalletLogWriteSyncEach);
+BENCHMARK(WalletLogWriteGroupCommit);
+BENCHMARK(WalletLogLoad);
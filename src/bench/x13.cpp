@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <hashblock.h>
+#include <uint256.h>
+
+#include <vector>
+
+/* Number of headers hashed per iteration */
+static const size_t HEADER_COUNT = 1000;
+/* Size of a serialized block header, the input of the X13 chain */
+static const size_t HEADER_SIZE = 80;
+
+// Each X13 primitive after the first one hashes the 64 byte output of the previous one
+#define X13_PRIMITIVE_BENCH(name)                                       \
+    static void X13_##name(benchmark::State& state)                     \
+    {                                                                   \
+        uint512 hash;                                                   \
+        sph_##name##512_context ctx;                                    \
+        while (state.KeepRunning()) {                                   \
+            for (size_t i = 0; i < HEADER_COUNT; i++) {                 \
+                sph_##name##512_init(&ctx);                             \
+                sph_##name##512(&ctx, hash.begin(), hash.size());       \
+                sph_##name##512_close(&ctx, hash.begin());              \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+    BENCHMARK(X13_##name);
+
+X13_PRIMITIVE_BENCH(blake)
+X13_PRIMITIVE_BENCH(bmw)
+X13_PRIMITIVE_BENCH(groestl)
+X13_PRIMITIVE_BENCH(skein)
+X13_PRIMITIVE_BENCH(jh)
+X13_PRIMITIVE_BENCH(keccak)
+X13_PRIMITIVE_BENCH(luffa)
+X13_PRIMITIVE_BENCH(cubehash)
+X13_PRIMITIVE_BENCH(shavite)
+X13_PRIMITIVE_BENCH(simd)
+X13_PRIMITIVE_BENCH(echo)
+X13_PRIMITIVE_BENCH(hamsi)
+X13_PRIMITIVE_BENCH(fugue)
+
+static void X13_Headers(benchmark::State& state)
+{
+    std::vector<unsigned char> vHeaders(HEADER_COUNT * HEADER_SIZE, 0);
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        vHeaders[i] = i & 0xff;
+    uint256 hash;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < HEADER_COUNT; i++)
+            hash = Hash9(vHeaders.begin() + i * HEADER_SIZE, vHeaders.begin() + (i + 1) * HEADER_SIZE);
+    }
+}
+
+static void X13_HeadersBatch(benchmark::State& state)
+{
+    std::vector<unsigned char> vHeaders(HEADER_COUNT * HEADER_SIZE, 0);
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        vHeaders[i] = i & 0xff;
+    std::vector<const unsigned char*> vData;
+    for (size_t i = 0; i < HEADER_COUNT; i++)
+        vData.push_back(&vHeaders[i * HEADER_SIZE]);
+    std::vector<uint256> vHashes(HEADER_COUNT);
+    while (state.KeepRunning())
+        Hash9Batch(&vData[0], HEADER_SIZE, &vHashes[0], HEADER_COUNT);
+}
+
+BENCHMARK(X13_Headers);
+BENCHMARK(X13_HeadersBatch);
@@ -0,0 +1,98 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockrelaycache.h>
+
+#include <memusage.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <version.h>
+
+static CSerializedBlockRef SerializeBlock(const CBlock& block, int nVersion)
+{
+    CDataStream ss(SER_NETWORK, nVersion);
+    ss << block;
+    return std::make_shared<const CSerializedBlock>(std::vector<char>(ss.begin(), ss.end()));
+}
+
+CBlockRelayCache::CBlockRelayCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0)
+{
+}
+
+size_t CBlockRelayCache::EntryUsage(const CEntry& entry)
+{
+    size_t nEntryUsage = memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const uint256, CEntry> >)) +
+                         memusage::MallocUsage(sizeof(uint256) + 2 * sizeof(void*)) +
+                         memusage::MallocUsage(entry.pblockWitness->data().capacity());
+    if (entry.pblockNoWitness != entry.pblockWitness)
+        nEntryUsage += memusage::MallocUsage(entry.pblockNoWitness->data().capacity());
+    return nEntryUsage;
+}
+
+void CBlockRelayCache::EvictOverLimit()
+{
+    AssertLockHeld(cs);
+    while (nUsage > nMaxUsage && !listLru.empty()) {
+        std::map<uint256, CEntry>::iterator it = mapBlocks.find(listLru.back());
+        nUsage -= EntryUsage(it->second);
+        mapBlocks.erase(it);
+        listLru.pop_back();
+    }
+}
+
+void CBlockRelayCache::SetMaxUsage(size_t nMaxUsageIn)
+{
+    LOCK(cs);
+    nMaxUsage = nMaxUsageIn;
+    EvictOverLimit();
+}
+
+void CBlockRelayCache::Add(const CBlock& block)
+{
+    uint256 hash = block.GetHash();
+    {
+        LOCK(cs);
+        if (nMaxUsage == 0 || mapBlocks.count(hash))
+            return;
+    }
+
+    // Serialize outside of the lock, readers do not have to wait for it
+    CEntry entry;
+    entry.pblockWitness = SerializeBlock(block, PROTOCOL_VERSION);
+    bool fHaveWitness = false;
+    for (size_t i = 0; i < block.vtx.size() && !fHaveWitness; i++)
+        fHaveWitness = !block.vtx[i].wit.IsNull();
+    entry.pblockNoWitness = fHaveWitness ? SerializeBlock(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) : entry.pblockWitness;
+
+    LOCK(cs);
+    std::pair<std::map<uint256, CEntry>::iterator, bool> ret = mapBlocks.insert(std::make_pair(hash, entry));
+    if (!ret.second)
+        return;
+    listLru.push_front(hash);
+    ret.first->second.itLru = listLru.begin();
+    nUsage += EntryUsage(ret.first->second);
+    EvictOverLimit();
+}
+
+CSerializedBlockRef CBlockRelayCache::Get(const uint256& hash, bool fWitness)
+{
+    LOCK(cs);
+    std::map<uint256, CEntry>::iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        nMisses++;
+        return CSerializedBlockRef();
+    }
+    nHits++;
+    listLru.splice(listLru.begin(), listLru, it->second.itLru);
+    return fWitness ? it->second.pblockWitness : it->second.pblockNoWitness;
+}
+
+void CBlockRelayCache::GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, size_t& nBlocksRet, size_t& nUsageRet) const
+{
+    LOCK(cs);
+    nHitsRet = nHits;
+    nMissesRet = nMisses;
+    nBlocksRet = mapBlocks.size();
+    nUsageRet = nUsage;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_BLOCKRELAYCACHE_H
+#define NAVCOIN_BLOCKRELAYCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+class CBlock;
+
+/** -blockrelaycache default (MiB) */
+static const unsigned int DEFAULT_BLOCK_RELAY_CACHE_SIZE = 16;
+
+/** A block kept in serialized form, which serializes to those bytes as is */
+class CSerializedBlock
+{
+private:
+    std::vector<char> vch;
+
+public:
+    explicit CSerializedBlock(const std::vector<char>& vchIn) : vch(vchIn) {}
+
+    const std::vector<char>& data() const { return vch; }
+    size_t size() const { return vch.size(); }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return vch.size();
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        if (!vch.empty())
+            s.write(&vch[0], vch.size());
+    }
+};
+
+typedef std::shared_ptr<const CSerializedBlock> CSerializedBlockRef;
+
+/**
+ * The most recently connected blocks in their network serialization, with and
+ * without witness data, so the blocks peers and REST clients ask for the most
+ * are sent without reading them from disk and serializing them again. The
+ * memory used by the serializations is bounded.
+ */
+class CBlockRelayCache
+{
+private:
+    struct CEntry
+    {
+        CSerializedBlockRef pblockWitness;
+        //! Same as pblockWitness when the block has no witness data
+        CSerializedBlockRef pblockNoWitness;
+        std::list<uint256>::iterator itLru;
+    };
+
+    mutable CCriticalSection cs;
+    size_t nMaxUsage;
+    size_t nUsage;
+    std::map<uint256, CEntry> mapBlocks;
+    //! Most recently added or used first
+    std::list<uint256> listLru;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+    static size_t EntryUsage(const CEntry& entry);
+    void EvictOverLimit();
+
+public:
+    explicit CBlockRelayCache(size_t nMaxUsageIn);
+
+    /** Set the maximum memory usage in bytes, 0 disabling the cache */
+    void SetMaxUsage(size_t nMaxUsageIn);
+    /** Serialize and add block */
+    void Add(const CBlock& block);
+    /** The serialized block with hash, with or without its witness data, or null if it is not cached */
+    CSerializedBlockRef Get(const uint256& hash, bool fWitness);
+
+    void GetStats(uint64_t& nHitsRet, uint64_t& nMissesRet, size_t& nBlocksRet, size_t& nUsageRet) const;
+};
+
+#endif // NAVCOIN_BLOCKRELAYCACHE_H
@@ -224,6 +224,10 @@ public:
 
     uint64_t nStakeModifier; // hash modifier for proof-of-stake
 
+    //! (memory only) Pointer to the latest block up to this one that generated a stake modifier,
+    //! or the genesis block when none did. NULL until the stake modifier of this block is known.
+    const CBlockIndex* pstakemodifier;
+
     // proof-of-stake specific fields
     COutPoint prevoutStake;
     unsigned int nStakeTime;
@@ -252,6 +256,7 @@ public:
         nCFLocked = 0;
         nFlags = 0;
         nStakeModifier = 0;
+        pstakemodifier = NULL;
 	      hashProof = arith_uint256();
         prevoutStake.SetNull();
         nStakeTime = 0;
@@ -452,6 +457,12 @@ public:
         return (nFlags & BLOCK_STAKE_MODIFIER);
     }
 
+    //! Build the stake modifier checkpoint pointer for this entry, once its stake modifier is known.
+    void BuildStakeModifierCheckpoint()
+    {
+        pstakemodifier = (GeneratedStakeModifier() || !pprev) ? this : pprev->pstakemodifier;
+    }
+
     //! Build the skiplist pointer for this entry.
     void BuildSkip();
 
@@ -527,7 +538,7 @@ public:
         READWRITE(vProposalVotes);
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -536,10 +547,14 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
+        return block;
+    }
 
-        const_cast<CDiskBlockIndex*>(this)->blockHash = block.GetHash();
+    uint256 GetBlockHash() const
+    {
+        const_cast<CDiskBlockIndex*>(this)->blockHash = GetBlockHeader().GetHash();
 
-        return block.GetHash();
+        return blockHash;
     }
 
 
@@ -8,9 +8,11 @@
 #include <algorithm>
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
@@ -211,4 +213,30 @@ public:
     }
 };
 
+/**
+ * Worker threads for a CCheckQueue which only run as long as this object
+ * exists, for queues used too rarely to keep a pool of threads around for
+ * them. The queue must outlive it, and be done with its work when it goes.
+ */
+template <typename T>
+class CCheckQueueWorkers
+{
+private:
+    boost::thread_group threads;
+
+public:
+    CCheckQueueWorkers(CCheckQueue<T>* pqueue, int nThreads, void (*pfnThread)(CCheckQueue<T>*))
+    {
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(pfnThread, pqueue));
+    }
+
+    ~CCheckQueueWorkers()
+    {
+        // The workers are waiting for more work, which is an interruption point
+        threads.interrupt_all();
+        threads.join_all();
+    }
+};
+
 #endif // NAVCOIN_CHECKQUEUE_H
@@ -53,6 +53,10 @@ bool CCoinsView::GetAllPaymentRequests(CPaymentRequestMap& map) { return false;
 bool CCoinsView::HaveCoins(const uint256 &txid) const { return false; }
 bool CCoinsView::HaveProposal(const uint256 &pid) const { return false; }
 bool CCoinsView::HavePaymentRequest(const uint256 &prid) const { return false; }
+bool CCoinsView::GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests) { return false; }
+bool CCoinsView::GetProposalStateCandidates(flags nState, std::set<uint256>& setProposals) { return false; }
+bool CCoinsView::GetPaymentRequestStateCandidates(flags nState, std::set<uint256>& setPaymentRequests) { return false; }
+uint256 CCoinsView::GetCFundStateAccumulator() const { return uint256(); }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                             CPaymentRequestMap &mapPaymentRequests, const uint256 &hashBlock) { return false; }
@@ -68,6 +72,10 @@ bool CCoinsViewBacked::GetAllPaymentRequests(CPaymentRequestMap& map) { return b
 bool CCoinsViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
 bool CCoinsViewBacked::HaveProposal(const uint256 &pid) const { return base->HaveProposal(pid); }
 bool CCoinsViewBacked::HavePaymentRequest(const uint256 &prid) const { return base->HavePaymentRequest(prid); }
+bool CCoinsViewBacked::GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests) { return base->GetProposalPaymentRequests(pid, setPaymentRequests); }
+bool CCoinsViewBacked::GetProposalStateCandidates(flags nState, std::set<uint256>& setProposals) { return base->GetProposalStateCandidates(nState, setProposals); }
+bool CCoinsViewBacked::GetPaymentRequestStateCandidates(flags nState, std::set<uint256>& setPaymentRequests) { return base->GetPaymentRequestStateCandidates(nState, setPaymentRequests); }
+uint256 CCoinsViewBacked::GetCFundStateAccumulator() const { return base->GetCFundStateAccumulator(); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
@@ -137,10 +145,16 @@ CPaymentRequestMap::const_iterator CCoinsViewCache::FetchPaymentRequest(const ui
 
     CPaymentRequestMap::iterator ret = cachePaymentRequests.insert(std::make_pair(prid, CPaymentRequest())).first;
     tmp.swap(ret->second);
+    IndexPaymentRequest(ret->second);
 
     return ret;
 }
 
+void CCoinsViewCache::IndexPaymentRequest(const CPaymentRequest& prequest) const {
+    if (!prequest.IsNull())
+        cacheProposalPaymentRequests[prequest.proposalhash].insert(prequest.hash);
+}
+
 
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
     CCoinsMap::const_iterator it = FetchCoins(txid);
@@ -207,6 +221,53 @@ bool CCoinsViewCache::GetAllPaymentRequests(CPaymentRequestMap& mapPaymentReques
     return true;
 }
 
+bool CCoinsViewCache::GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests) {
+    std::set<uint256> setBase;
+
+    if (!base->GetProposalPaymentRequests(pid, setBase))
+        return false;
+
+    setPaymentRequests.clear();
+
+    // Entries of the base view are only out of date when this cache changed them
+    for (const uint256& hash: setBase) {
+        CPaymentRequestMap::const_iterator it = cachePaymentRequests.find(hash);
+        if (it == cachePaymentRequests.end() || (!it->second.IsNull() && it->second.proposalhash == pid))
+            setPaymentRequests.insert(hash);
+    }
+
+    auto itIndex = cacheProposalPaymentRequests.find(pid);
+    if (itIndex != cacheProposalPaymentRequests.end()) {
+        for (const uint256& hash: itIndex->second) {
+            CPaymentRequestMap::const_iterator it = cachePaymentRequests.find(hash);
+            if (it != cachePaymentRequests.end() && !it->second.IsNull() && it->second.proposalhash == pid)
+                setPaymentRequests.insert(hash);
+        }
+    }
+
+    return true;
+}
+
+bool CCoinsViewCache::GetProposalStateCandidates(flags nState, std::set<uint256>& setProposals) {
+    if (!base->GetProposalStateCandidates(nState, setProposals))
+        return false;
+
+    for (auto &it: cacheProposals)
+        setProposals.insert(it.first);
+
+    return true;
+}
+
+bool CCoinsViewCache::GetPaymentRequestStateCandidates(flags nState, std::set<uint256>& setPaymentRequests) {
+    if (!base->GetPaymentRequestStateCandidates(nState, setPaymentRequests))
+        return false;
+
+    for (auto &it: cachePaymentRequests)
+        setPaymentRequests.insert(it.first);
+
+    return true;
+}
+
 CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256 &txid) {
     assert(!hasModifier);
     std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
@@ -246,6 +307,7 @@ CPaymentRequestModifier CCoinsViewCache::ModifyPaymentRequest(const uint256 &pri
         if (!base->GetPaymentRequest(prid, ret.first->second)) {
             ret.first->second.SetNull();
         }
+        IndexPaymentRequest(ret.first->second);
     }
     return CPaymentRequestModifier(*this, ret.first);
 }
@@ -269,6 +331,8 @@ bool CCoinsViewCache::AddProposal(const CProposal& proposal) const {
     if (HaveProposal(proposal.hash))
         return false;
 
+    nCFundStateDelta += GetCFundStateContribution(proposal);
+
     if (cacheProposals.count(proposal.hash))
         cacheProposals[proposal.hash]=proposal;
     else
@@ -281,11 +345,15 @@ bool CCoinsViewCache::AddPaymentRequest(const CPaymentRequest& prequest) const {
     if (HavePaymentRequest(prequest.hash))
         return false;
 
+    nCFundStateDelta += GetCFundStateContribution(prequest);
+
     if (cachePaymentRequests.count(prequest.hash))
         cachePaymentRequests[prequest.hash]=prequest;
     else
         cachePaymentRequests.insert(std::make_pair(prequest.hash, prequest));
 
+    IndexPaymentRequest(prequest);
+
     return true;
 }
 
@@ -293,6 +361,8 @@ bool CCoinsViewCache::RemoveProposal(const uint256 &pid) const {
     if (!HaveProposal(pid))
         return false;
 
+    nCFundStateDelta -= GetCFundStateContribution(cacheProposals[pid]);
+
     cacheProposals[pid] = CProposal();
     cacheProposals[pid].SetNull();
 
@@ -305,6 +375,8 @@ bool CCoinsViewCache::RemovePaymentRequest(const uint256 &prid) const {
     if (!HavePaymentRequest(prid))
         return false;
 
+    nCFundStateDelta -= GetCFundStateContribution(cachePaymentRequests[prid]);
+
     cachePaymentRequests[prid] = CPaymentRequest();
     cachePaymentRequests[prid].SetNull();
 
@@ -409,6 +481,16 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
     }
 
     for (CProposalMap::iterator it = mapProposals.begin(); it != mapProposals.end();) {
+        CProposalMap::iterator itUs = cacheProposals.find(it->first);
+        if (itUs == cacheProposals.end()) {
+            CProposal proposal;
+            if (base->GetProposal(it->first, proposal))
+                nCFundStateDelta -= GetCFundStateContribution(proposal);
+            nCFundStateDelta += GetCFundStateContribution(it->second);
+        } else if (itUs->second != it->second) {
+            nCFundStateDelta -= GetCFundStateContribution(itUs->second);
+            nCFundStateDelta += GetCFundStateContribution(it->second);
+        }
         CProposal& entry = cacheProposals[it->first];
         entry.swap(it->second);
         CProposalMap::iterator itOld = it++;
@@ -416,8 +498,19 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
     }
 
     for (CPaymentRequestMap::iterator it = mapPaymentRequests.begin(); it != mapPaymentRequests.end();) {
+        CPaymentRequestMap::iterator itUs = cachePaymentRequests.find(it->first);
+        if (itUs == cachePaymentRequests.end()) {
+            CPaymentRequest prequest;
+            if (base->GetPaymentRequest(it->first, prequest))
+                nCFundStateDelta -= GetCFundStateContribution(prequest);
+            nCFundStateDelta += GetCFundStateContribution(it->second);
+        } else if (itUs->second != it->second) {
+            nCFundStateDelta -= GetCFundStateContribution(itUs->second);
+            nCFundStateDelta += GetCFundStateContribution(it->second);
+        }
         CPaymentRequest& entry = cachePaymentRequests[it->first];
         entry.swap(it->second);
+        IndexPaymentRequest(entry);
         CPaymentRequestMap::iterator itOld = it++;
         mapPaymentRequests.erase(itOld);
     }
@@ -431,7 +524,9 @@ bool CCoinsViewCache::Flush() {
     cacheCoins.clear();
     cacheProposals.clear();
     cachePaymentRequests.clear();
+    cacheProposalPaymentRequests.clear();
     cachedCoinsUsage = 0;
+    nCFundStateDelta = 0;
     return fOk;
 }
 
@@ -448,7 +543,42 @@ unsigned int CCoinsViewCache::GetCacheSize() const {
     return cacheCoins.size();
 }
 
-uint256 CCoinsViewCache::GetCFundDBStateHash(const CAmount& nCFLocked, const CAmount& nCFSupply)
+uint256 CCoinsViewCache::GetCFundStateAccumulator() const
+{
+    return ArithToUint256(UintToArith256(base->GetCFundStateAccumulator()) + nCFundStateDelta);
+}
+
+uint256 CCoinsViewCache::GetCFundDBStateHash(const CAmount& nCFLocked, const CAmount& nCFSupply) const
+{
+    CHashWriter writer(0,0);
+
+    writer << nCFSupply;
+    writer << nCFLocked;
+    writer << GetCFundStateAccumulator();
+
+    return writer.GetHash();
+}
+
+uint256 CCoinsViewCache::ComputeCFundStateAccumulator()
+{
+    CPaymentRequestMap mapPaymentRequests;
+    CProposalMap mapProposals;
+
+    arith_uint256 nState;
+
+    if (GetAllProposals(mapProposals) && GetAllPaymentRequests(mapPaymentRequests))
+    {
+        for (auto &it: mapProposals)
+            nState += GetCFundStateContribution(it.second);
+
+        for (auto &it: mapPaymentRequests)
+            nState += GetCFundStateContribution(it.second);
+    }
+
+    return ArithToUint256(nState);
+}
+
+uint256 CCoinsViewCache::GetCFundDBStateHashFullScan(const CAmount& nCFLocked, const CAmount& nCFSupply)
 {
     CPaymentRequestMap mapPaymentRequests;
     CProposalMap mapProposals;
@@ -562,6 +692,7 @@ CCoinsModifier::~CCoinsModifier()
 CProposalModifier::CProposalModifier(CCoinsViewCache& cache_, CProposalMap::iterator it_) : cache(cache_), it(it_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    nContribution = GetCFundStateContribution(it->second);
 }
 
 CProposalModifier::~CProposalModifier()
@@ -569,14 +700,23 @@ CProposalModifier::~CProposalModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
 
+    cache.nCFundStateDelta -= nContribution;
+
     if (it->second.IsNull()) {
+        // The entry of the base view shows through again
+        CProposal proposal;
+        if (cache.base->GetProposal(it->first, proposal))
+            cache.nCFundStateDelta += GetCFundStateContribution(proposal);
         cache.cacheProposals.erase(it);
+    } else {
+        cache.nCFundStateDelta += GetCFundStateContribution(it->second);
     }
 }
 
 CPaymentRequestModifier::CPaymentRequestModifier(CCoinsViewCache& cache_, CPaymentRequestMap::iterator it_) : cache(cache_), it(it_) {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    nContribution = GetCFundStateContribution(it->second);
 }
 
 CPaymentRequestModifier::~CPaymentRequestModifier()
@@ -584,11 +724,39 @@ CPaymentRequestModifier::~CPaymentRequestModifier()
     assert(cache.hasModifier);
     cache.hasModifier = false;
 
+    cache.nCFundStateDelta -= nContribution;
+
     if (it->second.IsNull()) {
+        CPaymentRequest prequest;
+        if (cache.base->GetPaymentRequest(it->first, prequest))
+            cache.nCFundStateDelta += GetCFundStateContribution(prequest);
         cache.cachePaymentRequests.erase(it);
+    } else {
+        cache.nCFundStateDelta += GetCFundStateContribution(it->second);
+        cache.IndexPaymentRequest(it->second);
     }
 }
 
+arith_uint256 GetCFundStateContribution(const CProposal& proposal)
+{
+    if (proposal.IsNull())
+        return arith_uint256();
+
+    CHashWriter writer(0,0);
+    writer << 'p' << proposal;
+    return UintToArith256(writer.GetHash());
+}
+
+arith_uint256 GetCFundStateContribution(const CPaymentRequest& prequest)
+{
+    if (prequest.IsNull())
+        return arith_uint256();
+
+    CHashWriter writer(0,0);
+    writer << 'r' << prequest;
+    return UintToArith256(writer.GetHash());
+}
+
 CCoinsViewCursor::~CCoinsViewCursor()
 {
 }
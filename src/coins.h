@@ -6,6 +6,7 @@
 #ifndef NAVCOIN_COINS_H
 #define NAVCOIN_COINS_H
 
+#include <arith_uint256.h>
 #include <compressor.h>
 #include <core_memusage.h>
 #include <hash.h>
@@ -16,6 +17,8 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <set>
+
 #include <boost/unordered_map.hpp>
 
 using namespace CFund;
@@ -312,6 +315,14 @@ typedef boost::unordered_map<uint256, CCoinsCacheEntry, SaltedTxidHasher> CCoins
 typedef std::map<uint256, CProposal> CProposalMap;
 typedef std::map<uint256, CPaymentRequest> CPaymentRequestMap;
 
+/**
+ * Contribution of a proposal or payment request to the community fund state
+ * accumulator: the sum, modulo 2^256, of the hashes of every entry. Entries
+ * can then be added, removed or replaced without hashing the whole set again.
+ */
+arith_uint256 GetCFundStateContribution(const CProposal& proposal);
+arith_uint256 GetCFundStateContribution(const CPaymentRequest& prequest);
+
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
 {
@@ -352,6 +363,18 @@ public:
     virtual bool HaveProposal(const uint256 &pid) const;
     virtual bool HavePaymentRequest(const uint256 &prid) const;
 
+    //! Retrieve the hashes of the payment requests of a proposal
+    virtual bool GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests);
+
+    //! Retrieve the hashes of the proposals or payment requests which may be in
+    //! state nState. Entries changed by a cache layer are always returned, so
+    //! the result is a superset which the caller filters with GetLastState.
+    virtual bool GetProposalStateCandidates(CFund::flags nState, std::set<uint256>& setProposals);
+    virtual bool GetPaymentRequestStateCandidates(CFund::flags nState, std::set<uint256>& setPaymentRequests);
+
+    //! Retrieve the community fund state accumulator of this view
+    virtual uint256 GetCFundStateAccumulator() const;
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
@@ -384,6 +407,10 @@ public:
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
     bool HaveProposal(const uint256 &pid) const;
     bool HavePaymentRequest(const uint256 &prid) const;
+    bool GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests);
+    bool GetProposalStateCandidates(CFund::flags nState, std::set<uint256>& setProposals);
+    bool GetPaymentRequestStateCandidates(CFund::flags nState, std::set<uint256>& setPaymentRequests);
+    uint256 GetCFundStateAccumulator() const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals, CPaymentRequestMap &mapPaymentRequests, const uint256 &hashBlock);
@@ -418,6 +445,7 @@ class CProposalModifier
 private:
     CCoinsViewCache& cache;
     CProposalMap::iterator it;
+    arith_uint256 nContribution; // Contribution of the entry before modification
     CProposalModifier(CCoinsViewCache& cache_, CProposalMap::iterator it_);
 
 public:
@@ -433,6 +461,7 @@ class CPaymentRequestModifier
 private:
     CCoinsViewCache& cache;
     CPaymentRequestMap::iterator it;
+    arith_uint256 nContribution; // Contribution of the entry before modification
     CPaymentRequestModifier(CCoinsViewCache& cache_, CPaymentRequestMap::iterator it_);
 
 public:
@@ -458,9 +487,15 @@ protected:
     mutable CProposalMap cacheProposals;
     mutable CPaymentRequestMap cachePaymentRequests;
 
+    /* Payment requests in cachePaymentRequests by proposal. May hold removed entries. */
+    mutable std::map<uint256, std::set<uint256>> cacheProposalPaymentRequests;
+
     /* Cached dynamic memory usage for the inner CCoins objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Change of the community fund state accumulator relative to the base view. */
+    mutable arith_uint256 nCFundStateDelta;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
     ~CCoinsViewCache();
@@ -474,6 +509,10 @@ public:
     bool GetAllProposals(CProposalMap& map);
     bool GetPaymentRequest(const uint256 &txid, CPaymentRequest &prequest) const;
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
+    bool GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests);
+    bool GetProposalStateCandidates(CFund::flags nState, std::set<uint256>& setProposals);
+    bool GetPaymentRequestStateCandidates(CFund::flags nState, std::set<uint256>& setPaymentRequests);
+    uint256 GetCFundStateAccumulator() const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
@@ -483,7 +522,18 @@ public:
     bool RemoveProposal(const uint256 &pid) const;
     bool RemovePaymentRequest(const uint256 &prid) const;
 
-    uint256 GetCFundDBStateHash(const CAmount& nCFLocked, const CAmount& nCFSupply);
+    /**
+     * Hash of the community fund state, committing to the fund amounts and to
+     * every proposal and payment request through the state accumulator, which
+     * is maintained as entries change.
+     */
+    uint256 GetCFundDBStateHash(const CAmount& nCFLocked, const CAmount& nCFSupply) const;
+
+    //! Hash of the community fund state serializing every entry, as computed before the accumulator
+    uint256 GetCFundDBStateHashFullScan(const CAmount& nCFLocked, const CAmount& nCFSupply);
+
+    //! Compute the community fund state accumulator from every entry, to verify the maintained one
+    uint256 ComputeCFundStateAccumulator();
 
     /**
      * Check if we have the given tx already loaded in this cache.
@@ -572,6 +622,7 @@ private:
     CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
     CProposalMap::const_iterator FetchProposal(const uint256 &pid) const;
     CPaymentRequestMap::const_iterator FetchPaymentRequest(const uint256 &prid) const;
+    void IndexPaymentRequest(const CPaymentRequest& prequest) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
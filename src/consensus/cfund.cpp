@@ -471,18 +471,15 @@ CAmount CFund::CProposal::GetAvailable(CCoinsViewCache& coins, bool fIncludeRequ
     AssertLockHeld(cs_main);
 
     CAmount initial = nAmount;
-    CPaymentRequestMap mapPaymentRequests;
+    std::set<uint256> setPaymentRequests;
 
-    if(coins.GetAllPaymentRequests(mapPaymentRequests))
+    if(coins.GetProposalPaymentRequests(hash, setPaymentRequests))
     {
-        for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
+        for (const uint256& prid: setPaymentRequests)
         {
             CFund::CPaymentRequest prequest;
 
-            if (!coins.GetPaymentRequest(it_->first, prequest))
-                continue;
-
-            if (prequest.proposalhash != hash)
+            if (!coins.GetPaymentRequest(prid, prequest))
                 continue;
 
             flags fLastState = prequest.GetLastState();
@@ -503,18 +500,15 @@ std::string CFund::CProposal::ToString(CCoinsViewCache& coins, uint32_t currentT
                      "nVotesNo=%u, nVotingCycle=%u, fState=%s, strDZeel=%s, blockhash=%s)",
                      hash.ToString(), nVersion, (float)nAmount/COIN, (float)GetAvailable(coins)/COIN, (float)nFee/COIN, Address, nDeadline,
                      nVotesYes, nVotesNo, nVotingCycle, GetState(currentTime), strDZeel, blockhash.ToString().substr(0,10));
-    CPaymentRequestMap mapPaymentRequests;
+    std::set<uint256> setPaymentRequests;
 
-    if(coins.GetAllPaymentRequests(mapPaymentRequests))
+    if(coins.GetProposalPaymentRequests(hash, setPaymentRequests))
     {
-        for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
+        for (const uint256& prid: setPaymentRequests)
         {
             CFund::CPaymentRequest prequest;
 
-            if (!coins.GetPaymentRequest(it_->first, prequest))
-                continue;
-
-            if (prequest.proposalhash != hash)
+            if (!coins.GetPaymentRequest(prid, prequest))
                 continue;
 
             str += "\n    " + prequest.ToString();
@@ -526,18 +520,15 @@ std::string CFund::CProposal::ToString(CCoinsViewCache& coins, uint32_t currentT
 bool CFund::CProposal::HasPendingPaymentRequests(CCoinsViewCache& coins) const {
     AssertLockHeld(cs_main);
 
-    CPaymentRequestMap mapPaymentRequests;
+    std::set<uint256> setPaymentRequests;
 
-    if(coins.GetAllPaymentRequests(mapPaymentRequests))
+    if(coins.GetProposalPaymentRequests(hash, setPaymentRequests))
     {
-        for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
+        for (const uint256& prid: setPaymentRequests)
         {
             CFund::CPaymentRequest prequest;
 
-            if (!coins.GetPaymentRequest(it_->first, prequest))
-                continue;
-
-            if (prequest.proposalhash != hash)
+            if (!coins.GetPaymentRequest(prid, prequest))
                 continue;
 
             if(prequest.CanVote(coins))
@@ -677,22 +668,19 @@ void CFund::CProposal::ToJson(UniValue& ret, CCoinsViewCache& coins) const {
     ret.pushKV("state", (uint64_t)GetLastState());
     if(blockhash != uint256())
         ret.pushKV("stateChangedOnBlock", blockhash.ToString());
-    CPaymentRequestMap mapPaymentRequests;
+    std::set<uint256> setPaymentRequests;
 
-    if(coins.GetAllPaymentRequests(mapPaymentRequests))
+    if(coins.GetProposalPaymentRequests(hash, setPaymentRequests))
     {
         UniValue preq(UniValue::VOBJ);
         UniValue arr(UniValue::VARR);
         CFund::CPaymentRequest prequest;
 
-        for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
+        for (const uint256& prid: setPaymentRequests)
         {
             CFund::CPaymentRequest prequest;
 
-            if (!coins.GetPaymentRequest(it_->first, prequest))
-                continue;
-
-            if (prequest.proposalhash != hash)
+            if (!coins.GetPaymentRequest(prid, prequest))
                 continue;
 
             prequest.ToJson(preq, false);
@@ -724,6 +712,48 @@ void CFund::CPaymentRequest::ToJson(UniValue& ret, bool root) const {
 }
 
 
+bool CFund::GetProposalsByState(CCoinsViewCache& coins, flags nState, CProposalMap& mapProposals)
+{
+    AssertLockHeld(cs_main);
+
+    mapProposals.clear();
+
+    std::set<uint256> setCandidates;
+
+    if (!coins.GetProposalStateCandidates(nState, setCandidates))
+        return false;
+
+    for (const uint256& hash: setCandidates)
+    {
+        CProposal proposal;
+        if (coins.GetProposal(hash, proposal) && proposal.GetLastState() == nState)
+            mapProposals.insert(make_pair(hash, proposal));
+    }
+
+    return true;
+}
+
+bool CFund::GetPaymentRequestsByState(CCoinsViewCache& coins, flags nState, CPaymentRequestMap& mapPaymentRequests)
+{
+    AssertLockHeld(cs_main);
+
+    mapPaymentRequests.clear();
+
+    std::set<uint256> setCandidates;
+
+    if (!coins.GetPaymentRequestStateCandidates(nState, setCandidates))
+        return false;
+
+    for (const uint256& hash: setCandidates)
+    {
+        CPaymentRequest prequest;
+        if (coins.GetPaymentRequest(hash, prequest) && prequest.GetLastState() == nState)
+            mapPaymentRequests.insert(make_pair(hash, prequest));
+    }
+
+    return true;
+}
+
 bool CFund::IsBeginningCycle(const CBlockIndex* pindex, CChainParams params)
 {
     return pindex->nHeight % params.GetConsensus().nBlocksPerVotingCycle == 0;
@@ -734,8 +764,59 @@ bool CFund::IsEndCycle(const CBlockIndex* pindex, CChainParams params)
     return (pindex->nHeight+1) % params.GetConsensus().nBlocksPerVotingCycle == 0;
 }
 
+/** Vote tallies of the current voting cycle, up to and including pindexCacheVotes */
 std::map<uint256, std::pair<int, int>> vCacheProposalsToUpdate;
 std::map<uint256, std::pair<int, int>> vCachePaymentRequestToUpdate;
+const CBlockIndex* pindexCacheVotes = nullptr;
+uint256 hashCacheVotes;
+
+/** Tallies which could not be written yet, as their proposal or payment request was not in the view */
+std::set<uint256> setCacheProposalsPending;
+std::set<uint256> setCachePaymentRequestsPending;
+
+// Add (nSign = 1) or remove (nSign = -1) the votes of a block to the tallies. Only the
+// first vote of a block for a given hash counts.
+static void CountBlockVotes(const CBlockIndex* pindex, int nSign, std::set<uint256>& setProposalsChanged, std::set<uint256>& setPaymentRequestsChanged)
+{
+    std::set<uint256> setSeen;
+
+    for(unsigned int i = 0; i < pindex->vProposalVotes.size(); i++)
+    {
+        const uint256& hash = pindex->vProposalVotes[i].first;
+        if(!setSeen.insert(hash).second)
+            continue;
+
+        std::pair<int, int>& votes = vCacheProposalsToUpdate[hash];
+        if(pindex->vProposalVotes[i].second)
+            votes.first += nSign;
+        else
+            votes.second += nSign;
+
+        // Hashes without any vote left are not part of the tally
+        if(votes.first == 0 && votes.second == 0)
+            vCacheProposalsToUpdate.erase(hash);
+
+        setProposalsChanged.insert(hash);
+    }
+
+    for(unsigned int i = 0; i < pindex->vPaymentRequestVotes.size(); i++)
+    {
+        const uint256& hash = pindex->vPaymentRequestVotes[i].first;
+        if(!setSeen.insert(hash).second)
+            continue;
+
+        std::pair<int, int>& votes = vCachePaymentRequestToUpdate[hash];
+        if(pindex->vPaymentRequestVotes[i].second)
+            votes.first += nSign;
+        else
+            votes.second += nSign;
+
+        if(votes.first == 0 && votes.second == 0)
+            vCachePaymentRequestToUpdate.erase(hash);
+
+        setPaymentRequestsChanged.insert(hash);
+    }
+}
 
 void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, const bool fUndo, CCoinsViewCache& view)
 {
@@ -750,113 +831,135 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
     }
 
     int64_t nTimeStart = GetTimeMicros();
-    int nBlocks = (pindexNew->nHeight % Params().GetConsensus().nBlocksPerVotingCycle) + 1;
-    const CBlockIndex* pindexblock = pindexNew;
-
-    std::map<uint256, bool> vSeen;
+    int nBlocksPerVotingCycle = Params().GetConsensus().nBlocksPerVotingCycle;
 
-    if (fUndo || nBlocks == 1 || vCacheProposalsToUpdate.empty() || vCachePaymentRequestToUpdate.empty()) {
-        vCacheProposalsToUpdate.clear();
-        vCachePaymentRequestToUpdate.clear();
-    } else {
-        nBlocks = 1;
-    }
+    std::set<uint256> setProposalsChanged;
+    std::set<uint256> setPaymentRequestsChanged;
+    bool fRewriteAll = fUndo;
 
     int64_t nTimeStart2 = GetTimeMicros();
 
-    while(nBlocks > 0 && pindexblock != nullptr)
+    // The tallies follow the chain one block at a time; they are only counted again
+    // from the start of the cycle when they do not belong to the parent block
+    if (fUndo && pindexCacheVotes == pindexDelete && hashCacheVotes == pindexDelete->GetBlockHash() &&
+            pindexDelete->nHeight % nBlocksPerVotingCycle != 0)
     {
-        CProposal proposal;
-        CPaymentRequest prequest;
+        CountBlockVotes(pindexDelete, -1, setProposalsChanged, setPaymentRequestsChanged);
+    }
+    else if (!fUndo && pindexNew->pprev && pindexCacheVotes == pindexNew->pprev && hashCacheVotes == pindexNew->pprev->GetBlockHash() &&
+            pindexNew->nHeight % nBlocksPerVotingCycle != 0)
+    {
+        CountBlockVotes(pindexNew, 1, setProposalsChanged, setPaymentRequestsChanged);
+    }
+    else
+    {
+        vCacheProposalsToUpdate.clear();
+        vCachePaymentRequestToUpdate.clear();
+        setCacheProposalsPending.clear();
+        setCachePaymentRequestsPending.clear();
+        fRewriteAll = true;
 
-        vSeen.clear();
+        int nBlocks = (pindexNew->nHeight % nBlocksPerVotingCycle) + 1;
+        const CBlockIndex* pindexblock = pindexNew;
 
-        for(unsigned int i = 0; i < pindexblock->vProposalVotes.size(); i++)
+        while(nBlocks > 0 && pindexblock != nullptr)
         {
-            if(vSeen.count(pindexblock->vProposalVotes[i].first) == 0)
-            {
-                if(vCacheProposalsToUpdate.count(pindexblock->vProposalVotes[i].first) == 0)
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first] = make_pair(0, 0);
-
-                if(pindexblock->vProposalVotes[i].second)
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first].first += 1;
-                else
-                    vCacheProposalsToUpdate[pindexblock->vProposalVotes[i].first].second += 1;
-
-                vSeen[pindexblock->vProposalVotes[i].first]=true;
-            }
+            CountBlockVotes(pindexblock, 1, setProposalsChanged, setPaymentRequestsChanged);
+            pindexblock = pindexblock->pprev;
+            nBlocks--;
         }
-
-        for(unsigned int i = 0; i < pindexblock->vPaymentRequestVotes.size(); i++)
-        {
-            if(vSeen.count(pindexblock->vPaymentRequestVotes[i].first) == 0)
-            {
-                if(vCachePaymentRequestToUpdate.count(pindexblock->vPaymentRequestVotes[i].first) == 0)
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first] = make_pair(0, 0);
-
-                if(pindexblock->vPaymentRequestVotes[i].second)
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first].first += 1;
-                else
-                    vCachePaymentRequestToUpdate[pindexblock->vPaymentRequestVotes[i].first].second += 1;
-
-                vSeen[pindexblock->vPaymentRequestVotes[i].first]=true;
-            }
-        }
-        pindexblock = pindexblock->pprev;
-        nBlocks--;
     }
 
-    vSeen.clear();
+    pindexCacheVotes = pindexNew;
+    hashCacheVotes = pindexNew->GetBlockHash();
 
     int64_t nTimeEnd2 = GetTimeMicros();
     LogPrint("bench", "   - CFund count votes from headers: %.2fms\n", (nTimeEnd2 - nTimeStart2) * 0.001);
 
     int64_t nTimeStart3 = GetTimeMicros();
-    std::map<uint256, std::pair<int, int>>::iterator it;
 
     bool fLog = LogAcceptCategory("dao");
 
-    for(it = vCacheProposalsToUpdate.begin(); it != vCacheProposalsToUpdate.end(); it++)
+    // Write the tallies which changed, and the ones still waiting for their entry
+    std::set<uint256> setProposalsToWrite;
+    if (fRewriteAll)
+    {
+        for (auto& it: vCacheProposalsToUpdate)
+            setProposalsToWrite.insert(it.first);
+    }
+    else
+    {
+        setProposalsToWrite.swap(setProposalsChanged);
+        setProposalsToWrite.insert(setCacheProposalsPending.begin(), setCacheProposalsPending.end());
+    }
+
+    for (const uint256& hash: setProposalsToWrite)
     {
-        if (view.HaveProposal(it->first))
+        std::map<uint256, std::pair<int, int>>::iterator it = vCacheProposalsToUpdate.find(hash);
+        if (it == vCacheProposalsToUpdate.end() || !view.HaveProposal(hash))
         {
-            CProposal tmp; CProposal oldproposal = CProposal();
-            if (fLog)
-            {
-                view.GetProposal(it->first, tmp);
-                tmp.swap(oldproposal);
-            }
-            CProposalModifier proposal = view.ModifyProposal(it->first);
-            proposal->nVotesYes = it->second.first;
-            proposal->nVotesNo = it->second.second;
-            if (*proposal != oldproposal)
-            {
-                proposal->fDirty = true;
-                if (fLog) LogPrintf("%s: Updated proposal %s votes at height %d: yes(%d) no(%d)\n", __func__, proposal->hash.ToString(), pindexNew->nHeight, proposal->nVotesYes, proposal->nVotesNo);
-            }
-            vSeen[proposal->hash]=true;
+            if (it != vCacheProposalsToUpdate.end())
+                setCacheProposalsPending.insert(hash);
+            else
+                setCacheProposalsPending.erase(hash);
+            continue;
+        }
+        setCacheProposalsPending.erase(hash);
+
+        CProposal tmp; CProposal oldproposal = CProposal();
+        if (fLog)
+        {
+            view.GetProposal(it->first, tmp);
+            tmp.swap(oldproposal);
+        }
+        CProposalModifier proposal = view.ModifyProposal(it->first);
+        proposal->nVotesYes = it->second.first;
+        proposal->nVotesNo = it->second.second;
+        if (*proposal != oldproposal)
+        {
+            proposal->fDirty = true;
+            if (fLog) LogPrintf("%s: Updated proposal %s votes at height %d: yes(%d) no(%d)\n", __func__, proposal->hash.ToString(), pindexNew->nHeight, proposal->nVotesYes, proposal->nVotesNo);
         }
     }
 
-    for(it = vCachePaymentRequestToUpdate.begin(); it != vCachePaymentRequestToUpdate.end(); it++)
+    std::set<uint256> setPaymentRequestsToWrite;
+    if (fRewriteAll)
     {
-        if(view.HavePaymentRequest(it->first))
+        for (auto& it: vCachePaymentRequestToUpdate)
+            setPaymentRequestsToWrite.insert(it.first);
+    }
+    else
+    {
+        setPaymentRequestsToWrite.swap(setPaymentRequestsChanged);
+        setPaymentRequestsToWrite.insert(setCachePaymentRequestsPending.begin(), setCachePaymentRequestsPending.end());
+    }
+
+    for (const uint256& hash: setPaymentRequestsToWrite)
+    {
+        std::map<uint256, std::pair<int, int>>::iterator it = vCachePaymentRequestToUpdate.find(hash);
+        if (it == vCachePaymentRequestToUpdate.end() || !view.HavePaymentRequest(hash))
         {
-            CPaymentRequest tmp; CPaymentRequest oldprequest = CPaymentRequest();
-            if (fLog)
-            {
-                view.GetPaymentRequest(it->first, tmp);
-                tmp.swap(oldprequest);
-            }
-            CPaymentRequestModifier prequest = view.ModifyPaymentRequest(it->first);
-            prequest->nVotesYes = it->second.first;
-            prequest->nVotesNo = it->second.second;
-            if (*prequest != oldprequest)
-            {
-                prequest->fDirty = true;
-                if (fLog) LogPrintf("%s: Updated payment request %s votes at height %d: yes(%d) no(%d)\n", __func__, prequest->hash.ToString(), pindexNew->nHeight, prequest->nVotesYes, prequest->nVotesNo);
-            }
-            vSeen[prequest->hash]=true;
+            if (it != vCachePaymentRequestToUpdate.end())
+                setCachePaymentRequestsPending.insert(hash);
+            else
+                setCachePaymentRequestsPending.erase(hash);
+            continue;
+        }
+        setCachePaymentRequestsPending.erase(hash);
+
+        CPaymentRequest tmp; CPaymentRequest oldprequest = CPaymentRequest();
+        if (fLog)
+        {
+            view.GetPaymentRequest(it->first, tmp);
+            tmp.swap(oldprequest);
+        }
+        CPaymentRequestModifier prequest = view.ModifyPaymentRequest(it->first);
+        prequest->nVotesYes = it->second.first;
+        prequest->nVotesNo = it->second.second;
+        if (*prequest != oldprequest)
+        {
+            prequest->fDirty = true;
+            if (fLog) LogPrintf("%s: Updated payment request %s votes at height %d: yes(%d) no(%d)\n", __func__, prequest->hash.ToString(), pindexNew->nHeight, prequest->nVotesYes, prequest->nVotesNo);
         }
     }
 
@@ -864,9 +967,17 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
     LogPrint("bench", "   - CFund update votes: %.2fms\n", (nTimeEnd3 - nTimeStart3) * 0.001);
 
     int64_t nTimeStart4 = GetTimeMicros();
+
+    // Voting cycles only change at the first block of a cycle and states are only set at the
+    // last one, so the state pass can skip every other block. Undoing a block also needs to
+    // clear the payment requests it paid.
+    int nHeightStep = fUndo ? pindexDelete->nHeight : pindexNew->nHeight;
+    bool fCycleBoundary = pindexNew->nHeight % nBlocksPerVotingCycle == 0 || nHeightStep % nBlocksPerVotingCycle == 0 ||
+            (nHeightStep + 1) % nBlocksPerVotingCycle == 0;
+
     CPaymentRequestMap mapPaymentRequests;
 
-    if(view.GetAllPaymentRequests(mapPaymentRequests))
+    if((fUndo || fCycleBoundary) && view.GetAllPaymentRequests(mapPaymentRequests))
     {
         for (CPaymentRequestMap::iterator it = mapPaymentRequests.begin(); it != mapPaymentRequests.end(); it++)
         {
@@ -889,8 +1000,8 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
 
             bool fUpdate = false;
 
-            int nCreatedOnCycle = (pblockindex->nHeight / Params().GetConsensus().nBlocksPerVotingCycle);
-            int nCurrentCycle = (pindexNew->nHeight / Params().GetConsensus().nBlocksPerVotingCycle);
+            int nCreatedOnCycle = (pblockindex->nHeight / nBlocksPerVotingCycle);
+            int nCurrentCycle = (pindexNew->nHeight / nBlocksPerVotingCycle);
             int nElapsedCycles = std::max(nCurrentCycle - nCreatedOnCycle, 0);
             int nVotingCycles = std::min(nElapsedCycles, (int)Params().GetConsensus().nCyclesPaymentRequestVoting + 1);
 
@@ -927,7 +1038,7 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
                     fUpdate = true;
                 }
 
-                if((pindexNew->nHeight + 1) % Params().GetConsensus().nBlocksPerVotingCycle == 0)
+                if((pindexNew->nHeight + 1) % nBlocksPerVotingCycle == 0)
                 {
                     if(prequest->IsExpired())
                     {
@@ -962,11 +1073,11 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
                 }
             }
 
-            if((pindexNew->nHeight) % Params().GetConsensus().nBlocksPerVotingCycle == 0)
+            if((pindexNew->nHeight) % nBlocksPerVotingCycle == 0)
             {
                 flags proposalState = proposal.GetLastState();
 
-                if (!vSeen.count(prequest->hash) && prequest->GetLastState() == CFund::NIL &&
+                if (!vCachePaymentRequestToUpdate.count(prequest->hash) && prequest->GetLastState() == CFund::NIL &&
                     !((proposalState == CFund::ACCEPTED || proposalState == CFund::PENDING_VOTING_PREQ) && prequest->IsAccepted())){
                     prequest->nVotesYes = 0;
                     prequest->nVotesNo = 0;
@@ -989,7 +1100,7 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
     int64_t nTimeStart5 = GetTimeMicros();
     CProposalMap mapProposals;
 
-    if(view.GetAllProposals(mapProposals))
+    if(fCycleBoundary && view.GetAllProposals(mapProposals))
     {
         for (CProposalMap::iterator it = mapProposals.begin(); it != mapProposals.end(); it++)
         {
@@ -1012,8 +1123,8 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
 
             bool fUpdate = false;
 
-            int nCreatedOnCycle = (pblockindex->nHeight / Params().GetConsensus().nBlocksPerVotingCycle);
-            int nCurrentCycle = (pindexNew->nHeight / Params().GetConsensus().nBlocksPerVotingCycle);
+            int nCreatedOnCycle = (pblockindex->nHeight / nBlocksPerVotingCycle);
+            int nCurrentCycle = (pindexNew->nHeight / nBlocksPerVotingCycle);
             int nElapsedCycles = std::max(nCurrentCycle - nCreatedOnCycle, 0);
             int nVotingCycles = std::min(nElapsedCycles, (int)Params().GetConsensus().nCyclesProposalVoting + 1);
 
@@ -1045,7 +1156,7 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
                     fUpdate = true;
                 }
 
-                if((pindexNew->nHeight + 1) % Params().GetConsensus().nBlocksPerVotingCycle == 0)
+                if((pindexNew->nHeight + 1) % nBlocksPerVotingCycle == 0)
                 {
                     if(proposal->IsExpired(pindexNew->GetBlockTime()))
                     {
@@ -1098,9 +1209,9 @@ void CFund::CFundStep(const CValidationState& state, CBlockIndex *pindexNew, con
                 }
             }
 
-            if((pindexNew->nHeight) % Params().GetConsensus().nBlocksPerVotingCycle == 0)
+            if((pindexNew->nHeight) % nBlocksPerVotingCycle == 0)
             {
-                if (!vSeen.count(proposal->hash) && proposal->GetLastState() == CFund::NIL)
+                if (!vCacheProposalsToUpdate.count(proposal->hash) && proposal->GetLastState() == CFund::NIL)
                 {
                     proposal->nVotesYes = 0;
                     proposal->nVotesNo = 0;
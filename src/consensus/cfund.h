@@ -436,6 +436,10 @@ bool IsBeginningCycle(const CBlockIndex* pindex, CChainParams params);
 bool IsEndCycle(const CBlockIndex* pindex, CChainParams params);
 void CFundStep(const CValidationState& state, CBlockIndex *pindexNew, const bool fUndo, CCoinsViewCache& coins);
 
+/** Proposals and payment requests of coins whose last state is nState, looked up through the state index */
+bool GetProposalsByState(CCoinsViewCache& coins, flags nState, std::map<uint256, CProposal>& mapProposals);
+bool GetPaymentRequestsByState(CCoinsViewCache& coins, flags nState, std::map<uint256, CPaymentRequest>& mapPaymentRequests);
+
 }
 
 #endif // NAVCOIN_CFUND_H
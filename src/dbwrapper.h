@@ -83,6 +83,22 @@ public:
 
         batch.Delete(slKey);
     }
+
+    /** Write a key and a value which are already serialized */
+    void WriteSerialized(const std::string& strKey, const std::string& strValue)
+    {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
+        leveldb::Slice slValue(&ssValue[0], ssValue.size());
+
+        batch.Put(strKey, slValue);
+    }
+
+    /** Erase a key which is already serialized */
+    void EraseSerialized(const std::string& strKey)
+    {
+        batch.Delete(strKey);
+    }
 };
 
 class CDBIterator
@@ -130,6 +146,11 @@ public:
         return piter->key().size();
     }
 
+    /** The key as it is serialized in the database */
+    std::string GetKeySerialized() {
+        return piter->key().ToString();
+    }
+
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
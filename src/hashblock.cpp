@@ -0,0 +1,321 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <hashblock.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__))
+#define HASH9_ENABLE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#define HASH9_STAGE(name, in, out) do { \
+        sph_##name##512_init(&ctx.name); \
+        sph_##name##512(&ctx.name, in, 64); \
+        sph_##name##512_close(&ctx.name, out); \
+    } while (0)
+
+CHash9::CHash9()
+{
+    sph_blake512_init(&ctxBlake);
+}
+
+CHash9& CHash9::Write(const unsigned char* data, size_t len)
+{
+    sph_blake512(&ctxBlake, data, len);
+    return *this;
+}
+
+void CHash9::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    sph_blake512_close(&ctxBlake, buf);
+    HASH9_STAGE(bmw, buf, buf);
+    HASH9_STAGE(groestl, buf, buf);
+    HASH9_STAGE(skein, buf, buf);
+    HASH9_STAGE(jh, buf, buf);
+    HASH9_STAGE(keccak, buf, buf);
+    HASH9_STAGE(luffa, buf, buf);
+    HASH9_STAGE(cubehash, buf, buf);
+    HASH9_STAGE(shavite, buf, buf);
+    HASH9_STAGE(simd, buf, buf);
+    HASH9_STAGE(echo, buf, buf);
+    HASH9_STAGE(hamsi, buf, buf);
+    HASH9_STAGE(fugue, buf, buf);
+    memcpy(hash, buf, OUTPUT_SIZE);
+}
+
+CHash9& CHash9::Reset()
+{
+    sph_blake512_init(&ctxBlake);
+    return *this;
+}
+
+#undef HASH9_STAGE
+
+namespace {
+
+// One X13 function over a single buffer, through the sph reference implementation
+#define HASH9_SCALAR(name) \
+    void Scalar_##name(const void* pin, size_t nLen, void* pout) \
+    { \
+        sph_##name##512_context ctx; \
+        sph_##name##512_init(&ctx); \
+        sph_##name##512(&ctx, pin, nLen); \
+        sph_##name##512_close(&ctx, pout); \
+    }
+
+HASH9_SCALAR(blake)
+HASH9_SCALAR(bmw)
+HASH9_SCALAR(groestl)
+HASH9_SCALAR(skein)
+HASH9_SCALAR(jh)
+HASH9_SCALAR(keccak)
+HASH9_SCALAR(luffa)
+HASH9_SCALAR(cubehash)
+HASH9_SCALAR(shavite)
+HASH9_SCALAR(simd)
+HASH9_SCALAR(echo)
+HASH9_SCALAR(hamsi)
+HASH9_SCALAR(fugue)
+
+#undef HASH9_SCALAR
+
+typedef void (*Hash9Function)(const void* pin, size_t nLen, void* pout);
+
+/** The X13 chain, in the order of Hash9 */
+const Hash9Function HASH9_CHAIN[] = {
+    Scalar_blake, Scalar_bmw, Scalar_groestl, Scalar_skein, Scalar_jh, Scalar_keccak, Scalar_luffa,
+    Scalar_cubehash, Scalar_shavite, Scalar_simd, Scalar_echo, Scalar_hamsi, Scalar_fugue
+};
+const size_t HASH9_CHAIN_LENGTH = sizeof(HASH9_CHAIN) / sizeof(HASH9_CHAIN[0]);
+const size_t HASH9_STAGE_KECCAK = 5;
+
+/** Size of the block headers which the multi-buffer blake512 kernel is specialized for */
+const size_t HASH9_HEADER_SIZE = 80;
+
+#ifdef HASH9_ENABLE_AVX2
+
+bool fHash9AVX2 = false;
+
+__attribute__((target("avx2")))
+inline __m256i Load4x64(uint64_t a, uint64_t b, uint64_t c, uint64_t d)
+{
+    return _mm256_set_epi64x(d, c, b, a);
+}
+
+__attribute__((target("avx2")))
+inline __m256i RotateRight64(__m256i x, int n)
+{
+    return _mm256_or_si256(_mm256_srl_epi64(x, _mm_cvtsi32_si128(n)), _mm256_sll_epi64(x, _mm_cvtsi32_si128(64 - n)));
+}
+
+__attribute__((target("avx2")))
+inline void Store4x64(__m256i x, uint64_t out[4])
+{
+    _mm256_storeu_si256((__m256i*)out, x);
+}
+
+const uint64_t BLAKE512_IV[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL, 0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL, 0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL
+};
+
+const uint64_t BLAKE512_CB[16] = {
+    0x243F6A8885A308D3ULL, 0x13198A2E03707344ULL, 0xA4093822299F31D0ULL, 0x082EFA98EC4E6C89ULL,
+    0x452821E638D01377ULL, 0xBE5466CF34E90C6CULL, 0xC0AC29B7C97C50DDULL, 0x3F84D5B5B5470917ULL,
+    0x9216D5D98979FB1BULL, 0xD1310BA698DFB5ACULL, 0x2FFD72DBD01ADFB7ULL, 0xB8E1AFED6A267E96ULL,
+    0xBA7C9045F12C7F99ULL, 0x24A19947B3916CF7ULL, 0x0801F2E2858EFC16ULL, 0x636920D871574E69ULL
+};
+
+const unsigned char BLAKE512_SIGMA[10][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 }
+};
+
+__attribute__((target("avx2")))
+inline void Blake512G(const __m256i* M, const unsigned char* sigma, int i, __m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    const __m256i rot16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+                                           2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    unsigned int s0 = sigma[2 * i], s1 = sigma[2 * i + 1];
+
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), _mm256_xor_si256(M[s0], _mm256_set1_epi64x(BLAKE512_CB[s1])));
+    d = _mm256_shuffle_epi32(_mm256_xor_si256(d, a), 0xB1);
+    c = _mm256_add_epi64(c, d);
+    b = RotateRight64(_mm256_xor_si256(b, c), 25);
+    a = _mm256_add_epi64(_mm256_add_epi64(a, b), _mm256_xor_si256(M[s1], _mm256_set1_epi64x(BLAKE512_CB[s0])));
+    d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+    c = _mm256_add_epi64(c, d);
+    b = RotateRight64(_mm256_xor_si256(b, c), 11);
+}
+
+/** blake512 of four 80 byte buffers, which fit in a single padded block */
+__attribute__((target("avx2")))
+void Blake512_80_4way(const unsigned char* const pin[4], unsigned char pout[4][64])
+{
+    __m256i M[16];
+    for (int i = 0; i < 10; i++)
+        M[i] = Load4x64(ReadBE64(pin[0] + 8 * i), ReadBE64(pin[1] + 8 * i), ReadBE64(pin[2] + 8 * i), ReadBE64(pin[3] + 8 * i));
+    M[10] = _mm256_set1_epi64x(0x8000000000000000ULL);
+    M[11] = _mm256_setzero_si256();
+    M[12] = _mm256_setzero_si256();
+    M[13] = _mm256_set1_epi64x(1);
+    M[14] = _mm256_setzero_si256();
+    M[15] = _mm256_set1_epi64x(HASH9_HEADER_SIZE * 8);
+
+    __m256i V[16];
+    for (int i = 0; i < 8; i++)
+        V[i] = _mm256_set1_epi64x(BLAKE512_IV[i]);
+    for (int i = 0; i < 4; i++)
+        V[8 + i] = _mm256_set1_epi64x(BLAKE512_CB[i]);
+    V[12] = _mm256_set1_epi64x(BLAKE512_CB[4] ^ (HASH9_HEADER_SIZE * 8));
+    V[13] = _mm256_set1_epi64x(BLAKE512_CB[5] ^ (HASH9_HEADER_SIZE * 8));
+    V[14] = _mm256_set1_epi64x(BLAKE512_CB[6]);
+    V[15] = _mm256_set1_epi64x(BLAKE512_CB[7]);
+
+    for (int r = 0; r < 16; r++) {
+        const unsigned char* sigma = BLAKE512_SIGMA[r % 10];
+        Blake512G(M, sigma, 0, V[0], V[4], V[8], V[12]);
+        Blake512G(M, sigma, 1, V[1], V[5], V[9], V[13]);
+        Blake512G(M, sigma, 2, V[2], V[6], V[10], V[14]);
+        Blake512G(M, sigma, 3, V[3], V[7], V[11], V[15]);
+        Blake512G(M, sigma, 4, V[0], V[5], V[10], V[15]);
+        Blake512G(M, sigma, 5, V[1], V[6], V[11], V[12]);
+        Blake512G(M, sigma, 6, V[2], V[7], V[8], V[13]);
+        Blake512G(M, sigma, 7, V[3], V[4], V[9], V[14]);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t h[4];
+        Store4x64(_mm256_xor_si256(_mm256_set1_epi64x(BLAKE512_IV[i]), _mm256_xor_si256(V[i], V[i + 8])), h);
+        for (int l = 0; l < 4; l++)
+            WriteBE64(pout[l] + 8 * i, h[l]);
+    }
+}
+
+const uint64_t KECCAK_RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+const int KECCAK_ROTC[24] = { 1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44 };
+const int KECCAK_PILN[24] = { 10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1 };
+
+/** keccak512 of four 64 byte buffers, which fit in a single padded block. pin and pout may alias. */
+__attribute__((target("avx2")))
+void Keccak512_64_4way(const unsigned char pin[4][64], unsigned char pout[4][64])
+{
+    __m256i A[25];
+    for (int i = 0; i < 8; i++)
+        A[i] = Load4x64(ReadLE64(pin[0] + 8 * i), ReadLE64(pin[1] + 8 * i), ReadLE64(pin[2] + 8 * i), ReadLE64(pin[3] + 8 * i));
+    // sph_keccak pads with 0x01 ... 0x80 at the end of the 72 byte rate
+    A[8] = _mm256_set1_epi64x(0x8000000000000001ULL);
+    for (int i = 9; i < 25; i++)
+        A[i] = _mm256_setzero_si256();
+
+    for (int r = 0; r < 24; r++) {
+        __m256i C[5];
+        for (int x = 0; x < 5; x++)
+            C[x] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(A[x], A[x + 5]), _mm256_xor_si256(A[x + 10], A[x + 15])), A[x + 20]);
+        for (int x = 0; x < 5; x++) {
+            __m256i D = _mm256_xor_si256(C[(x + 4) % 5], RotateRight64(C[(x + 1) % 5], 63));
+            for (int y = 0; y < 25; y += 5)
+                A[y + x] = _mm256_xor_si256(A[y + x], D);
+        }
+
+        __m256i t = A[1];
+        for (int i = 0; i < 24; i++) {
+            int j = KECCAK_PILN[i];
+            __m256i tmp = A[j];
+            A[j] = RotateRight64(t, 64 - KECCAK_ROTC[i]);
+            t = tmp;
+        }
+
+        for (int y = 0; y < 25; y += 5) {
+            __m256i B[5];
+            for (int x = 0; x < 5; x++)
+                B[x] = A[y + x];
+            for (int x = 0; x < 5; x++)
+                A[y + x] = _mm256_xor_si256(B[x], _mm256_andnot_si256(B[(x + 1) % 5], B[(x + 2) % 5]));
+        }
+
+        A[0] = _mm256_xor_si256(A[0], _mm256_set1_epi64x(KECCAK_RC[r]));
+    }
+
+    for (int i = 0; i < 8; i++) {
+        uint64_t h[4];
+        Store4x64(A[i], h);
+        for (int l = 0; l < 4; l++)
+            WriteLE64(pout[l] + 8 * i, h[l]);
+    }
+}
+
+#endif // HASH9_ENABLE_AVX2
+
+} // anon namespace
+
+std::string Hash9AutoDetect()
+{
+#ifdef HASH9_ENABLE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fHash9AVX2 = true;
+        return "avx2(4way blake512,keccak512)";
+    }
+#endif
+    return "standard";
+}
+
+void Hash9Batch(const unsigned char* const* ppdata, size_t nLen, uint256* phashes, size_t nCount)
+{
+    for (size_t nOffset = 0; nOffset < nCount; nOffset += HASH9_BATCH_LANES) {
+        size_t nLanes = std::min(HASH9_BATCH_LANES, nCount - nOffset);
+
+        // Short batches repeat their last buffer, so the multi-buffer kernels always see full lanes
+        const unsigned char* pin[HASH9_BATCH_LANES];
+        for (size_t l = 0; l < HASH9_BATCH_LANES; l++)
+            pin[l] = ppdata[nOffset + std::min(l, nLanes - 1)];
+
+        unsigned char state[HASH9_BATCH_LANES][64] = {};
+        unsigned char next[HASH9_BATCH_LANES][64];
+
+        for (size_t nStage = 0; nStage < HASH9_CHAIN_LENGTH; nStage++) {
+#ifdef HASH9_ENABLE_AVX2
+            if (fHash9AVX2 && nStage == 0 && nLen == HASH9_HEADER_SIZE) {
+                Blake512_80_4way(pin, state);
+                continue;
+            }
+            if (fHash9AVX2 && nStage == HASH9_STAGE_KECCAK) {
+                Keccak512_64_4way(state, state);
+                continue;
+            }
+#endif
+            for (size_t l = 0; l < nLanes; l++) {
+                if (nStage == 0)
+                    HASH9_CHAIN[nStage](pin[l], nLen, next[l]);
+                else
+                    HASH9_CHAIN[nStage](state[l], 64, next[l]);
+                memcpy(state[l], next[l], 64);
+            }
+        }
+
+        for (size_t l = 0; l < nLanes; l++)
+            memcpy(phashes[nOffset + l].begin(), state[l], 32);
+    }
+}
@@ -9,3 +9,210 @@
 #include <timedata.h>
 #include <txdb.h>
 #include <main.h>
+
+#include <chainparams.h>
+#include <checkqueue.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <streams.h>
+
+#include <string.h>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+int nStakerThreads = 0;
+
+uint256 GetStakeKernelHash(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout, unsigned int nTimeTx)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << nTimeTxPrev << prevout.hash << prevout.n << nTimeTx;
+    return ss.GetHash();
+}
+
+// Widen a 256 bit value to 512 bits without a round trip through its hex representation
+static arith_uint512 ToArith512(const uint256& a)
+{
+    uint512 b;
+    memcpy(b.begin(), a.begin(), a.size());
+    return UintToArith512(b);
+}
+
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn) : pindexPrev(pindexPrevIn), nBits(nBitsIn)
+{
+    nStakeModifier = pindexPrev->nStakeModifier;
+    nStakeMinAge = Params().GetConsensus().nStakeMinAge;
+
+    arith_uint256 bnTarget256;
+    bnTarget256.SetCompact(nBits);
+    bnTarget = ToArith512(ArithToUint256(bnTarget256));
+}
+
+bool CStakeKernelSearch::IsPrepared(const CStakeKernelCoin& coin) const
+{
+    return coin.fPrepared && coin.nPreparedModifier == nStakeModifier && coin.nPreparedBits == nBits;
+}
+
+void CStakeKernelSearch::Prepare(CStakeKernelCoin& coin) const
+{
+    if (IsPrepared(coin))
+        return;
+
+    if (!coin.fPrepared || coin.nPreparedModifier != nStakeModifier)
+    {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << nStakeModifier << coin.nTimeBlockFrom << coin.nTimeTxPrev << coin.prevout.hash << coin.prevout.n;
+        assert(ss.size() == sizeof(coin.vchPrefix));
+        std::copy(ss.begin(), ss.end(), coin.vchPrefix);
+    }
+
+    coin.bnWeightedTarget = bnTarget;
+    coin.bnWeightedTarget *= arith_uint512(coin.nValue);
+
+    coin.fPrepared = true;
+    coin.nPreparedModifier = nStakeModifier;
+    coin.nPreparedBits = nBits;
+}
+
+bool CStakeKernelSearch::CheckKernel(const CStakeKernelCoin& coin, unsigned int nTimeTx) const
+{
+    if (IsPrepared(coin))
+        return CheckPreparedKernel(coin, nTimeTx);
+
+    CStakeKernelCoin coinPrepared(coin);
+    Prepare(coinPrepared);
+    return CheckPreparedKernel(coinPrepared, nTimeTx);
+}
+
+bool CStakeKernelSearch::CheckPreparedKernel(const CStakeKernelCoin& coin, unsigned int nTimeTx) const
+{
+    if (nTimeTx < coin.nTimeTxPrev)
+        return false;
+
+    if (coin.nTimeBlockFrom + nStakeMinAge > nTimeTx)
+        return false;
+
+    // Same as GetStakeKernelHash, with everything but the timestamp already serialized
+    unsigned char vchTime[4];
+    WriteLE32(vchTime, nTimeTx);
+    uint256 hashProofOfStake;
+    CHash256().Write(coin.vchPrefix, sizeof(coin.vchPrefix)).Write(vchTime, sizeof(vchTime)).Finalize(hashProofOfStake.begin());
+
+    return ToArith512(hashProofOfStake) <= coin.bnWeightedTarget;
+}
+
+namespace {
+
+/** Outcome of a kernel search, shared by all the batches of the search */
+struct CStakeKernelSearchResult
+{
+    boost::mutex mutex;
+    bool fFound;
+    //! Position of the kernel in the coin x timestamp space
+    uint64_t nPos;
+
+    CStakeKernelSearchResult() : fFound(false), nPos(0) {}
+};
+
+/**
+ * A batch of kernel hashes to evaluate, covering the positions
+ * [nBegin, nEnd) of the coin x timestamp space of a search.
+ *
+ * Returns false once a kernel has been found, so the check queue stops
+ * handing out the remaining batches.
+ */
+class CStakeKernelCheck
+{
+private:
+    const CStakeKernelSearch* psearch;
+    const std::vector<CStakeKernelCoin>* pvCoins;
+    unsigned int nTimeTx;
+    unsigned int nSearchInterval;
+    uint64_t nBegin;
+    uint64_t nEnd;
+    CStakeKernelSearchResult* presult;
+
+public:
+    CStakeKernelCheck() : psearch(nullptr), pvCoins(nullptr), nTimeTx(0), nSearchInterval(0), nBegin(0), nEnd(0), presult(nullptr) {}
+    CStakeKernelCheck(const CStakeKernelSearch* psearchIn, const std::vector<CStakeKernelCoin>* pvCoinsIn, unsigned int nTimeTxIn,
+                      unsigned int nSearchIntervalIn, uint64_t nBeginIn, uint64_t nEndIn, CStakeKernelSearchResult* presultIn) :
+        psearch(psearchIn), pvCoins(pvCoinsIn), nTimeTx(nTimeTxIn), nSearchInterval(nSearchIntervalIn), nBegin(nBeginIn), nEnd(nEndIn), presult(presultIn) {}
+
+    bool operator()()
+    {
+        uint64_t nPos = nBegin;
+        while (nPos < nEnd)
+        {
+            const CStakeKernelCoin& coin = (*pvCoins)[nPos / nSearchInterval];
+            for (unsigned int n = nPos % nSearchInterval; n < nSearchInterval && nPos < nEnd; n++, nPos++)
+            {
+                if (psearch->CheckKernel(coin, nTimeTx - n))
+                {
+                    boost::unique_lock<boost::mutex> lock(presult->mutex);
+                    if (!presult->fFound || nPos < presult->nPos)
+                    {
+                        presult->fFound = true;
+                        presult->nPos = nPos;
+                    }
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(psearch, check.psearch);
+        std::swap(pvCoins, check.pvCoins);
+        std::swap(nTimeTx, check.nTimeTx);
+        std::swap(nSearchInterval, check.nSearchInterval);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(presult, check.presult);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CStakeKernelCheck> stakekernelqueue(1);
+
+void ThreadStakeKernelCheck() {
+    RenameThread("navcoin-kernel");
+    stakekernelqueue.Thread();
+}
+
+bool CStakeKernelSearch::Search(std::vector<CStakeKernelCoin>& vCoins, unsigned int nTimeTx, unsigned int nSearchInterval, size_t& nCoinRet, unsigned int& nTimeTxRet) const
+{
+    uint64_t nTotal = (uint64_t)vCoins.size() * nSearchInterval;
+    if (nTotal == 0)
+        return false;
+
+    // The workers only read the coins, so they must be prepared beforehand
+    for(CStakeKernelCoin& coin: vCoins)
+        Prepare(coin);
+
+    CStakeKernelSearchResult result;
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve((nTotal + STAKE_KERNEL_BATCH_SIZE - 1) / STAKE_KERNEL_BATCH_SIZE);
+    for (uint64_t nBegin = 0; nBegin < nTotal; nBegin += STAKE_KERNEL_BATCH_SIZE)
+        vChecks.push_back(CStakeKernelCheck(this, &vCoins, nTimeTx, nSearchInterval, nBegin,
+                                            std::min(nTotal, nBegin + STAKE_KERNEL_BATCH_SIZE), &result));
+
+    if (nStakerThreads) {
+        CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for(CStakeKernelCheck& check: vChecks)
+            if (!check())
+                break;
+    }
+
+    if (!result.fFound)
+        return false;
+
+    nCoinRet = result.nPos / nSearchInterval;
+    nTimeTxRet = nTimeTx - result.nPos % nSearchInterval;
+    return true;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2012-2013 The PPCoin developers
+// Copyright (c) 2014 The NavCoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_KERNEL_H
+#define NAVCOIN_KERNEL_H
+
+#include <amount.h>
+#include <arith_uint256.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <vector>
+
+class CBlockIndex;
+
+/** Maximum number of seconds a single kernel search looks back from the coinstake time */
+static const unsigned int MAX_STAKE_SEARCH_INTERVAL = 60;
+/** Maximum number of stake kernel search threads */
+static const int MAX_STAKER_THREADS = 16;
+/** -stakerthreads default (0 = auto) */
+static const int DEFAULT_STAKER_THREADS = 0;
+/** Number of kernel hashes evaluated by one batch of the staker thread pool */
+static const unsigned int STAKE_KERNEL_BATCH_SIZE = 512;
+/** Size of the serialized kernel hash input preceding the timestamp */
+static const unsigned int STAKE_KERNEL_PREFIX_SIZE = 52;
+
+extern int nStakerThreads;
+
+/** Compute the proof-of-stake kernel hash of a staked output at time nTimeTx */
+uint256 GetStakeKernelHash(uint64_t nStakeModifier, unsigned int nTimeBlockFrom, unsigned int nTimeTxPrev, const COutPoint& prevout, unsigned int nTimeTx);
+
+/**
+ * The per-output inputs of the stake kernel, which do not depend on the chain tip.
+ *
+ * Once prepared by a CStakeKernelSearch, it also holds the serialized kernel
+ * hash input up to the timestamp and the target scaled by the coin value, so
+ * trying a timestamp only costs hashing the trailing four bytes. Both stay
+ * valid for as long as the stake modifier and nBits they were built with.
+ */
+struct CStakeKernelCoin
+{
+    COutPoint prevout;
+    unsigned int nTimeBlockFrom;
+    unsigned int nTimeTxPrev;
+    CAmount nValue;
+
+    bool fPrepared;
+    uint64_t nPreparedModifier;
+    unsigned int nPreparedBits;
+    unsigned char vchPrefix[STAKE_KERNEL_PREFIX_SIZE];
+    arith_uint512 bnWeightedTarget;
+
+    CStakeKernelCoin() : nTimeBlockFrom(0), nTimeTxPrev(0), nValue(0), fPrepared(false), nPreparedModifier(0), nPreparedBits(0) {}
+    CStakeKernelCoin(const COutPoint& prevoutIn, unsigned int nTimeBlockFromIn, unsigned int nTimeTxPrevIn, CAmount nValueIn) :
+        prevout(prevoutIn), nTimeBlockFrom(nTimeBlockFromIn), nTimeTxPrev(nTimeTxPrevIn), nValue(nValueIn),
+        fPrepared(false), nPreparedModifier(0), nPreparedBits(0) {}
+};
+
+/**
+ * Searches a set of staking coins for a valid proof-of-stake kernel.
+ *
+ * The values that only depend on the chain tip (stake modifier and base target)
+ * are computed once when the search is created. Search() splits the
+ * coin x timestamp space in batches that are evaluated by the staker thread
+ * pool, and stops every worker as soon as one of them finds a kernel.
+ */
+class CStakeKernelSearch
+{
+private:
+    const CBlockIndex* pindexPrev;
+    uint64_t nStakeModifier;
+    unsigned int nBits;
+    arith_uint512 bnTarget;
+    int64_t nStakeMinAge;
+
+    bool CheckPreparedKernel(const CStakeKernelCoin& coin, unsigned int nTimeTx) const;
+
+public:
+    CStakeKernelSearch(const CBlockIndex* pindexPrevIn, unsigned int nBits);
+
+    const CBlockIndex* GetPrevIndex() const { return pindexPrev; }
+    uint64_t GetStakeModifier() const { return nStakeModifier; }
+
+    /** Whether coin holds a kernel prefix and weighted target usable by this search */
+    bool IsPrepared(const CStakeKernelCoin& coin) const;
+
+    /** Build the kernel prefix and weighted target of coin, unless already prepared for this search */
+    void Prepare(CStakeKernelCoin& coin) const;
+
+    /** Check whether coin is a valid kernel at time nTimeTx */
+    bool CheckKernel(const CStakeKernelCoin& coin, unsigned int nTimeTx) const;
+
+    /**
+     * Look for a kernel in vCoins, preparing the coins which are not yet. Each
+     * coin is tried at nTimeTx, nTimeTx - 1, ... down to
+     * nTimeTx - nSearchInterval + 1. On success the index of the kernel coin
+     * in vCoins and its timestamp are returned.
+     */
+    bool Search(std::vector<CStakeKernelCoin>& vCoins, unsigned int nTimeTx, unsigned int nSearchInterval, size_t& nCoinRet, unsigned int& nTimeTxRet) const;
+};
+
+/** Run an instance of the stake kernel search thread pool */
+void ThreadStakeKernelCheck();
+
+#endif // NAVCOIN_KERNEL_H
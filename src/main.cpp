@@ -10,6 +10,7 @@
 #include <arith_uint256.h>
 #include <base58.h>
 #include <blockencodings.h>
+#include <blockrelaycache.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
@@ -17,8 +18,11 @@
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/common.h>
 #include <hash.h>
 #include <init.h>
+#include <kernel.h>
+#include <mappedfile.h>
 #include <merkleblock.h>
 #include <net.h>
 #include <policy/fees.h>
@@ -77,6 +81,7 @@ bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
 bool fAddressIndex = false;
+bool fAddressBalanceIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fHavePruned = false;
@@ -85,6 +90,7 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+uint256 hashAssumeValid;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -1776,24 +1782,37 @@ bool HashOnchainActive(const uint256 &hash)
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
-                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end,
+                     const CAddressIndexKey *pkeyFrom, size_t nLimit, CAddressIndexKey *pkeyNext)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end, pkeyFrom, nLimit, pkeyNext))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalance &balance)
+{
+    if (!fAddressBalanceIndex)
+        return error("address balance index not enabled");
+
+    if (!pblocktree->ReadAddressBalance(addressHash, type, balance))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pkeyFrom, size_t nLimit, CAddressUnspentKey *pkeyNext)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs, pkeyFrom, nLimit, pkeyNext))
         return error("unable to get txids for address");
 
     return true;
@@ -1893,10 +1912,73 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+static CMappedFileCache mappedblockfiles(MAX_MAPPED_BLOCK_FILES);
+
+CBlockRelayCache blockrelaycache(DEFAULT_BLOCK_RELAY_CACHE_SIZE << 20);
+
+bool ReadRawBlockFromDisk(CMappedFileSpan& span, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The block is preceded by the network magic and its size
+    unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (pos.nPos < nHeaderSize)
+        return error("%s: invalid block position %s", __func__, pos.ToString());
+
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    std::shared_ptr<const CMappedFile> pfile = mappedblockfiles.Get(pos.nFile, path, pos.nPos);
+    if (!pfile)
+        return false;
+
+    const char* pheader = pfile->data() + pos.nPos - nHeaderSize;
+    if (memcmp(pheader, messageStart, MESSAGE_START_SIZE) != 0)
+        return error("%s: no block at %s", __func__, pos.ToString());
+    unsigned int nSize = ReadLE32((const unsigned char*)pheader + MESSAGE_START_SIZE);
+    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+
+    if (pos.nPos + nSize > pfile->size()) {
+        pfile = mappedblockfiles.Get(pos.nFile, path, pos.nPos + nSize);
+        if (!pfile)
+            return error("%s: block at %s extends past the end of its file", __func__, pos.ToString());
+    }
+
+    span = CMappedFileSpan(pfile, pos.nPos, nSize);
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CMappedFileSpan& span, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(span, pindex->GetBlockPos(), messageStart))
+        return false;
+
+    CBlockHeader header;
+    try {
+        CSpanReader(span.begin(), span.end(), SER_DISK, CLIENT_VERSION) >> header;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CMappedFileSpan&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
+    // Deserialize in place from the mapped block file when possible
+    CMappedFileSpan span;
+    if (ReadRawBlockFromDisk(span, pos, Params().MessageStart())) {
+        try {
+            CSpanReader(span.begin(), span.end(), SER_DISK, CLIENT_VERSION) >> block;
+            return true;
+        }
+        catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    }
+    block.SetNull();
+
     // Open history file to read
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
@@ -2624,6 +2706,9 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         if (!pblocktree->EraseAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to delete address index");
         }
+        if (fAddressBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(addressIndex, pindex, true)) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
@@ -2664,6 +2749,105 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+namespace {
+
+/**
+ * Context-free validation of the headers [nBegin, nEnd) of a headers message:
+ * computes their hashes and runs CheckBlockHeader on them. The checks of a
+ * message write to disjoint entries of the result vectors, so they can run on
+ * the header check thread pool without holding cs_main.
+ */
+class CHeaderCheck
+{
+private:
+    const std::vector<CBlock>* pvHeaders;
+    std::vector<uint256>* pvHashes;
+    std::vector<CValidationState>* pvStates;
+    const Consensus::Params* pconsensusParams;
+    size_t nBegin;
+    size_t nEnd;
+
+public:
+    CHeaderCheck() : pvHeaders(nullptr), pvHashes(nullptr), pvStates(nullptr), pconsensusParams(nullptr), nBegin(0), nEnd(0) {}
+    CHeaderCheck(const std::vector<CBlock>* pvHeadersIn, std::vector<uint256>* pvHashesIn, std::vector<CValidationState>* pvStatesIn,
+                 const Consensus::Params* pconsensusParamsIn, size_t nBeginIn, size_t nEndIn) :
+        pvHeaders(pvHeadersIn), pvHashes(pvHashesIn), pvStates(pvStatesIn), pconsensusParams(pconsensusParamsIn), nBegin(nBeginIn), nEnd(nEndIn) {}
+
+    bool operator()()
+    {
+        std::vector<const CBlockHeader*> vpHeaders;
+        std::vector<uint256> vHashes;
+        vpHeaders.reserve(nEnd - nBegin);
+        for (size_t i = nBegin; i < nEnd; i++)
+            vpHeaders.push_back(&(*pvHeaders)[i]);
+        GetBlockHeaderHashes(vpHeaders, vHashes);
+
+        for (size_t i = nBegin; i < nEnd; i++) {
+            (*pvHashes)[i] = vHashes[i - nBegin];
+            CheckBlockHeader((*pvHeaders)[i], (*pvHashes)[i], (*pvStates)[i], *pconsensusParams, false);
+        }
+
+        // A failed check is reported through its state, the other checks must still run
+        return true;
+    }
+
+    void swap(CHeaderCheck& check)
+    {
+        std::swap(pvHeaders, check.pvHeaders);
+        std::swap(pvHashes, check.pvHashes);
+        std::swap(pvStates, check.pvStates);
+        std::swap(pconsensusParams, check.pconsensusParams);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CHeaderCheck> headercheckqueue(4);
+
+void ThreadHeaderCheck() {
+    RenameThread("navcoin-hdrcheck");
+    headercheckqueue.Thread();
+}
+
+/**
+ * Hash the headers of a headers message and run their context-free checks,
+ * on the header check thread pool if there is one. Must not be called with
+ * cs_main held, so the pool is not serialized behind it.
+ */
+static void PrecheckHeaders(const std::vector<CBlock>& vHeaders, std::vector<uint256>& vHashes, std::vector<CValidationState>& vStates, const Consensus::Params& consensusParams)
+{
+    vHashes.assign(vHeaders.size(), uint256());
+    vStates.assign(vHeaders.size(), CValidationState());
+
+    std::vector<CHeaderCheck> vChecks;
+    vChecks.reserve((vHeaders.size() + HEADER_CHECK_BATCH_SIZE - 1) / HEADER_CHECK_BATCH_SIZE);
+    for (size_t nBegin = 0; nBegin < vHeaders.size(); nBegin += HEADER_CHECK_BATCH_SIZE)
+        vChecks.push_back(CHeaderCheck(&vHeaders, &vHashes, &vStates, &consensusParams, nBegin,
+                                       std::min(vHeaders.size(), nBegin + HEADER_CHECK_BATCH_SIZE)));
+
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for(CHeaderCheck& check: vChecks)
+            check();
+    }
+}
+
+// Header pre-validation statistics, protected by cs_main
+static int64_t nHeadersProcessed = 0;
+static int64_t nHeadersProcessingTime = 0;
+
+void GetHeaderSyncStats(int64_t& nHeadersRet, int64_t& nTimeMicrosRet)
+{
+    AssertLockHeld(cs_main);
+    nHeadersRet = nHeadersProcessed;
+    nTimeMicrosRet = nHeadersProcessingTime;
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2823,9 +3007,202 @@ bool TxToPaymentRequest(std::string strDZeel, uint256 hash, const uint256& block
     return true;
 }
 
+int GetAddressIndexKey(const CScript& script, uint160& hashBytes)
+{
+    // The templates are matched on their raw bytes, so the hash is copied
+    // straight out of the script instead of going through ExtractDestination
+    if (script.IsPayToScriptHash()) {
+        memcpy(hashBytes.begin(), &script[2], 20);
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        memcpy(hashBytes.begin(), &script[3], 20);
+        return 1;
+    } else if (script.IsColdStaking()) {
+        // Indexed under the spending key
+        memcpy(hashBytes.begin(), &script[31], 20);
+        return 1;
+    } else if (script.IsPayToPublicKey()) {
+        CPubKey pubkey(script.begin() + 1, script.begin() + 34);
+        if (pubkey.IsValid()) {
+            hashBytes = pubkey.GetID();
+            return 1;
+        }
+    }
+
+    hashBytes.SetNull();
+    return 0;
+}
+
+namespace {
+
+/** Address, unspent and spent index entries of a single transaction of a block */
+struct CTxIndexEntries
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+};
+
+/**
+ * Builds the index entries of the transactions [nBegin, nEnd) of a connected
+ * block. The spent outputs are read from the block undo data rather than the
+ * coins view, so the checks do not need cs_main and can run on the index
+ * thread pool. Every transaction has its own entry in the result vector.
+ */
+class CIndexCheck
+{
+private:
+    const CBlock* pblock;
+    const CBlockUndo* pblockundo;
+    std::vector<CTxIndexEntries>* pvEntries;
+    int nHeight;
+    size_t nBegin;
+    size_t nEnd;
+
+public:
+    CIndexCheck() : pblock(nullptr), pblockundo(nullptr), pvEntries(nullptr), nHeight(0), nBegin(0), nEnd(0) {}
+    CIndexCheck(const CBlock* pblockIn, const CBlockUndo* pblockundoIn, std::vector<CTxIndexEntries>* pvEntriesIn,
+                int nHeightIn, size_t nBeginIn, size_t nEndIn) :
+        pblock(pblockIn), pblockundo(pblockundoIn), pvEntries(pvEntriesIn), nHeight(nHeightIn), nBegin(nBeginIn), nEnd(nEndIn) {}
+
+    bool operator()()
+    {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const CTransaction& tx = pblock->vtx[i];
+            const uint256& txhash = tx.GetHash();
+            CTxIndexEntries& entries = (*pvEntries)[i];
+
+            if (!tx.IsCoinBase()) {
+                const CTxUndo& txundo = pblockundo->vtxundo[i - 1];
+                for (size_t j = 0; j < tx.vin.size(); j++) {
+                    const CTxIn& input = tx.vin[j];
+                    const CTxOut& prevout = txundo.vprevout[j].txout;
+                    uint160 hashBytes;
+                    int addressType = GetAddressIndexKey(prevout.scriptPubKey, hashBytes);
+
+                    if (fAddressIndex && addressType > 0) {
+                        // record spending activity
+                        entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+                        // remove address from unspent index
+                        entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+                    }
+
+                    if (fSpentIndex) {
+                        // add the spent index to determine the txid and input that spent an output
+                        // and to find the amount and address from an input
+                        entries.spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, addressType, hashBytes)));
+                    }
+                }
+            }
+
+            if (!fAddressIndex)
+                continue;
+
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int addressType = GetAddressIndexKey(out.scriptPubKey, hashBytes);
+
+                if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsColdStaking()) {
+                    // These were always recorded with the spending flag set, and even
+                    // without an address, keep doing so to match the existing entries
+                    entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, true), out.nValue));
+                } else if (addressType > 0) {
+                    // record receiving activity
+                    entries.addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, k, false), out.nValue));
+                } else {
+                    continue;
+                }
+
+                // record unspent output
+                entries.addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            }
+        }
+
+        return true;
+    }
+
+    void swap(CIndexCheck& check)
+    {
+        std::swap(pblock, check.pblock);
+        std::swap(pblockundo, check.pblockundo);
+        std::swap(pvEntries, check.pvEntries);
+        std::swap(nHeight, check.nHeight);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CIndexCheck> indexcheckqueue(4);
+
+void ThreadIndexCheck() {
+    RenameThread("navcoin-indexer");
+    indexcheckqueue.Thread();
+}
+
+/**
+ * Build the address, unspent and spent index entries of a block once it has
+ * been connected and its undo data filled, on the index thread pool if there
+ * is one. The entries are returned in the order the transactions, and their
+ * inputs before their outputs, appear in the block.
+ */
+static void BuildBlockIndexEntries(const CBlock& block, const CBlockUndo& blockundo, int nHeight,
+                                   std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                                   std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+                                   std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex)
+{
+    std::vector<CTxIndexEntries> vEntries(block.vtx.size());
+
+    std::vector<CIndexCheck> vChecks;
+    vChecks.reserve((block.vtx.size() + INDEX_CHECK_BATCH_SIZE - 1) / INDEX_CHECK_BATCH_SIZE);
+    for (size_t nBegin = 0; nBegin < block.vtx.size(); nBegin += INDEX_CHECK_BATCH_SIZE)
+        vChecks.push_back(CIndexCheck(&block, &blockundo, &vEntries, nHeight, nBegin,
+                                      std::min(block.vtx.size(), nBegin + INDEX_CHECK_BATCH_SIZE)));
+
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        CCheckQueueControl<CIndexCheck> control(&indexcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for(CIndexCheck& check: vChecks)
+            check();
+    }
+
+    for(CTxIndexEntries& entries: vEntries) {
+        addressIndex.insert(addressIndex.end(), entries.addressIndex.begin(), entries.addressIndex.end());
+        addressUnspentIndex.insert(addressUnspentIndex.end(), entries.addressUnspentIndex.begin(), entries.addressUnspentIndex.end());
+        spentIndex.insert(spentIndex.end(), entries.spentIndex.begin(), entries.spentIndex.end());
+    }
+}
+
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+/**
+ * Whether the script checks of pindex may be skipped: it is an ancestor of
+ * both the -assumevalid block and the best header, and enough work has been
+ * built on it. Only the scripts are skipped, which the merkle root commits
+ * to. The block signature is not covered by the block hash, so it is always
+ * checked, as are the stake kernel, coins and community fund state.
+ */
+bool IsAssumedValid(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull() || pindexBestHeader == nullptr)
+        return false;
+
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+
+    return it->second->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+           GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) >= ASSUME_VALID_MIN_BURIED_TIME;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -2861,6 +3238,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTimeStart = GetTimeMicros();
     int64_t nStakeReward = 0;
 
+    bool fAssumeValid = !fJustCheck && IsAssumedValid(pindex, chainparams.GetConsensus());
+
     // Check it again in case a previous version let a bad block in
     if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck, !fJustCheck))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
@@ -2915,6 +3294,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         return state.DoS(1, error("ContextualCheckBlock() : ComputeNextStakeModifier() failed"), REJECT_INVALID, "bad-stake-modifier");
 
     pindex->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
+    pindex->BuildStakeModifierCheckpoint();
 
     // Flag the block index so we can be sure it will be saved on disk
     if (!pindex->IsValid(BLOCK_VALID_STAKE))
@@ -2932,6 +3312,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             fScriptChecks = false;
         }
     }
+    if (fAssumeValid)
+        fScriptChecks = false;
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
@@ -3026,7 +3408,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
-        const uint256 txhash = tx.GetHash();
 
         nInputs += tx.vin.size();
 
@@ -3162,50 +3543,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 return state.DoS(100, error("%s: contains a non-BIP68-final transaction", __func__),
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
-
-            if (fAddressIndex || fSpentIndex)
-            {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey() || prevout.scriptPubKey.IsColdStaking()) {
-                        CTxDestination destination;
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CNavCoinAddress address(destination);
-                        if (prevout.scriptPubKey.IsColdStaking())
-                            address.GetSpendingAddress(address);
-                        address.GetIndexKey(hashBytes, addressType);
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-
-            }
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -3277,51 +3614,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                              tx.nTime, block.nTime);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsColdStaking()) {
-                    uint160 hashBytes;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CNavCoinAddress address(destination);
-                    if (out.scriptPubKey.IsColdStaking())
-                        address.GetSpendingAddress(address);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // undo spending activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, true), out.nValue));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else {
-                    continue;
-                }
-
-            }
-        }
-
         bool fContribution = false;
         CAmount nProposalFee = 0;
 
@@ -3482,6 +3774,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (fJustCheck)
         return true;
 
+    if (fAddressIndex || fSpentIndex)
+        BuildBlockIndexEntries(block, blockundo, pindex->nHeight, addressIndex, addressUnspentIndex, spentIndex);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
     {
@@ -3510,6 +3805,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return AbortNode(state, "Failed to write address index");
         }
 
+        if (fAddressBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(addressIndex, pindex, false)) {
+            return AbortNode(state, "Failed to write address balance index");
+        }
+
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
@@ -3607,7 +3906,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
 
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-    int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    // The pending block index writes share the coins cache budget
+    int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR + pblocktree->IndexCacheUsage();
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB of the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
@@ -3620,7 +3920,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
     // Combine all conditions that result in a full cache flush.
     bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
-    // Write blocks and block index to disk.
+    // Write blocks, block index and the pending transaction, address, spent and timestamp index entries to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
@@ -3883,6 +4183,9 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
     // Update chainActive & related variables.
     UpdateTip(pindexNew, statehash, chainparams);
+    // Keep the new tip ready to be served to peers, which is of no use while catching up
+    if (!IsInitialBlockDownload())
+        blockrelaycache.Add(*pblock);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     for(const CTransaction &tx: txConflicted) {
@@ -4227,10 +4530,9 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
@@ -4264,6 +4566,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     return pindexNew;
 }
 
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+{
+    return AddToBlockIndex(block, block.GetHash());
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos)
 {
@@ -4402,17 +4709,93 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
 }
 
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
+{
+    return CheckBlockHeader(block, block.GetHash(), state, consensusParams, fCheckPOW);
+}
+
+bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
     CBlockIndex pblock = CBlockIndex(block);
     if (pblock.IsProofOfWork())
-        if (!CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+        if (!CheckProofOfWork(hash, block.nBits, consensusParams))
             return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+namespace {
+
+/**
+ * Context-free checks of the transactions [nBegin, nEnd) of a block, or of
+ * its proof-of-stake signature when fCheckSig is set. Only success is
+ * reported: when a check fails, CheckBlock runs them again sequentially to
+ * reject the block with the same state it always did.
+ */
+class CBlockCheck
+{
+private:
+    const CBlock* pblock;
+    size_t nBegin;
+    size_t nEnd;
+    bool fCheckSig;
+
+public:
+    CBlockCheck() : pblock(nullptr), nBegin(0), nEnd(0), fCheckSig(false) {}
+    CBlockCheck(const CBlock* pblockIn, size_t nBeginIn, size_t nEndIn, bool fCheckSigIn) :
+        pblock(pblockIn), nBegin(nBeginIn), nEnd(nEndIn), fCheckSig(fCheckSigIn) {}
+
+    bool operator()()
+    {
+        if (fCheckSig && !CheckBlockSignature(*pblock))
+            return false;
+
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CValidationState state;
+            if (!CheckTransaction(pblock->vtx[i], state))
+                return false;
+        }
+        return true;
+    }
+
+    void swap(CBlockCheck& check)
+    {
+        std::swap(pblock, check.pblock);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(fCheckSig, check.fCheckSig);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CBlockCheck> blockcheckqueue(4);
+
+void ThreadBlockCheck() {
+    RenameThread("navcoin-blkcheck");
+    blockcheckqueue.Thread();
+}
+
+/**
+ * Run the block signature and transaction checks of CheckBlock on the block
+ * check thread pool. Returns false without touching state if any of them
+ * failed, leaving it to the sequential checks to find which one.
+ */
+static bool CheckBlockTransactionsParallel(const CBlock& block, bool fCheckSig)
+{
+    std::vector<CBlockCheck> vChecks;
+    vChecks.reserve((block.vtx.size() + BLOCK_CHECK_BATCH_SIZE - 1) / BLOCK_CHECK_BATCH_SIZE + 1);
+    if (fCheckSig)
+        vChecks.push_back(CBlockCheck(&block, 0, 0, true));
+    for (size_t nBegin = 0; nBegin < block.vtx.size(); nBegin += BLOCK_CHECK_BATCH_SIZE)
+        vChecks.push_back(CBlockCheck(&block, nBegin, std::min(block.vtx.size(), nBegin + BLOCK_CHECK_BATCH_SIZE), false));
+
+    CCheckQueueControl<CBlockCheck> control(&blockcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+static bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig, bool fParallel)
 {
     // These are checks that are independent of context.
     if (block.fChecked)
@@ -4466,18 +4849,23 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
         if (block.vtx[i].IsCoinBase())
             return state.DoS(100, false, REJECT_INVALID, "bad-cb-multiple", false, "more than one coinbase");
 
-    // Check proof-of-stake block signature
-    if (fCheckSig && !CheckBlockSignature(block))
+    // The signature and transaction checks dominate the cost of CheckBlock,
+    // a block which passes them on the thread pool skips their sequential run.
+    if (!fParallel || !CheckBlockTransactionsParallel(block, fCheckSig))
     {
-        return error("CheckBlock() : bad proof-of-stake block signature");
-    }
+        // Check proof-of-stake block signature
+        if (fCheckSig && !CheckBlockSignature(block))
+        {
+            return error("CheckBlock() : bad proof-of-stake block signature");
+        }
 
-    // Check transactions
-    for(const CTransaction& tx: block.vtx)
-    {
-        if (!CheckTransaction(tx, state))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s\n%s", tx.GetHash().ToString(), state.GetDebugMessage(), tx.ToString()));
+        // Check transactions
+        for(const CTransaction& tx: block.vtx)
+        {
+            if (!CheckTransaction(tx, state))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s\n%s", tx.GetHash().ToString(), state.GetDebugMessage(), tx.ToString()));
+        }
     }
 
     unsigned int nSigOps = 0;
@@ -4493,6 +4881,32 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     return true;
 }
 
+bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig)
+{
+    return CheckBlock(block, state, consensusParams, fCheckPOW, fCheckMerkleRoot, fCheckSig, false);
+}
+
+// Block pre-validation statistics, only updated by the message handler thread
+static int64_t nBlocksPrechecked = 0;
+static int64_t nTimePrecheck = 0;
+
+bool PrecheckBlock(const CBlock& block, const Consensus::Params& consensusParams)
+{
+    if (block.fChecked)
+        return true;
+
+    int64_t nTimeStart = GetTimeMicros();
+    CValidationState state;
+    bool fParallel = nScriptCheckThreads && (block.IsProofOfStake() || block.vtx.size() > BLOCK_CHECK_BATCH_SIZE);
+    bool ret = CheckBlock(block, state, consensusParams, true, true, true, fParallel);
+    int64_t nTimeEnd = GetTimeMicros();
+
+    nBlocksPrechecked++;
+    nTimePrecheck += nTimeEnd - nTimeStart;
+    LogPrint("bench", "  - Precheck block (%u txs, %s): %.2fms [%.2fs over %d blocks]\n", (unsigned)block.vtx.size(), ret ? "valid" : "invalid", 0.001 * (nTimeEnd - nTimeStart), nTimePrecheck * 0.000001, nBlocksPrechecked);
+    return ret;
+}
+
 bool CheckBlockSignature(const CBlock& block)
 {
     if (block.IsProofOfWork())
@@ -4854,11 +5268,14 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/**
+ * Accept a header whose hash is already known. If pstateChecked is passed, it
+ * holds the result of CheckBlockHeader, which was already run on the header.
+ */
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, const CValidationState* pstateChecked=NULL)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -4873,7 +5290,12 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), false))
+        if (pstateChecked) {
+            if (!pstateChecked->IsValid()) {
+                state = *pstateChecked;
+                return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
+            }
+        } else if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus(), false))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -4895,7 +5317,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     }
 
     if (pindex == nullptr)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -4903,6 +5325,11 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+{
+    return AcceptBlockHeader(block, block.GetHash(), state, chainparams, ppindex);
+}
+
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
 static bool AcceptBlock(const CBlock& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
 {
@@ -5092,6 +5519,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedblockfiles.Erase(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -5254,6 +5682,8 @@ bool static LoadBlockIndexDB()
             pindexBestInvalid = pindex;
         if (pindex->pprev)
             pindex->BuildSkip();
+        if (pindex->IsValid(BLOCK_VALID_STAKE))
+            pindex->BuildStakeModifierCheckpoint();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == NULL || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -5362,7 +5792,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CCoinsViewCache coins(coinsview);
     uint256 prevStateHash;
-    if (nCheckLevel >= 4) prevStateHash = coins.GetCFundDBStateHash(chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply);
+    if (nCheckLevel >= 4) prevStateHash = coins.GetCFundDBStateHashFullScan(chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply);
     std::string sBefore = "";
     if (LogAcceptCategory("dao"))
     {
@@ -5460,7 +5890,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             CFundStep(state, pindex, false, coins);
         }
-        uint256 nowStateHash = coins.GetCFundDBStateHash(pindex->nCFLocked, pindex->nCFSupply);
+        uint256 nowStateHash = coins.GetCFundDBStateHashFullScan(pindex->nCFLocked, pindex->nCFSupply);
         if (prevStateHash != nowStateHash)
         {
             std::string sExtra = "";
@@ -5704,6 +6134,179 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+namespace {
+
+/**
+ * Context-free checks of the blocks [nBegin, nEnd) of a window of blocks read
+ * by LoadExternalBlockFile, most of whose cost is the proof-of-stake signature
+ * verification. Each check only touches its own blocks, which are marked as
+ * checked on success. A block which fails is left unmarked, so AcceptBlock
+ * checks it again and rejects and reports it on its own.
+ */
+class CImportBlockCheck
+{
+private:
+    const std::vector<const CBlock*>* pvpBlocks;
+    const Consensus::Params* pconsensusParams;
+    size_t nBegin;
+    size_t nEnd;
+
+public:
+    CImportBlockCheck() : pvpBlocks(nullptr), pconsensusParams(nullptr), nBegin(0), nEnd(0) {}
+    CImportBlockCheck(const std::vector<const CBlock*>* pvpBlocksIn, const Consensus::Params* pconsensusParamsIn, size_t nBeginIn, size_t nEndIn) :
+        pvpBlocks(pvpBlocksIn), pconsensusParams(pconsensusParamsIn), nBegin(nBeginIn), nEnd(nEndIn) {}
+
+    bool operator()()
+    {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            CValidationState state;
+            CheckBlock(*(*pvpBlocks)[i], state, *pconsensusParams);
+        }
+
+        // A failed check is reported by AcceptBlock, the other checks must still run
+        return true;
+    }
+
+    void swap(CImportBlockCheck& check)
+    {
+        std::swap(pvpBlocks, check.pvpBlocks);
+        std::swap(pconsensusParams, check.pconsensusParams);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+    }
+};
+
+} // anon namespace
+
+static CCheckQueue<CImportBlockCheck> importcheckqueue(4);
+
+void ThreadImportCheck() {
+    RenameThread("navcoin-impcheck");
+    importcheckqueue.Thread();
+}
+
+/**
+ * Accept a window of blocks read from a block file, in file order. The blocks
+ * which will be accepted right away are checked together on the import check
+ * thread pool first. Returns false if loading must stop.
+ */
+static bool LoadExternalBlockWindow(const CChainParams& chainparams, std::vector<CBlock>& vBlocks, std::vector<CDiskBlockPos>& vPositions, bool fHavePos,
+                                    std::multimap<uint256, CDiskBlockPos>& mapBlocksUnknownParent, int& nLoaded)
+{
+    std::vector<uint256> vHashes;
+    vHashes.reserve(vBlocks.size());
+    for(const CBlock& block: vBlocks)
+        vHashes.push_back(block.GetHash());
+
+    // Out of order blocks are read again from disk once their parent is
+    // known, and blocks we already have are skipped, so don't check either.
+    std::set<uint256> setWindowHashes;
+    std::vector<const CBlock*> vpBlocks;
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        const uint256& hash = vHashes[i];
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+            continue;
+        if (hash == chainparams.GetConsensus().hashGenesisBlock || mapBlockIndex.count(vBlocks[i].hashPrevBlock) || setWindowHashes.count(vBlocks[i].hashPrevBlock)) {
+            vpBlocks.push_back(&vBlocks[i]);
+            setWindowHashes.insert(hash);
+        }
+    }
+
+    std::vector<CImportBlockCheck> vChecks;
+    vChecks.reserve((vpBlocks.size() + IMPORT_CHECK_BATCH_SIZE - 1) / IMPORT_CHECK_BATCH_SIZE);
+    for (size_t nBegin = 0; nBegin < vpBlocks.size(); nBegin += IMPORT_CHECK_BATCH_SIZE)
+        vChecks.push_back(CImportBlockCheck(&vpBlocks, &chainparams.GetConsensus(), nBegin,
+                                            std::min(vpBlocks.size(), nBegin + IMPORT_CHECK_BATCH_SIZE)));
+
+    // Without worker threads AcceptBlock runs the same checks one block at a time
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        int64_t nTimeStart = GetTimeMicros();
+        CCheckQueueControl<CImportBlockCheck> control(&importcheckqueue);
+        control.Add(vChecks);
+        control.Wait();
+        LogPrint("bench", "%s: Checked %u blocks: %.2fms\n", __func__, (unsigned)vpBlocks.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+    }
+
+    bool fContinue = true;
+    for (size_t i = 0; i < vBlocks.size() && fContinue; i++) {
+        try {
+            const CBlock& block = vBlocks[i];
+            const uint256& hash = vHashes[i];
+            CDiskBlockPos* dbp = fHavePos ? &vPositions[i] : nullptr;
+
+            // detect out of order blocks, and store them for later
+            if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                        block.hashPrevBlock.ToString());
+                if (dbp)
+                    mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                continue;
+            }
+
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                LOCK(cs_main);
+                CValidationState state;
+                if (AcceptBlock(block, state, chainparams, nullptr, true, dbp, nullptr))
+                    nLoaded++;
+                if (state.IsError()) {
+                    fContinue = false;
+                    break;
+                }
+            } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
+
+            // Activate the genesis block so normal node progress can continue
+            if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                CValidationState state;
+                if (!ActivateBestChain(state, chainparams)) {
+                    fContinue = false;
+                    break;
+                }
+            }
+
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                    CBlock blockChild;
+                    if (ReadBlockFromDisk(blockChild, it->second, chainparams.GetConsensus()))
+                    {
+                        LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                                head.ToString());
+                        LOCK(cs_main);
+                        CValidationState dummy;
+
+                        if (AcceptBlock(blockChild, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                        {
+                            nLoaded++;
+                            queue.push_back(blockChild.GetHash());
+                        }
+                    }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
+                }
+            }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+
+    vBlocks.clear();
+    vPositions.clear();
+    return fContinue;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -5715,6 +6318,13 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
+        // Blocks read but not accepted yet, with their position in the file
+        std::vector<CBlock> vBlocks;
+        std::vector<CDiskBlockPos> vPositions;
+        vBlocks.reserve(MAX_IMPORT_CHECK_WINDOW_BLOCKS);
+        vPositions.reserve(MAX_IMPORT_CHECK_WINDOW_BLOCKS);
+        size_t nWindowSize = 0;
+        bool fContinue = true;
         while (!blkdat.eof()) {
             boost::this_thread::interruption_point();
 
@@ -5749,69 +6359,21 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(block, state, chainparams, nullptr, true, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-
-                            if (AcceptBlock(block, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                vBlocks.push_back(std::move(block));
+                vPositions.push_back(dbp ? *dbp : CDiskBlockPos());
+                nWindowSize += nSize;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+
+            if (vBlocks.size() >= MAX_IMPORT_CHECK_WINDOW_BLOCKS || nWindowSize >= MAX_IMPORT_CHECK_WINDOW_SIZE) {
+                nWindowSize = 0;
+                if (!(fContinue = LoadExternalBlockWindow(chainparams, vBlocks, vPositions, dbp != nullptr, mapBlocksUnknownParent, nLoaded)))
+                    break;
+            }
         }
+        if (fContinue)
+            LoadExternalBlockWindow(chainparams, vBlocks, vPositions, dbp != nullptr, mapBlocksUnknownParent, nLoaded);
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -6179,11 +6741,24 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
+                    // Send block from the relay cache or from disk. A full block is
+                    // sent straight from the mapped block file, unless it may hold
+                    // witness data the peer did not ask for.
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                    CSerializedBlockRef pserializedBlock;
+                    if (inv.type != MSG_FILTERED_BLOCK)
+                        pserializedBlock = blockrelaycache.Get(inv.hash, inv.type == MSG_WITNESS_BLOCK);
+                    CMappedFileSpan blockSpan;
+                    bool fRawBlock = !pserializedBlock && inv.type != MSG_FILTERED_BLOCK &&
+                                     (inv.type == MSG_WITNESS_BLOCK || !IsWitnessEnabled((*mi).second->pprev, consensusParams)) &&
+                                     ReadRawBlockFromDisk(blockSpan, (*mi).second, Params().MessageStart());
+                    if (!pserializedBlock && !fRawBlock && !ReadBlockFromDisk(block, (*mi).second, consensusParams))
                         assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
+                    if (pserializedBlock)
+                        pfrom->PushMessage(NetMsgType::BLOCK, *pserializedBlock);
+                    else if (fRawBlock)
+                        pfrom->PushMessage(NetMsgType::BLOCK, blockSpan);
+                    else if (inv.type == MSG_BLOCK)
                         pfrom->PushMessageWithFlag(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
                     else if (inv.type == MSG_WITNESS_BLOCK)
                         pfrom->PushMessage(NetMsgType::BLOCK, block);
@@ -7231,6 +7806,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             //ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Hash and run the context-free checks on the whole message outside
+        // cs_main. Only linking the headers to the block index is serialized.
+        int64_t nTimeStart = GetTimeMicros();
+        std::vector<uint256> vHashes;
+        std::vector<CValidationState> vStates;
+        PrecheckHeaders(headers, vHashes, vStates, chainparams.GetConsensus());
+
         {
         LOCK(cs_main);
 
@@ -7253,14 +7835,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             nodestate->nUnconnectingHeaders++;
             pfrom->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
             LogPrint("net", "received header %s: missing prev block %s, sending getheaders (%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
-                    headers[0].GetHash().ToString(),
+                    vHashes[0].ToString(),
                     headers[0].hashPrevBlock.ToString(),
                     pindexBestHeader->nHeight,
                     pfrom->id, nodestate->nUnconnectingHeaders);
             // Set hashLastUnknownBlock for this peer, so that if we
             // eventually get the headers - even from a different peer -
             // we can use this peer to download.
-            UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+            UpdateBlockAvailability(pfrom->GetId(), vHashes.back());
 
             if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -7280,7 +7862,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         std::vector<uint256> vHeaderHashes;
 
-        for(const CBlock& header: headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlock& header = headers[i];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -7289,7 +7872,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 break;
             }
             CBlockHeader pblockheader = CBlockHeader(header);
-            if (!AcceptBlockHeader(pblockheader, state, chainparams, &pindexLast)) {
+            if (!AcceptBlockHeader(pblockheader, vHashes[i], state, chainparams, &pindexLast, &vStates[i])) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
@@ -7299,7 +7882,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     break;
                 }
             }
-            vHeaderHashes.push_back(pblockheader.GetHash());
+            vHeaderHashes.push_back(vHashes[i]);
             if (pindexLast) {
                 nLast = pindexLast->nHeight;
                 if (bFirst){
@@ -7309,6 +7892,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        nHeadersProcessed += vHeaderHashes.size();
+        nHeadersProcessingTime += GetTimeMicros() - nTimeStart;
+
         if(GetBoolArg("-headerspamfilter", DEFAULT_HEADER_SPAM_FILTER) && !IsInitialBlockDownload())
         {
             LOCK(cs_main);
@@ -7436,6 +8022,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        // Run the context-free checks before taking cs_main, so AcceptBlock
+        // finds the block already checked. A failure is left to it to report.
+        PrecheckBlock(block, chainparams.GetConsensus());
+
         CValidationState state;
         // Process all blocks from whitelisted peers, even if not requested,
         // unless we're still syncing with the network.
@@ -8462,6 +9052,8 @@ static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModi
 {
     if (!pindex)
         return error("GetLastStakeModifier: null pindex");
+    if (pindex->pstakemodifier)
+        pindex = pindex->pstakemodifier;
     while (pindex && pindex->pprev && !pindex->GeneratedStakeModifier())
         pindex = pindex->pprev;
     if (!pindex->GeneratedStakeModifier()){
@@ -8490,27 +9082,112 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
+/** A block taking part in the selection of a stake modifier, ordered by timestamp and hash */
+struct CStakeModifierCandidate
+{
+    int64_t nTime;
+    uint256 hash;
+    const CBlockIndex* pindex;
+
+    CStakeModifierCandidate(const CBlockIndex* pindexIn) : nTime(pindexIn->GetBlockTime()), hash(pindexIn->GetBlockHash()), pindex(pindexIn) {}
+
+    bool operator<(const CStakeModifierCandidate& other) const
+    {
+        if (nTime != other.nTime)
+            return nTime < other.nTime;
+        return hash < other.hash;
+    }
+};
+
+/**
+ * The candidate blocks of the last stake modifier computation, sorted by
+ * timestamp. Consecutive modifiers select from overlapping intervals of the
+ * same chain, so the next computation only drops the blocks which fell out of
+ * the interval and merges the blocks connected since, instead of collecting
+ * and sorting the whole interval again.
+ */
+struct CStakeModifierCandidateWindow
+{
+    //! Tip and first height of the candidates, which are the blocks in between
+    const CBlockIndex* pindexTip;
+    uint256 hashTip;
+    int nHeightTip;
+    int nHeightFirst;
+    vector<CStakeModifierCandidate> vSortedByTimestamp;
+
+    CStakeModifierCandidateWindow() : pindexTip(NULL), nHeightTip(-1), nHeightFirst(0) {}
+
+    void Update(const CBlockIndex* pindexPrev, int64_t nSelectionIntervalStart)
+    {
+        // The window can slide when its tip is an ancestor of the new one
+        bool fSlide = pindexTip && nHeightTip <= pindexPrev->nHeight &&
+                pindexPrev->GetAncestor(nHeightTip) == pindexTip && pindexTip->GetBlockHash() == hashTip;
+
+        vector<CStakeModifierCandidate> vNew;
+        const CBlockIndex* pindex = pindexPrev;
+        while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
+        {
+            if (!fSlide || pindex->nHeight > nHeightTip)
+                vNew.push_back(CStakeModifierCandidate(pindex));
+            pindex = pindex->pprev;
+        }
+        int nHeightFirstNew = pindex ? (pindex->nHeight + 1) : 0;
+
+        if (fSlide && nHeightFirstNew >= nHeightFirst)
+        {
+            // Drop the blocks below the new interval start, keeping the others sorted
+            vector<CStakeModifierCandidate>::iterator it = vSortedByTimestamp.begin();
+            for (vector<CStakeModifierCandidate>::iterator mi = vSortedByTimestamp.begin(); mi != vSortedByTimestamp.end(); ++mi)
+                if (mi->pindex->nHeight >= nHeightFirstNew)
+                    *it++ = *mi;
+            vSortedByTimestamp.erase(it, vSortedByTimestamp.end());
+        }
+        else
+        {
+            vSortedByTimestamp.clear();
+            if (fSlide)
+            {
+                // The interval start moved back past the first candidate, so collect everything again
+                vNew.clear();
+                for (pindex = pindexPrev; pindex && pindex->nHeight >= nHeightFirstNew; pindex = pindex->pprev)
+                    vNew.push_back(CStakeModifierCandidate(pindex));
+            }
+        }
+
+        size_t nOld = vSortedByTimestamp.size();
+        sort(vNew.begin(), vNew.end());
+        vSortedByTimestamp.insert(vSortedByTimestamp.end(), vNew.begin(), vNew.end());
+        inplace_merge(vSortedByTimestamp.begin(), vSortedByTimestamp.begin() + nOld, vSortedByTimestamp.end());
+
+        pindexTip = pindexPrev;
+        hashTip = pindexPrev->GetBlockHash();
+        nHeightTip = pindexPrev->nHeight;
+        nHeightFirst = nHeightFirstNew;
+    }
+};
+
+static CStakeModifierCandidateWindow stakeModifierCandidates;
+static CCriticalSection cs_stakeModifierCandidates;
+
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
+// already selected blocks in vSelected, and with timestamp up to
 // nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
-    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected)
+static bool SelectBlockFromCandidates(const vector<CStakeModifierCandidate>& vSortedByTimestamp, const vector<bool>& vSelected,
+    int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, size_t* pnSelected)
 {
     bool fSelected = false;
     uint256 hashBest = uint256();
-    *pindexSelected = (const CBlockIndex*) 0;
-    for(const PAIRTYPE(int64_t, uint256)& item: vSortedByTimestamp)
+    *pnSelected = 0;
+    for (size_t i = 0; i < vSortedByTimestamp.size(); i++)
     {
-        if (!mapBlockIndex.count(item.second))
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString());
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
+        const CBlockIndex* pindex = vSortedByTimestamp[i].pindex;
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop){
 //            LogPrint("stakemodifier", "SelectBlockFromCandidates: selection hash=%s index=%d proofhash=%s nStakeModifierPrev=%08x\n", hashBest.ToString(), pindex->nHeight, pindex->hashProof.ToString(), nStakeModifierPrev);
             break;
 
         }
 
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (vSelected[i])
             continue;
         // compute the selection hash by hashing its proof-hash and the
         // previous proof-of-stake modifier
@@ -8528,13 +9205,13 @@ static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedBy
         if (fSelected && hashSelection < hashBest)
         {
             hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            *pnSelected = i;
         }
         else if (!fSelected)
         {
             fSelected = true;
             hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*) pindex;
+            *pnSelected = i;
         }
     }
     return fSelected;
@@ -8571,39 +9248,37 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     if (nModifierTime / Params().GetConsensus().nModifierInterval >= pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval)
         return true;
 
-    // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256> > vSortedByTimestamp;
-    vSortedByTimestamp.reserve(64 * Params().GetConsensus().nModifierInterval / GetTargetSpacing(pindexPrev->nHeight));
     int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / Params().GetConsensus().nModifierInterval)
             * Params().GetConsensus().nModifierInterval - nSelectionInterval;
 //    LogPrint("stakemodifier", "nSelectionInterval = %d nSelectionIntervalStart = %d\n",nSelectionInterval,nSelectionIntervalStart);
 
-    const CBlockIndex* pindex = pindexPrev;
-    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
-    {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
-        pindex = pindex->pprev;
-    }
-    int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
-    reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-    sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
+    LOCK(cs_stakeModifierCandidates);
+
+    // Candidate blocks sorted by timestamp
+    stakeModifierCandidates.Update(pindexPrev, nSelectionIntervalStart);
+    const vector<CStakeModifierCandidate>& vSortedByTimestamp = stakeModifierCandidates.vSortedByTimestamp;
+    int nHeightFirstCandidate = stakeModifierCandidates.nHeightFirst;
 
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    map<uint256, const CBlockIndex*> mapSelectedBlocks;
+    vector<bool> vSelected(vSortedByTimestamp.size(), false);
+    vector<const CBlockIndex*> vSelectedBlocks;
     for (int nRound=0; nRound<min(64, (int)vSortedByTimestamp.size()); nRound++)
     {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        size_t nSelected;
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, vSelected, nSelectionIntervalStop, nStakeModifier, &nSelected))
             return error("ComputeNextStakeModifier: unable to select block at round %d", nRound);
+        const CBlockIndex* pindex = vSortedByTimestamp[nSelected].pindex;
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
         // add the selected block from candidates to selected list
-        mapSelectedBlocks.insert(make_pair(pindex->GetBlockHash(), pindex));
+        vSelected[nSelected] = true;
+        vSelectedBlocks.push_back(pindex);
 //        LogPrint("stakemodifier", "ComputeNextStakeModifier: selected round %d stop=%s height=%d bit=%d\n", nRound, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nSelectionIntervalStop), pindex->nHeight, pindex->GetStakeEntropyBit());
     }
 
@@ -8613,7 +9288,7 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
         string strSelectionMap = "";
         // '-' indicates proof-of-work blocks not selected
         strSelectionMap.insert(0, pindexPrev->nHeight - nHeightFirstCandidate + 1, '-');
-        pindex = pindexPrev;
+        const CBlockIndex* pindex = pindexPrev;
         while (pindex && pindex->nHeight >= nHeightFirstCandidate)
         {
             // '=' indicates proof-of-stake blocks not selected
@@ -8621,11 +9296,11 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        for(const PAIRTYPE(uint256, const CBlockIndex*)& item: mapSelectedBlocks)
+        for(const CBlockIndex* pindexSelected: vSelectedBlocks)
         {
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->IsProofOfStake()? "S" : "W");
+            strSelectionMap.replace(pindexSelected->nHeight - nHeightFirstCandidate, 1, pindexSelected->IsProofOfStake()? "S" : "W");
         }
 //        LogPrintf("ComputeNextStakeModifier: selection height [%d, %d] map %s\n", nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap);
     }
@@ -8663,9 +9338,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
     int64_t nStakeModifierTime = pindexPrev->nTime;
 
     // Calculate hash
-    CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
-    hashProofOfStake = UintToArith256(Hash(ss.begin(), ss.end()));
+    hashProofOfStake = UintToArith256(GetStakeKernelHash(nStakeModifier, nTimeBlockFrom, txPrev.nTime, prevout, nTimeTx));
 
     if (fPrintProofOfStake)
     {
@@ -46,10 +46,12 @@
 static const int64_t MAX_MINT_PROOF_OF_STAKE = 0.1 * COIN;
 
 class CBlockIndex;
+class CBlockRelayCache;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
+class CMappedFileSpan;
 class CScriptCheck;
 class CTxMemPool;
 class CValidationInterface;
@@ -90,6 +92,8 @@ static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
+/** Number of block files kept memory mapped for reading blocks */
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 8 : 2;
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
@@ -97,6 +101,18 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Number of headers hashed and checked by one batch of the header pre-validation threads */
+static const size_t HEADER_CHECK_BATCH_SIZE = 64;
+/** Number of transactions checked by one batch of the block pre-validation threads */
+static const size_t BLOCK_CHECK_BATCH_SIZE = 32;
+/** Number of blocks checked by one batch of the block import threads */
+static const size_t IMPORT_CHECK_BATCH_SIZE = 4;
+/** Maximum number of blocks read ahead of AcceptBlock when importing a block file */
+static const size_t MAX_IMPORT_CHECK_WINDOW_BLOCKS = 256;
+/** Maximum serialized size of the blocks read ahead of AcceptBlock when importing a block file */
+static const size_t MAX_IMPORT_CHECK_WINDOW_SIZE = 32 * 1024 * 1024;
+/** Number of transactions classified by one batch of the address and spent index threads */
+static const size_t INDEX_CHECK_BATCH_SIZE = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -141,8 +157,11 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Amount of work, in seconds of blocks at the current best header, that must be built on a block before -assumevalid may skip its checks */
+static const int64_t ASSUME_VALID_MIN_BURIED_TIME = 2 * 7 * 24 * 60 * 60;
 static const bool DEFAULT_TXINDEX = false;
 static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_ADDRESSBALANCEINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
@@ -181,6 +200,8 @@ struct BlockHasher
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
+/** Serialized recently connected blocks, served to peers and REST clients */
+extern CBlockRelayCache blockrelaycache;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
@@ -194,12 +215,15 @@ extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fAddressIndex;
+extern bool fAddressBalanceIndex;
 extern bool fSpentIndex;
 extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Block whose ancestors skip their script checks (-assumevalid), null to verify all */
+extern uint256 hashAssumeValid;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -282,6 +306,16 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the header pre-validation thread */
+void ThreadHeaderCheck();
+/** Run an instance of the block pre-validation thread */
+void ThreadBlockCheck();
+/** Run an instance of the block import check thread */
+void ThreadImportCheck();
+/** Run an instance of the address and spent index thread */
+void ThreadIndexCheck();
+/** Number of headers received from peers and accepted so far, and the time spent validating them in microseconds */
+void GetHeaderSyncStats(int64_t& nHeadersRet, int64_t& nTimeMicrosRet);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -471,20 +505,45 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool HashOnchainActive(const uint256 &hash);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0,
+                     const CAddressIndexKey *pkeyFrom = NULL, size_t nLimit = 0, CAddressIndexKey *pkeyNext = NULL);
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalance &balance);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentKey *pkeyFrom = NULL, size_t nLimit = 0, CAddressUnspentKey *pkeyNext = NULL);
+/**
+ * Address index type and hash of a script: 1 for P2PKH, P2PK and cold staking
+ * (indexed under the spending key), 2 for P2SH, 0 when it is not indexed.
+ */
+int GetAddressIndexKey(const CScript& script, uint160& hashBytes);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Get the serialized block at pos from the memory mapped block files, without
+ * deserializing it. Its bytes are the disk serialization, witness included.
+ * Returns false when the block file cannot be mapped.
+ */
+bool ReadRawBlockFromDisk(CMappedFileSpan& span, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+/** Same as above, also checking the block hash against the index like ReadBlockFromDisk */
+bool ReadRawBlockFromDisk(CMappedFileSpan& span, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+/** Same as above, for a header whose hash is already known */
+bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
+/**
+ * Run CheckBlock on a block which was just received, spreading its signature
+ * and transaction checks over the block pre-validation threads. On success the
+ * block is marked as checked, so the CheckBlock call of AcceptBlock returns
+ * at once. Must not be called with cs_main held.
+ */
+bool PrecheckBlock(const CBlock& block, const Consensus::Params& consensusParams);
 
 /** Context-dependent validity checks.
  *  By "context", we mean only the previous block headers, but not the UTXO
@@ -492,6 +551,9 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, CBlockIndex* pindexPrev, int64_t nAdjustedTime);
 bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIndex *pindexPrev, bool fProofOfStake = false);
 
+/** Whether ConnectBlock may skip the script checks of pindex under -assumevalid. Requires cs_main. */
+bool IsAssumedValid(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mappedfile.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedFile::CMappedFile(const boost::filesystem::path& path) : pdata(nullptr), nSize(0)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            pdata = static_cast<const char*>(p);
+            nSize = st.st_size;
+        }
+    }
+
+    // The mapping outlives the descriptor
+    close(fd);
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    if (pdata)
+        munmap(const_cast<char*>(pdata), nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(int nFile, const boost::filesystem::path& path, size_t nMinSize)
+{
+    LOCK(cs);
+
+    for (std::list<std::pair<int, std::shared_ptr<const CMappedFile> > >::iterator it = listFiles.begin(); it != listFiles.end(); it++) {
+        if (it->first == nFile) {
+            if (it->second->size() >= nMinSize) {
+                listFiles.splice(listFiles.begin(), listFiles, it);
+                return listFiles.front().second;
+            }
+            // The file was appended to since it was mapped
+            listFiles.erase(it);
+            break;
+        }
+    }
+
+    std::shared_ptr<const CMappedFile> pfile = std::make_shared<const CMappedFile>(path);
+    if (pfile->IsNull() || pfile->size() < nMinSize)
+        return std::shared_ptr<const CMappedFile>();
+
+    listFiles.push_front(std::make_pair(nFile, pfile));
+    if (listFiles.size() > nMaxFiles)
+        listFiles.pop_back();
+    return pfile;
+}
+
+void CMappedFileCache::Erase(int nFile)
+{
+    LOCK(cs);
+
+    for (std::list<std::pair<int, std::shared_ptr<const CMappedFile> > >::iterator it = listFiles.begin(); it != listFiles.end(); it++) {
+        if (it->first == nFile) {
+            listFiles.erase(it);
+            return;
+        }
+    }
+}
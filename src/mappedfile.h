@@ -0,0 +1,95 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_MAPPEDFILE_H
+#define NAVCOIN_MAPPEDFILE_H
+
+#include <sync.h>
+
+#include <list>
+#include <memory>
+#include <utility>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * A read-only memory mapping of a whole file. The mapping is null when the
+ * file could not be mapped, or on platforms without mmap.
+ */
+class CMappedFile
+{
+private:
+    // Disallow copies
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+
+    const char* pdata;
+    size_t nSize;
+
+public:
+    explicit CMappedFile(const boost::filesystem::path& path);
+    ~CMappedFile();
+
+    bool IsNull() const { return pdata == nullptr; }
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * A range of bytes of a mapped file, which keeps the mapping alive for as long
+ * as it is held. It serializes to its raw bytes, so already serialized data
+ * can be sent or returned as is.
+ */
+class CMappedFileSpan
+{
+private:
+    std::shared_ptr<const CMappedFile> pfile;
+    const char* pbegin;
+    size_t nSize;
+
+public:
+    CMappedFileSpan() : pbegin(nullptr), nSize(0) {}
+    CMappedFileSpan(const std::shared_ptr<const CMappedFile>& pfileIn, size_t nOffset, size_t nSizeIn) :
+        pfile(pfileIn), pbegin(pfileIn->data() + nOffset), nSize(nSizeIn) {}
+
+    bool IsNull() const { return !pfile; }
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return nSize;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        if (nSize > 0)
+            s.write(pbegin, nSize);
+    }
+};
+
+/**
+ * The most recently used mappings of a set of numbered files, such as the
+ * block files. A file which grew past its mapping is mapped again.
+ */
+class CMappedFileCache
+{
+private:
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! Most recently used first
+    std::list<std::pair<int, std::shared_ptr<const CMappedFile> > > listFiles;
+
+public:
+    explicit CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Mapping of file nFile, at path, covering at least its first nMinSize bytes, or null if there is none */
+    std::shared_ptr<const CMappedFile> Get(int nFile, const boost::filesystem::path& path, size_t nMinSize);
+    /** Forget the mapping of file nFile, e.g. once it is deleted */
+    void Erase(int nFile);
+};
+
+#endif // NAVCOIN_MAPPEDFILE_H
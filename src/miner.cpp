@@ -255,14 +255,12 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bo
         UniValue strDZeel(UniValue::VARR);
         CPaymentRequestMap mapPaymentRequests;
 
-        if(view.GetAllPaymentRequests(mapPaymentRequests))
+        if(CFund::GetPaymentRequestsByState(view, CFund::ACCEPTED, mapPaymentRequests))
         {
             for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
             {
-                CFund::CPaymentRequest prequest;
+                const CFund::CPaymentRequest& prequest = it_->second;
 
-                if (!view.GetPaymentRequest(it_->first, prequest))
-                    continue;
                 CBlockIndex* pblockindex = prequest.GetLastStateBlockIndexForState(CFund::ACCEPTED);
                 if(pblockindex == nullptr)
                     continue;
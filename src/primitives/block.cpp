@@ -59,6 +59,33 @@ std::string CBlockHeader::ToString() const
     return s.str();
 }
 
+void GetBlockHeaderHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHashes)
+{
+    vHashes.assign(vHeaders.size(), uint256());
+
+    std::vector<const unsigned char*> vData;
+    std::vector<size_t> vPos;
+    vData.reserve(vHeaders.size());
+    vPos.reserve(vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        const CBlockHeader* pheader = vHeaders[i];
+        if (pheader->nVersion > 6) {
+            vHashes[i] = SerializeHash(*pheader);
+        } else {
+            vData.push_back((const unsigned char*)BEGIN(pheader->nVersion));
+            vPos.push_back(i);
+        }
+    }
+
+    if (vData.empty())
+        return;
+
+    std::vector<uint256> vPoWHashes(vData.size());
+    Hash9Batch(&vData[0], END(vHeaders[0]->nNonce) - BEGIN(vHeaders[0]->nVersion), &vPoWHashes[0], vData.size());
+    for (size_t i = 0; i < vPos.size(); i++)
+        vHashes[vPos[i]] = vPoWHashes[i];
+}
+
 int64_t GetBlockWeight(const CBlock& block)
 {
     // This implements the weight = (stripped_size * 4) + witness_size formula,
@@ -214,6 +214,12 @@ struct CBlockLocator
 
 };
 
+/**
+ * Compute the hashes of a set of block headers, equal to calling GetHash() on
+ * each of them. The X13 hashed headers are handed to Hash9Batch together.
+ */
+void GetBlockHeaderHashes(const std::vector<const CBlockHeader*>& vHeaders, std::vector<uint256>& vHashes);
+
 /** Compute the consensus-critical block weight (see BIP 141). */
 int64_t GetBlockWeight(const CBlock& tx);
 
@@ -3,11 +3,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockrelaycache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <main.h>
+#include <mappedfile.h>
 #include <httpserver.h>
 #include <rpc/server.h>
 #include <streams.h>
@@ -214,6 +216,9 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    CSerializedBlockRef pserializedBlock;
+    CMappedFileSpan blockSpan;
+    bool fRawBlock = false;
     CBlockIndex* pblockindex = nullptr;
     {
         LOCK(cs_main);
@@ -224,12 +229,24 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        // The binary and hex formats are the serialization with witness, so they
+        // are served from the relay cache or straight from the mapped block file
+        // when possible
+        if (rf == RF_BINARY || rf == RF_HEX) {
+            pserializedBlock = blockrelaycache.Get(hash, true);
+            fRawBlock = !pserializedBlock && ReadRawBlockFromDisk(blockSpan, pblockindex, Params().MessageStart());
+        }
+        if (!pserializedBlock && !fRawBlock && !ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    if (pserializedBlock)
+        ssBlock << *pserializedBlock;
+    else if (fRawBlock)
+        ssBlock << blockSpan;
+    else
+        ssBlock << block;
 
     switch (rf) {
     case RF_BINARY: {
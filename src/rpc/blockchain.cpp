@@ -11,6 +11,7 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <main.h>
+#include <mappedfile.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
@@ -837,6 +838,14 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    if (!fVerbose)
+    {
+        // The disk serialization is returned as is when the block file can be mapped
+        CMappedFileSpan blockSpan;
+        if (ReadRawBlockFromDisk(blockSpan, pblockindex, Params().MessageStart()))
+            return HexStr(blockSpan.begin(), blockSpan.end());
+    }
+
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -945,20 +954,36 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 
 UniValue getcfunddbstatehash(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-                "getcfunddbstatehash\n"
+                "getcfunddbstatehash ( \"mode\" )\n"
                 "\nReturns the hash of the Cfund DB current state.\n"
+                "\nArguments:\n"
+                "1. \"mode\"     (string, optional, default=\"fast\") \"fast\" hashes the state accumulator maintained as\n"
+                "               proposals and payment requests change, \"verify\" also recomputes the accumulator from every\n"
+                "               entry and fails if they differ, \"full\" serializes every entry as done before the accumulator\n"
                 "\nResult\n"
                 "\"hex\"      (string) the hash hex encoded\n"
                 "\nExamples\n"
                 + HelpExampleCli("getcfunddbstatehash", "")
+                + HelpExampleCli("getcfunddbstatehash", "\"verify\"")
                 + HelpExampleRpc("getcfunddbstatehash", "")
                 );
 
+    std::string strMode = params.size() > 0 ? params[0].get_str() : "fast";
+    if (strMode != "fast" && strMode != "verify" && strMode != "full")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+
     LOCK(cs_main);
 
     CCoinsViewCache view(pcoinsTip);
+
+    if (strMode == "full")
+        return view.GetCFundDBStateHashFullScan(chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply).ToString();
+
+    if (strMode == "verify" && view.ComputeCFundStateAccumulator() != view.GetCFundStateAccumulator())
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cfund DB state accumulator does not match its entries");
+
     return view.GetCFundDBStateHash(chainActive.Tip()->nCFLocked, chainActive.Tip()->nCFSupply).ToString();
 }
 
@@ -1264,6 +1289,11 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"chain\": \"xxxx\",        (string) current network name as defined in BIP70 (main, test, regtest)\n"
             "  \"blocks\": xxxxxx,         (numeric) the current number of blocks processed in the server\n"
             "  \"headers\": xxxxxx,        (numeric) the current number of headers we have validated\n"
+            "  \"headersync\": {            (object) throughput of the validation of the headers received from peers\n"
+            "     \"processed\": xxxxxx,    (numeric) number of headers accepted since startup\n"
+            "     \"time\": xxxxxx,         (numeric) seconds spent validating them\n"
+            "     \"rate\": xxxxxx          (numeric) headers validated per second\n"
+            "  },\n"
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"mediantime\": xxxxxx,     (numeric) median time for the current best block\n"
@@ -1304,6 +1334,15 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.pushKV("chain",                 Params().NetworkIDString());
     obj.pushKV("blocks",                (int)chainActive.Height());
     obj.pushKV("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1);
+
+    int64_t nHeadersProcessed, nHeadersProcessingTime;
+    GetHeaderSyncStats(nHeadersProcessed, nHeadersProcessingTime);
+    UniValue headersync(UniValue::VOBJ);
+    headersync.pushKV("processed",      nHeadersProcessed);
+    headersync.pushKV("time",           nHeadersProcessingTime * 0.000001);
+    headersync.pushKV("rate",           nHeadersProcessingTime ? nHeadersProcessed * 1000000.0 / nHeadersProcessingTime : 0.0);
+    obj.pushKV("headersync",            headersync);
+
     obj.pushKV("bestblockhash",         chainActive.Tip()->GetBlockHash().GetHex());
     obj.pushKV("difficulty",            (double)GetDifficulty());
     obj.pushKV("mediantime",            (int64_t)chainActive.Tip()->GetMedianTimePast());
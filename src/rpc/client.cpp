@@ -48,6 +48,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listreceivedbyaccount", 2 },
     { "getbalance", 1 },
     { "getbalance", 2 },
+    { "getstakereport", 0 },
+    { "getstakereport", 1 },
+    { "getstakereport", 2 },
     { "getblockhash", 0 },
     { "move", 2 },
     { "move", 3 },
@@ -596,6 +596,113 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
+/**
+ * Read the "limit" and "cursor" parameters of the paginated address calls.
+ * Returns false when no limit was passed. A cursor holds the position in the
+ * list of addresses and the key of the index row the page starts at.
+ */
+template <typename Key>
+static bool getAddressPageFromParams(const UniValue& params, const std::vector<std::pair<uint160, int> > &addresses,
+                                     size_t &nLimit, size_t &nAddress, Key &keyFrom)
+{
+    nLimit = 0;
+    nAddress = 0;
+    keyFrom.SetNull();
+
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull()) {
+        if (!cursorValue.isNull())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "A cursor requires a limit");
+        return false;
+    }
+    if (!limitValue.isNum() || limitValue.get_int64() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+    nLimit = limitValue.get_int64();
+
+    if (cursorValue.isNull())
+        return true;
+    if (!cursorValue.isStr() || !IsHex(cursorValue.get_str()))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    CDataStream ss(ParseHex(cursorValue.get_str()), SER_DISK, CLIENT_VERSION);
+    try {
+        uint32_t nPos;
+        ss >> nPos >> keyFrom;
+        nAddress = nPos;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (nAddress >= addresses.size() || keyFrom.hashBytes != addresses[nAddress].first || keyFrom.type != (unsigned int)addresses[nAddress].second)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    return true;
+}
+
+template <typename Key>
+static std::string getAddressPageCursor(size_t nAddress, const Key &keyNext)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << (uint32_t)nAddress << keyNext;
+    return HexStr(ss.begin(), ss.end());
+}
+
+/**
+ * Read a page of at most nLimit address index rows, from the address nAddress
+ * and the row keyFrom on. On return nAddress and keyNext locate the start of
+ * the next page, keyNext being null once every address was read.
+ */
+static void getAddressIndexPage(const std::vector<std::pair<uint160, int> > &addresses, int start, int end, size_t nLimit,
+                                size_t &nAddress, const CAddressIndexKey &keyFrom, CAddressIndexKey &keyNext,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex)
+{
+    keyNext.SetNull();
+    const size_t nAddressFrom = nAddress;
+    for (; nAddress < addresses.size(); nAddress++) {
+        const std::pair<uint160, int>& address = addresses[nAddress];
+        bool fFirst = nAddress == nAddressFrom && !keyFrom.IsNull();
+        if (!GetAddressIndex(address.first, address.second, addressIndex, start, end,
+                             fFirst ? &keyFrom : NULL, nLimit - addressIndex.size(), &keyNext)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (!keyNext.IsNull())
+            return;
+        if (addressIndex.size() == nLimit)
+            break;
+    }
+
+    // The page ended with an address, the next one starts with the following address
+    if (++nAddress < addresses.size())
+        keyNext = CAddressIndexKey(addresses[nAddress].second, addresses[nAddress].first, start > 0 ? start : 0, 0, uint256(), 0, false);
+}
+
+/** Same as getAddressIndexPage, for the unspent outputs */
+static void getAddressUnspentPage(const std::vector<std::pair<uint160, int> > &addresses, size_t nLimit,
+                                  size_t &nAddress, const CAddressUnspentKey &keyFrom, CAddressUnspentKey &keyNext,
+                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+{
+    keyNext.SetNull();
+    const size_t nAddressFrom = nAddress;
+    for (; nAddress < addresses.size(); nAddress++) {
+        const std::pair<uint160, int>& address = addresses[nAddress];
+        bool fFirst = nAddress == nAddressFrom && !keyFrom.IsNull();
+        if (!GetAddressUnspent(address.first, address.second, unspentOutputs,
+                               fFirst ? &keyFrom : NULL, nLimit - unspentOutputs.size(), &keyNext)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+        if (!keyNext.IsNull())
+            return;
+        if (unspentOutputs.size() == nLimit)
+            break;
+    }
+
+    if (++nAddress < addresses.size())
+        keyNext = CAddressUnspentKey(addresses[nAddress].second, addresses[nAddress].first, uint256(), 0);
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
                 std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
     return a.second.blockHeight < b.second.blockHeight;
@@ -691,6 +798,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs, ordered by address then txid\n"
+            "  \"cursor\"  (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -703,6 +812,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nWith chainInfo or limit, the outputs are returned in the \"utxos\" field of an object. When limit\n"
+            "is passed and more outputs remain, its \"cursor\" field is set to the cursor of the next page.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -724,13 +835,21 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    size_t nLimit, nAddress;
+    CAddressUnspentKey keyFrom, keyNext;
+    bool fPaged = getAddressPageFromParams(params, addresses, nLimit, nAddress, keyFrom);
+
+    if (fPaged) {
+        getAddressUnspentPage(addresses, nLimit, nAddress, keyFrom, keyNext, unspentOutputs);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -750,13 +869,17 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || fPaged) {
         UniValue result(UniValue::VOBJ);
         result.pushKV("utxos", utxos);
+        if (!keyNext.IsNull())
+            result.pushKV("cursor", getAddressPageCursor(nAddress, keyNext));
 
-        LOCK(cs_main);
-        result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
-        result.pushKV("height", (int)chainActive.Height());
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
+            result.pushKV("height", (int)chainActive.Height());
+        }
         return result;
     } else {
         return utxos;
@@ -779,6 +902,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many deltas, ordered by address then height\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -790,6 +915,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nWith chain info or limit, the deltas are returned in the \"deltas\" field of an object. When limit\n"
+            "is passed and more deltas remain, its \"cursor\" field is set to the cursor of the next page.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -827,14 +954,22 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    size_t nLimit, nAddress;
+    CAddressIndexKey keyFrom, keyNext;
+    bool fPaged = getAddressPageFromParams(params, addresses, nLimit, nAddress, keyFrom);
+
+    if (fPaged) {
+        getAddressIndexPage(addresses, start, end, nLimit, nAddress, keyFrom, keyNext, addressIndex);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -879,9 +1014,17 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         endInfo.pushKV("height", end);
 
         result.pushKV("deltas", deltas);
+        if (fPaged && !keyNext.IsNull())
+            result.pushKV("cursor", getAddressPageCursor(nAddress, keyNext));
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
 
+        return result;
+    } else if (fPaged) {
+        result.pushKV("deltas", deltas);
+        if (!keyNext.IsNull())
+            result.pushKV("cursor", getAddressPageCursor(nAddress, keyNext));
+
         return result;
     } else {
         return deltas;
@@ -906,6 +1049,7 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving the address, summed over the addresses\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
@@ -918,27 +1062,43 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CAmount balance = 0;
+    CAmount received = 0;
+    int64_t txcount = 0;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (fAddressBalanceIndex) {
+            CAddressBalance addressBalance;
+            if (!GetAddressBalance((*it).first, (*it).second, addressBalance)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            balance += addressBalance.balance;
+            received += addressBalance.received;
+            txcount += addressBalance.txcount;
+            continue;
+        }
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
         if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-    }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+        uint256 hashLastTx;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator jt=addressIndex.begin(); jt!=addressIndex.end(); jt++) {
+            if (jt->second > 0) {
+                received += jt->second;
+            }
+            balance += jt->second;
+            if (jt == addressIndex.begin() || jt->first.txhash != hashLastTx)
+                txcount++;
+            hashLastTx = jt->first.txhash;
         }
-        balance += it->second;
     }
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", balance);
     result.pushKV("received", received);
+    result.pushKV("txcount", txcount);
 
     return result;
 
@@ -959,12 +1119,18 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Read at most this many index rows, ordered by address then height\n"
+            "  \"cursor\" (string, optional) The cursor returned by the previous page\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nWith limit, the txids are returned in the \"txids\" field of an object, whose \"cursor\" field is set\n"
+            "to the cursor of the next page when more rows remain. A transaction is never split between two pages\n"
+            "of the same address, but may appear for several addresses. A page holding a single transaction\n"
+            "grows past limit to all the rows of the transaction.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -989,6 +1155,55 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    size_t nLimit, nAddress;
+    CAddressIndexKey keyFrom, keyNext;
+    bool fPaged = getAddressPageFromParams(params, addresses, nLimit, nAddress, keyFrom);
+
+    if (fPaged) {
+        getAddressIndexPage(addresses, start, end, nLimit, nAddress, keyFrom, keyNext, addressIndex);
+
+        // The rows of a transaction are adjacent, so the ones cut by the end of
+        // the page are moved to the next page. When they fill it entirely, the
+        // page grows to the rest of them instead.
+        if (!keyNext.IsNull() && !addressIndex.empty() && addressIndex.back().first.hashBytes == keyNext.hashBytes) {
+            const uint256 txhash = keyNext.txhash;
+            size_t nKeep = addressIndex.size();
+            while (nKeep > 0 && addressIndex[nKeep - 1].first.txhash == txhash)
+                nKeep--;
+            if (nKeep == 0) {
+                while (!keyNext.IsNull() && keyNext.txhash == txhash) {
+                    CAddressIndexKey keyRest = keyNext;
+                    if (!GetAddressIndex(keyRest.hashBytes, keyRest.type, addressIndex, start, end, &keyRest, nLimit, &keyNext))
+                        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+                nKeep = addressIndex.size();
+                while (nKeep > 0 && addressIndex[nKeep - 1].first.txhash != txhash)
+                    nKeep--;
+                // The transaction ended the address, the next page starts with the following one
+                if (nKeep == addressIndex.size() && keyNext.IsNull() && ++nAddress < addresses.size())
+                    keyNext = CAddressIndexKey(addresses[nAddress].second, addresses[nAddress].first, start > 0 ? start : 0, 0, uint256(), 0, false);
+            }
+            if (nKeep < addressIndex.size()) {
+                keyNext = addressIndex[nKeep].first;
+                addressIndex.resize(nKeep);
+            }
+        }
+
+        std::set<std::pair<int, std::string> > txids;
+        UniValue result(UniValue::VARR);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+            std::string txid = it->first.txhash.GetHex();
+            if (txids.insert(std::make_pair(it->first.blockHeight, txid)).second)
+                result.push_back(txid);
+        }
+
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("txids", result);
+        if (!keyNext.IsNull())
+            page.pushKV("cursor", getAddressPageCursor(nAddress, keyNext));
+        return page;
+    }
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
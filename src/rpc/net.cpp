@@ -4,6 +4,7 @@
 
 #include <rpc/server.h>
 
+#include <blockrelaycache.h>
 #include <chainparams.h>
 #include <clientversion.h>
 #include <main.h>
@@ -409,6 +410,13 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"blockrelaycache\":\n"
+            "  {\n"
+            "    \"hits\": n,                              (numeric) Blocks served from the cache of recently connected blocks\n"
+            "    \"misses\": n,                            (numeric) Blocks which had to be read from disk\n"
+            "    \"blocks\": n,                            (numeric) Number of cached blocks\n"
+            "    \"usage\": n                              (numeric) Memory used by the cache in bytes\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -429,6 +437,16 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     outboundLimit.pushKV("bytes_left_in_cycle", CNode::GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", CNode::GetMaxOutboundTimeLeftInCycle());
     obj.pushKV("uploadtarget", outboundLimit);
+
+    uint64_t nHits, nMisses;
+    size_t nBlocks, nUsage;
+    blockrelaycache.GetStats(nHits, nMisses, nBlocks, nUsage);
+    UniValue blockCache(UniValue::VOBJ);
+    blockCache.pushKV("hits", nHits);
+    blockCache.pushKV("misses", nMisses);
+    blockCache.pushKV("blocks", (uint64_t)nBlocks);
+    blockCache.pushKV("usage", (uint64_t)nUsage);
+    obj.pushKV("blockrelaycache", blockCache);
     return obj;
 }
 
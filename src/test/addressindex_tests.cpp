@@ -0,0 +1,368 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addressindex.h>
+#include <arith_uint256.h>
+#include <base58.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <uint256.h>
+#include <utilstrencodings.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+typedef std::vector<std::pair<CAddressIndexKey, CAmount> > AddressIndexVector;
+
+static AddressIndexVector BlockDeltas(const uint160& address, int nHeight, int nBranch = 0)
+{
+    AddressIndexVector vDeltas;
+    uint256 hashTx1 = ArithToUint256(arith_uint256(nBranch * 1000 + nHeight * 2));
+    uint256 hashTx2 = ArithToUint256(arith_uint256(nBranch * 1000 + nHeight * 2 + 1));
+    // Two outputs of a transaction, and a spend plus change in another one
+    vDeltas.push_back(std::make_pair(CAddressIndexKey(1, address, nHeight, 0, hashTx1, 0, false), 5 * COIN));
+    vDeltas.push_back(std::make_pair(CAddressIndexKey(1, address, nHeight, 0, hashTx1, 1, false), 1 * COIN));
+    vDeltas.push_back(std::make_pair(CAddressIndexKey(1, address, nHeight, 1, hashTx2, 0, true), -2 * COIN));
+    vDeltas.push_back(std::make_pair(CAddressIndexKey(1, address, nHeight, 1, hashTx2, 1, false), 1 * COIN));
+    return vDeltas;
+}
+
+static void ConnectDeltas(CBlockTreeDB& db, const AddressIndexVector& vDeltas, const CBlockIndex* pindex)
+{
+    BOOST_CHECK(db.WriteAddressIndex(vDeltas));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(vDeltas, pindex, false));
+}
+
+static void DisconnectDeltas(CBlockTreeDB& db, const AddressIndexVector& vDeltas, const CBlockIndex* pindex)
+{
+    BOOST_CHECK(db.EraseAddressIndex(vDeltas));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(vDeltas, pindex, true));
+}
+
+static void CheckBalance(CBlockTreeDB& db, const uint160& address, CAmount nBalance, CAmount nReceived, int64_t nTxCount)
+{
+    CAddressBalance balance;
+    BOOST_CHECK(db.ReadAddressBalance(address, 1, balance));
+    BOOST_CHECK_EQUAL(balance.balance, nBalance);
+    BOOST_CHECK_EQUAL(balance.received, nReceived);
+    BOOST_CHECK_EQUAL(balance.txcount, nTxCount);
+}
+
+static void CheckBestBlock(CBlockTreeDB& db, const CBlockIndex* pindex)
+{
+    uint256 hashBest;
+    BOOST_CHECK(db.ReadAddressBalanceBestBlock(hashBest));
+    BOOST_CHECK(hashBest == pindex->GetBlockHash());
+}
+
+BOOST_AUTO_TEST_CASE(addressbalance_index)
+{
+    FakeActiveChain chain(4);
+    CBlockTreeDB db(1 << 20, true);
+    uint160 address = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    CAddressBalance balance;
+
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, NULL));
+
+    for (int nHeight = 1; nHeight <= 3; nHeight++)
+        ConnectDeltas(db, BlockDeltas(address, nHeight), &chain.vIndex[nHeight]);
+
+    BOOST_CHECK(db.ReadAddressBalance(address, 1, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 15 * COIN);
+    BOOST_CHECK_EQUAL(balance.received, 21 * COIN);
+    BOOST_CHECK_EQUAL(balance.txcount, 6);
+    BOOST_CHECK_EQUAL(balance.nHeight, 3);
+    CheckBestBlock(db, &chain.vIndex[3]);
+
+    // Disconnecting the tip reverts its deltas
+    DisconnectDeltas(db, BlockDeltas(address, 3), &chain.vIndex[3]);
+    BOOST_CHECK(db.ReadAddressBalance(address, 1, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 10 * COIN);
+    BOOST_CHECK_EQUAL(balance.received, 14 * COIN);
+    BOOST_CHECK_EQUAL(balance.txcount, 4);
+    BOOST_CHECK_EQUAL(balance.nHeight, 2);
+    CheckBestBlock(db, &chain.vIndex[2]);
+
+    // A rebuild from the address index gives the same totals
+    BOOST_CHECK(db.SyncAddressBalanceIndex(false, &chain.vIndex[2]));
+    BOOST_CHECK(db.ReadAddressBalance(address, 1, balance));
+    BOOST_CHECK(balance.IsNull());
+    uint256 hashBest;
+    BOOST_CHECK(!db.ReadAddressBalanceBestBlock(hashBest));
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, &chain.vIndex[2]));
+    BOOST_CHECK(db.ReadAddressBalance(address, 1, balance));
+    BOOST_CHECK_EQUAL(balance.balance, 10 * COIN);
+    BOOST_CHECK_EQUAL(balance.received, 14 * COIN);
+    BOOST_CHECK_EQUAL(balance.txcount, 4);
+    BOOST_CHECK_EQUAL(balance.nHeight, 2);
+    CheckBestBlock(db, &chain.vIndex[2]);
+
+    // Unknown addresses have an empty balance
+    BOOST_CHECK(db.ReadAddressBalance(uint160(), 1, balance));
+    BOOST_CHECK(balance.IsNull());
+}
+
+BOOST_AUTO_TEST_CASE(addressbalance_index_replay)
+{
+    FakeActiveChain chain(6);
+    CBlockTreeDB db(1 << 20, true);
+    uint160 address = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, NULL));
+    for (int nHeight = 1; nHeight <= 3; nHeight++)
+        ConnectDeltas(db, BlockDeltas(address, nHeight), &chain.vIndex[nHeight]);
+    BOOST_CHECK(db.FlushIndexCache());
+
+    // The chainstate was last flushed at height 1, so blocks 2 and 3 get
+    // connected again after an unclean shutdown, and are not counted twice
+    for (int nHeight = 2; nHeight <= 4; nHeight++)
+        ConnectDeltas(db, BlockDeltas(address, nHeight), &chain.vIndex[nHeight]);
+    CheckBalance(db, address, 20 * COIN, 28 * COIN, 8);
+    CheckBestBlock(db, &chain.vIndex[4]);
+
+    // Likewise for a disconnected block which the chainstate still has
+    DisconnectDeltas(db, BlockDeltas(address, 4), &chain.vIndex[4]);
+    DisconnectDeltas(db, BlockDeltas(address, 4), &chain.vIndex[4]);
+    CheckBalance(db, address, 15 * COIN, 21 * COIN, 6);
+    CheckBestBlock(db, &chain.vIndex[3]);
+
+    // Building the index leaves out the rows above the tip, which belong to
+    // the blocks that get connected again
+    ConnectDeltas(db, BlockDeltas(address, 4), &chain.vIndex[4]);
+    ConnectDeltas(db, BlockDeltas(address, 5), &chain.vIndex[5]);
+    BOOST_CHECK(db.SyncAddressBalanceIndex(false, &chain.vIndex[2]));
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, &chain.vIndex[2]));
+    CheckBalance(db, address, 10 * COIN, 14 * COIN, 4);
+    CheckBestBlock(db, &chain.vIndex[2]);
+    for (int nHeight = 3; nHeight <= 5; nHeight++)
+        ConnectDeltas(db, BlockDeltas(address, nHeight), &chain.vIndex[nHeight]);
+    CheckBalance(db, address, 25 * COIN, 35 * COIN, 10);
+    CheckBestBlock(db, &chain.vIndex[5]);
+
+    // An index which does not know its last block, as built before it was
+    // kept, is built again
+    CBlockTreeDB dbOld(1 << 20, true);
+    for (int nHeight = 1; nHeight <= 5; nHeight++)
+        BOOST_CHECK(dbOld.WriteAddressIndex(BlockDeltas(address, nHeight)));
+    BOOST_CHECK(dbOld.SyncAddressBalanceIndex(true, NULL));
+    uint256 hashBest;
+    BOOST_CHECK(!dbOld.ReadAddressBalanceBestBlock(hashBest));
+    BOOST_CHECK(dbOld.SyncAddressBalanceIndex(true, &chain.vIndex[4]));
+    CheckBalance(dbOld, address, 20 * COIN, 28 * COIN, 8);
+    CheckBestBlock(dbOld, &chain.vIndex[4]);
+}
+
+BOOST_AUTO_TEST_CASE(addressbalance_index_reorg)
+{
+    FakeActiveChain chain(4);
+    CBlockTreeDB db(1 << 20, true);
+    uint160 address = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 other = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+
+    // A competing branch forking off after height 1
+    std::vector<uint256> vBranchHashes(3);
+    std::vector<CBlockIndex> vBranch(3);
+    for (unsigned int i = 0; i < vBranch.size(); i++) {
+        vBranchHashes[i] = GetRandHash();
+        vBranch[i].phashBlock = &vBranchHashes[i];
+        vBranch[i].pprev = i ? &vBranch[i - 1] : &chain.vIndex[1];
+        vBranch[i].nHeight = i + 2;
+        vBranch[i].BuildSkip();
+        mapBlockIndex[vBranchHashes[i]] = &vBranch[i];
+    }
+
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, NULL));
+
+    // The address has activity at heights 1 and 3 of the first branch
+    ConnectDeltas(db, BlockDeltas(address, 1), &chain.vIndex[1]);
+    ConnectDeltas(db, BlockDeltas(other, 2), &chain.vIndex[2]);
+    ConnectDeltas(db, BlockDeltas(address, 3), &chain.vIndex[3]);
+    CheckBalance(db, address, 10 * COIN, 14 * COIN, 4);
+
+    // Reorganize onto a competing branch from height 2, where the address
+    // has activity at a lower height than the block it loses
+    DisconnectDeltas(db, BlockDeltas(address, 3), &chain.vIndex[3]);
+    DisconnectDeltas(db, BlockDeltas(other, 2), &chain.vIndex[2]);
+    CheckBalance(db, address, 5 * COIN, 7 * COIN, 2);
+    ConnectDeltas(db, BlockDeltas(address, 2, 1), &vBranch[0]);
+    ConnectDeltas(db, BlockDeltas(other, 3, 1), &vBranch[1]);
+    ConnectDeltas(db, BlockDeltas(address, 4, 1), &vBranch[2]);
+    CheckBalance(db, address, 15 * COIN, 21 * COIN, 6);
+    CheckBalance(db, other, 5 * COIN, 7 * COIN, 2);
+    CheckBestBlock(db, &vBranch[2]);
+
+    // A rebuild from the address index gives the same totals
+    BOOST_CHECK(db.SyncAddressBalanceIndex(false, &vBranch[2]));
+    BOOST_CHECK(db.SyncAddressBalanceIndex(true, &vBranch[2]));
+    CheckBalance(db, address, 15 * COIN, 21 * COIN, 6);
+    CheckBalance(db, other, 5 * COIN, 7 * COIN, 2);
+
+    for (unsigned int i = 0; i < vBranch.size(); i++)
+        mapBlockIndex.erase(vBranchHashes[i]);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_pages)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 address = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 other = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+
+    AddressIndexVector vAll;
+    for (int nHeight = 1; nHeight <= 5; nHeight++) {
+        AddressIndexVector vDeltas = BlockDeltas(address, nHeight);
+        BOOST_CHECK(db.WriteAddressIndex(vDeltas));
+        BOOST_CHECK(db.WriteAddressIndex(BlockDeltas(other, nHeight)));
+        vAll.insert(vAll.end(), vDeltas.begin(), vDeltas.end());
+    }
+
+    // Pages of 3 rows cover the 20 rows of the address exactly once, in order
+    AddressIndexVector vPaged;
+    CAddressIndexKey keyFrom, keyNext;
+    int nPages = 0;
+    do {
+        AddressIndexVector vPage;
+        BOOST_CHECK(db.ReadAddressIndex(address, 1, vPage, 0, 0, keyFrom.IsNull() ? NULL : &keyFrom, 3, &keyNext));
+        BOOST_CHECK(vPage.size() <= 3);
+        vPaged.insert(vPaged.end(), vPage.begin(), vPage.end());
+        keyFrom = keyNext;
+        nPages++;
+    } while (!keyNext.IsNull());
+
+    BOOST_CHECK_EQUAL(nPages, 7);
+    BOOST_CHECK_EQUAL(vPaged.size(), vAll.size());
+    for (size_t i = 0; i < vPaged.size() && i < vAll.size(); i++) {
+        BOOST_CHECK(vPaged[i].first.txhash == vAll[i].first.txhash);
+        BOOST_CHECK_EQUAL(vPaged[i].first.index, vAll[i].first.index);
+        BOOST_CHECK_EQUAL(vPaged[i].second, vAll[i].second);
+    }
+
+    // A page ending with the last row of the address has no next key
+    AddressIndexVector vPage;
+    BOOST_CHECK(db.ReadAddressIndex(address, 1, vPage, 0, 0, NULL, vAll.size(), &keyNext));
+    BOOST_CHECK_EQUAL(vPage.size(), vAll.size());
+    BOOST_CHECK(keyNext.IsNull());
+}
+
+// The index key of a script as given by its address, which GetAddressIndexKey must match
+static int AddressIndexKeyFromDestination(const CScript& script, uint160& hashBytes)
+{
+    CTxDestination destination;
+    int type = 0;
+    hashBytes.SetNull();
+    if (!ExtractDestination(script, destination))
+        return 0;
+    CNavCoinAddress address(destination);
+    if (script.IsColdStaking())
+        address.GetSpendingAddress(address);
+    if (!address.GetIndexKey(hashBytes, type))
+        return 0;
+    return type;
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_cache)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 address = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    CSpentIndexKey keySpent(ArithToUint256(arith_uint256(1)), 0);
+    CSpentIndexValue value;
+
+    // Index writes stay in memory, where point reads find them
+    BOOST_CHECK(db.WriteAddressIndex(BlockDeltas(address, 1)));
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    vSpent.push_back(std::make_pair(keySpent, CSpentIndexValue(ArithToUint256(arith_uint256(2)), 0, 1, 5 * COIN, 1, address)));
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(db.IndexCacheUsage() > 0);
+    BOOST_CHECK(db.ReadSpentIndex(keySpent, value));
+    BOOST_CHECK_EQUAL(value.satoshis, 5 * COIN);
+
+    // Range reads find them too, and leave them pending
+    uint160 addressOther = uint160(ParseHex("1112131415161718191a1b1c1d1e1f2021222324"));
+    BOOST_CHECK(db.WriteAddressIndex(BlockDeltas(addressOther, 1)));
+    AddressIndexVector vRows;
+    BOOST_CHECK(db.ReadAddressIndex(address, 1, vRows));
+    BOOST_CHECK_EQUAL(vRows.size(), 4U);
+    BOOST_CHECK(db.IndexCacheUsage() > 0);
+
+    // Pending writes are merged with the rows in the database, in key order,
+    // and pending erases hide rows in the database
+    BOOST_CHECK(db.FlushIndexCache());
+    BOOST_CHECK_EQUAL(db.IndexCacheUsage(), 0U);
+    BOOST_CHECK(db.WriteAddressIndex(BlockDeltas(address, 2)));
+    AddressIndexVector vErase = BlockDeltas(address, 1);
+    vErase.resize(2);
+    BOOST_CHECK(db.EraseAddressIndex(vErase));
+    vRows.clear();
+    BOOST_CHECK(db.ReadAddressIndex(address, 1, vRows));
+    BOOST_REQUIRE_EQUAL(vRows.size(), 6U);
+    BOOST_CHECK_EQUAL(vRows[0].first.blockHeight, 1);
+    BOOST_CHECK_EQUAL(vRows[0].first.txindex, 1U);
+    BOOST_CHECK_EQUAL(vRows[2].first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vRows[2].second, 5 * COIN);
+    for (unsigned int i = 0; i < vRows.size(); i++)
+        BOOST_CHECK(vRows[i].first.hashBytes == address);
+    BOOST_CHECK(db.IndexCacheUsage() > 0);
+
+    // Flushing them gives the same rows
+    BOOST_CHECK(db.FlushIndexCache());
+    AddressIndexVector vFlushed;
+    BOOST_CHECK(db.ReadAddressIndex(address, 1, vFlushed));
+    BOOST_REQUIRE_EQUAL(vFlushed.size(), vRows.size());
+    for (unsigned int i = 0; i < vRows.size(); i++) {
+        BOOST_CHECK(vFlushed[i].first.txhash == vRows[i].first.txhash);
+        BOOST_CHECK_EQUAL(vFlushed[i].first.index, vRows[i].first.index);
+        BOOST_CHECK_EQUAL(vFlushed[i].second, vRows[i].second);
+    }
+    BOOST_CHECK(db.ReadSpentIndex(keySpent, value));
+
+    // A pending erase hides the entry in the database
+    vSpent[0].second.SetNull();
+    BOOST_CHECK(db.UpdateSpentIndex(vSpent));
+    BOOST_CHECK(!db.ReadSpentIndex(keySpent, value));
+    BOOST_CHECK(db.FlushIndexCache());
+    BOOST_CHECK(!db.ReadSpentIndex(keySpent, value));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_script_key)
+{
+    CKey key, key2;
+    key.MakeNewKey(true);
+    key2.MakeNewKey(false);
+    CKeyID keyID = key.GetPubKey().GetID();
+    CKeyID keyID2 = key2.GetPubKey().GetID();
+
+    std::vector<unsigned char> vchInvalid(33, 0x11);
+    vchInvalid[0] = 0x04;
+
+    std::vector<CScript> vScripts;
+    vScripts.push_back(GetScriptForDestination(keyID));
+    vScripts.push_back(GetScriptForDestination(CScriptID(GetScriptForDestination(keyID))));
+    vScripts.push_back(GetScriptForDestination(std::make_pair(keyID, keyID2)));
+    vScripts.push_back(GetScriptForRawPubKey(key.GetPubKey()));
+    vScripts.push_back(CScript() << vchInvalid << OP_CHECKSIG);
+    vScripts.push_back(CScript() << OP_RETURN << ParseHex("0102"));
+
+    const int vExpectedTypes[] = {1, 2, 1, 1, 0, 0};
+    for (size_t i = 0; i < vScripts.size(); i++) {
+        uint160 hashBytes, hashExpected;
+        int type = GetAddressIndexKey(vScripts[i], hashBytes);
+        BOOST_CHECK_EQUAL(type, vExpectedTypes[i]);
+        BOOST_CHECK_EQUAL(type, AddressIndexKeyFromDestination(vScripts[i], hashExpected));
+        BOOST_CHECK(hashBytes == hashExpected);
+    }
+
+    // Cold staking outputs are indexed under the spending key
+    uint160 hashBytes;
+    GetAddressIndexKey(vScripts[2], hashBytes);
+    BOOST_CHECK(hashBytes == uint160(keyID2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
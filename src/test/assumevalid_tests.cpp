@@ -0,0 +1,182 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <script/script.h>
+#include <test/test_navcoin.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(assumevalid_tests, BasicTestingSetup)
+
+static CBlock CreateStakeBlock(const CKey& key)
+{
+    CBlock block;
+    block.nVersion = 7;
+    block.nTime = 1500000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.nTime = block.nTime;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0] = CTxOut(0, CScript());
+
+    CMutableTransaction coinstake;
+    coinstake.nTime = block.nTime;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0] = CTxOut(0, CScript());
+    coinstake.vout[1].nValue = 1000 * COIN;
+    coinstake.vout[1].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(coinstake);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    BOOST_CHECK(key.Sign(block.GetHash(), block.vchBlockSig));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_checks_block_signature)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBlock block = CreateStakeBlock(key);
+    BOOST_REQUIRE(block.IsProofOfStake());
+
+    // The block is buried under the -assumevalid block, which is the best header
+    uint256 hashBlock = block.GetHash();
+    uint256 hashTip = GetRandHash();
+    CBlockIndex indexBlock;
+    indexBlock.phashBlock = &hashBlock;
+    indexBlock.nHeight = 0;
+    indexBlock.nBits = block.nBits;
+    CBlockIndex indexTip;
+    indexTip.phashBlock = &hashTip;
+    indexTip.pprev = &indexBlock;
+    indexTip.nHeight = 1;
+    indexTip.nBits = block.nBits;
+    indexTip.nChainWork = arith_uint256(1) << 64;
+    indexTip.BuildSkip();
+
+    CBlockIndex* pindexBestHeaderOld;
+    {
+        LOCK(cs_main);
+        mapBlockIndex[hashBlock] = &indexBlock;
+        mapBlockIndex[hashTip] = &indexTip;
+        pindexBestHeaderOld = pindexBestHeader;
+        pindexBestHeader = &indexTip;
+        hashAssumeValid = hashTip;
+    }
+
+    const Consensus::Params& params = Params().GetConsensus();
+    CValidationState state;
+    CBlock blockValid = block;
+    BOOST_CHECK(PrecheckBlock(blockValid, params));
+    blockValid.fChecked = false;
+    BOOST_CHECK(CheckBlock(blockValid, state, params));
+
+    // The block signature is not committed to by the block hash or the merkle
+    // root, so it must still be checked for assumed valid blocks
+    CBlock blockTampered = block;
+    blockTampered.vchBlockSig[blockTampered.vchBlockSig.size() / 2] ^= 0x01;
+    BOOST_CHECK(blockTampered.GetHash() == hashBlock);
+    BOOST_CHECK(!PrecheckBlock(blockTampered, params));
+    BOOST_CHECK(!CheckBlock(blockTampered, state, params));
+
+    blockTampered = block;
+    blockTampered.vchBlockSig.clear();
+    BOOST_CHECK(!PrecheckBlock(blockTampered, params));
+
+    {
+        LOCK(cs_main);
+        mapBlockIndex.erase(hashBlock);
+        mapBlockIndex.erase(hashTip);
+        pindexBestHeader = pindexBestHeaderOld;
+        hashAssumeValid.SetNull();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_ancestors)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // Each block adds the work of a quarter of ASSUME_VALID_MIN_BURIED_TIME,
+    // so blocks four below the best header are buried enough and three are not
+    const int nBlocks = 10;
+    std::vector<uint256> vHash(nBlocks + 1);
+    std::vector<CBlockIndex> vIndex(nBlocks + 1);
+    for (int i = 0; i <= nBlocks; i++) {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].nBits = 0x207fffff;
+    }
+    arith_uint256 nWorkBlock = GetBlockProof(vIndex[0]) * (ASSUME_VALID_MIN_BURIED_TIME / (4 * params.nPowTargetSpacing) + 1);
+    for (int i = 0; i < nBlocks; i++) {
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = i;
+        vIndex[i].nChainWork = nWorkBlock * (i + 1);
+        vIndex[i].BuildSkip();
+    }
+    // A block at height 5 on a branch off block 4
+    CBlockIndex& indexFork = vIndex[nBlocks];
+    indexFork.pprev = &vIndex[4];
+    indexFork.nHeight = 5;
+    indexFork.nChainWork = vIndex[5].nChainWork;
+    indexFork.BuildSkip();
+
+    CBlockIndex* pindexTip = &vIndex[nBlocks - 1];
+    CBlockIndex* pindexBestHeaderOld;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i <= nBlocks; i++)
+            mapBlockIndex[vHash[i]] = &vIndex[i];
+        pindexBestHeaderOld = pindexBestHeader;
+        pindexBestHeader = pindexTip;
+
+        // Without an -assumevalid block, or with one not in the block index, every script is checked
+        hashAssumeValid.SetNull();
+        BOOST_CHECK(!IsAssumedValid(&vIndex[2], params));
+        hashAssumeValid = GetRandHash();
+        BOOST_CHECK(!IsAssumedValid(&vIndex[2], params));
+
+        // Ancestors of the -assumevalid block buried enough under the best header skip their scripts
+        hashAssumeValid = vHash[nBlocks - 2];
+        BOOST_CHECK(IsAssumedValid(&vIndex[2], params));
+        BOOST_CHECK(IsAssumedValid(&vIndex[nBlocks - 5], params));
+
+        // Not buried enough, though an ancestor
+        BOOST_CHECK(!IsAssumedValid(&vIndex[nBlocks - 4], params));
+        BOOST_CHECK(!IsAssumedValid(&vIndex[nBlocks - 2], params));
+
+        // Not an ancestor: above the -assumevalid block, or on another branch
+        BOOST_CHECK(!IsAssumedValid(&vIndex[nBlocks - 1], params));
+        BOOST_CHECK(!IsAssumedValid(&indexFork, params));
+
+        // Buried under a best header on another branch, which only the common ancestors skip
+        indexFork.nChainWork = nWorkBlock * (nBlocks + 4);
+        pindexBestHeader = &indexFork;
+        BOOST_CHECK(IsAssumedValid(&vIndex[2], params));
+        BOOST_CHECK(!IsAssumedValid(&vIndex[5], params));
+
+        for (int i = 0; i <= nBlocks; i++)
+            mapBlockIndex.erase(vHash[i]);
+        pindexBestHeader = pindexBestHeaderOld;
+        hashAssumeValid.SetNull();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockrelaycache.h>
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <version.h>
+#include <test/test_navcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockrelaycache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockrelaycache)
+{
+    CBlockRelayCache cache(1 << 20);
+    CBlock block = Params().GenesisBlock();
+    uint64_t nHits, nMisses;
+    size_t nBlocks, nUsage;
+
+    BOOST_CHECK(!cache.Get(block.GetHash(), true));
+    cache.Add(block);
+
+    // The cached bytes are the network serialization, block signature included
+    CSerializedBlockRef pserialized = cache.Get(block.GetHash(), true);
+    BOOST_REQUIRE(pserialized);
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    CDataStream ssCached(SER_NETWORK, PROTOCOL_VERSION);
+    ssCached << *pserialized;
+    BOOST_CHECK(ssCached.str() == ssBlock.str());
+
+    // Without witness data both serializations are shared
+    BOOST_CHECK(cache.Get(block.GetHash(), false) == pserialized);
+
+    cache.GetStats(nHits, nMisses, nBlocks, nUsage);
+    BOOST_CHECK_EQUAL(nHits, 2U);
+    BOOST_CHECK_EQUAL(nMisses, 1U);
+    BOOST_CHECK_EQUAL(nBlocks, 1U);
+    BOOST_CHECK(nUsage >= ssBlock.size());
+
+    // Blocks are evicted once the cache goes over its size
+    CBlock blockOther = block;
+    blockOther.nNonce++;
+    cache.SetMaxUsage(nUsage);
+    cache.Add(blockOther);
+    BOOST_CHECK(cache.Get(blockOther.GetHash(), true));
+    BOOST_CHECK(!cache.Get(block.GetHash(), true));
+    BOOST_CHECK(pserialized->size() == ssBlock.size());
+
+    cache.SetMaxUsage(0);
+    cache.GetStats(nHits, nMisses, nBlocks, nUsage);
+    BOOST_CHECK_EQUAL(nBlocks, 0U);
+    BOOST_CHECK_EQUAL(nUsage, 0U);
+    cache.Add(block);
+    BOOST_CHECK(!cache.Get(block.GetHash(), true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
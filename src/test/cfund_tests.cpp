@@ -4,10 +4,12 @@
 
 #include <chainparams.h>
 #include <consensus/cfund.h>
+#include <consensus/validation.h>
 #include <coins.h>
 #include <random.h>
 #include <uint256.h>
 #include <test/test_navcoin.h>
+#include <test/testutil.h>
 #include <main.h>
 
 #include <vector>
@@ -15,6 +17,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+extern std::map<uint256, std::pair<int, int>> vCacheProposalsToUpdate;
+extern std::map<uint256, std::pair<int, int>> vCachePaymentRequestToUpdate;
+extern const CBlockIndex* pindexCacheVotes;
+
 BOOST_FIXTURE_TEST_SUITE(cfund_tests, TestingSetup)
 
 BOOST_AUTO_TEST_CASE(cfund_proposals)
@@ -551,5 +557,134 @@ BOOST_AUTO_TEST_CASE(cfund_prequests)
 
 }
 
+struct CFundRegtestSetup : public BasicTestingSetup
+{
+    CFundRegtestSetup() : BasicTestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+typedef std::map<uint256, std::pair<int, int>> CVoteTally;
+
+// Count the votes of the current voting cycle from scratch, up to and including pindex
+static void RecountVotes(const CBlockIndex* pindex, CVoteTally& mapProposals, CVoteTally& mapPaymentRequests)
+{
+    mapProposals.clear();
+    mapPaymentRequests.clear();
+    for (int n = pindex->nHeight % Params().GetConsensus().nBlocksPerVotingCycle + 1; n > 0 && pindex; n--, pindex = pindex->pprev)
+    {
+        std::set<uint256> setSeen;
+        for (const std::pair<uint256, bool>& vote: pindex->vProposalVotes)
+            if (setSeen.insert(vote.first).second)
+                (vote.second ? mapProposals[vote.first].first : mapProposals[vote.first].second)++;
+        for (const std::pair<uint256, bool>& vote: pindex->vPaymentRequestVotes)
+            if (setSeen.insert(vote.first).second)
+                (vote.second ? mapPaymentRequests[vote.first].first : mapPaymentRequests[vote.first].second)++;
+    }
+}
+
+static void CheckVotes(const CBlockIndex* pindex, const CCoinsViewCache& view, const std::vector<uint256>& vProposals, const std::vector<uint256>& vPaymentRequests)
+{
+    CVoteTally mapProposals, mapPaymentRequests;
+    RecountVotes(pindex, mapProposals, mapPaymentRequests);
+    BOOST_CHECK(vCacheProposalsToUpdate == mapProposals);
+    BOOST_CHECK(vCachePaymentRequestToUpdate == mapPaymentRequests);
+
+    // Entries without votes in the cycle keep what they had
+    for (const uint256& hash: vProposals)
+    {
+        CProposal proposal;
+        if (!mapProposals.count(hash) || !view.GetProposal(hash, proposal))
+            continue;
+        BOOST_CHECK_EQUAL(proposal.nVotesYes, mapProposals[hash].first);
+        BOOST_CHECK_EQUAL(proposal.nVotesNo, mapProposals[hash].second);
+    }
+    for (const uint256& hash: vPaymentRequests)
+    {
+        CPaymentRequest prequest;
+        if (!mapPaymentRequests.count(hash) || !view.GetPaymentRequest(hash, prequest))
+            continue;
+        BOOST_CHECK_EQUAL(prequest.nVotesYes, mapPaymentRequests[hash].first);
+        BOOST_CHECK_EQUAL(prequest.nVotesNo, mapPaymentRequests[hash].second);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(cfund_vote_tally, CFundRegtestSetup)
+{
+    LOCK(cs_main);
+
+    int nBlocksPerVotingCycle = Params().GetConsensus().nBlocksPerVotingCycle;
+    FakeActiveChain chain(nBlocksPerVotingCycle * 3 + nBlocksPerVotingCycle / 2);
+
+    CCoinsViewDB coinsdbview(1 << 20, true);
+    CCoinsViewCache view(&coinsdbview);
+
+    // The last proposal only gets into the view after it was first voted for
+    std::vector<uint256> vProposals, vPaymentRequests;
+    for (int i = 0; i < 3; i++)
+        vProposals.push_back(GetRandHash());
+    vPaymentRequests.push_back(GetRandHash());
+    for (int i = 0; i < 2; i++)
+    {
+        CProposal proposal;
+        proposal.hash = vProposals[i];
+        proposal.nAmount = COIN;
+        proposal.strDZeel = "test";
+        BOOST_CHECK(view.AddProposal(proposal));
+    }
+    CPaymentRequest prequest;
+    prequest.hash = vPaymentRequests[0];
+    prequest.nAmount = COIN;
+    prequest.strDZeel = "test";
+    BOOST_CHECK(view.AddPaymentRequest(prequest));
+
+    // Random votes, sometimes voting twice in a block of which only the first vote counts
+    for (unsigned int i = 1; i < chain.vIndex.size(); i++)
+    {
+        CBlockIndex& index = chain.vIndex[i];
+        for (const uint256& hash: vProposals)
+        {
+            if (insecure_rand() % 3 == 0)
+                continue;
+            bool fYes = insecure_rand() % 2;
+            index.vProposalVotes.push_back(std::make_pair(hash, fYes));
+            if (insecure_rand() % 4 == 0)
+                index.vProposalVotes.push_back(std::make_pair(hash, !fYes));
+        }
+        if (insecure_rand() % 3 != 0)
+            index.vPaymentRequestVotes.push_back(std::make_pair(vPaymentRequests[0], (bool)(insecure_rand() % 2)));
+    }
+
+    CValidationState state;
+    pindexCacheVotes = nullptr;
+    int nHeightAdded = nBlocksPerVotingCycle + 5;
+    for (unsigned int i = 1; i < chain.vIndex.size(); i++)
+    {
+        if ((int)i == nHeightAdded)
+        {
+            CProposal proposal;
+            proposal.hash = vProposals[2];
+            proposal.nAmount = COIN;
+            proposal.strDZeel = "test";
+            BOOST_CHECK(view.AddProposal(proposal));
+        }
+        CFundStep(state, &chain.vIndex[i], false, view);
+        CheckVotes(&chain.vIndex[i], view, vProposals, vPaymentRequests);
+    }
+
+    // Disconnect back across two cycle boundaries, and connect again
+    int nHeightFork = nBlocksPerVotingCycle + nBlocksPerVotingCycle / 2;
+    for (int i = chain.vIndex.size() - 1; i > nHeightFork; i--)
+    {
+        CFundStep(state, &chain.vIndex[i], true, view);
+        CheckVotes(&chain.vIndex[i - 1], view, vProposals, vPaymentRequests);
+    }
+    for (unsigned int i = nHeightFork + 1; i < chain.vIndex.size(); i++)
+    {
+        CFundStep(state, &chain.vIndex[i], false, view);
+        CheckVotes(&chain.vIndex[i], view, vProposals, vPaymentRequests);
+    }
+
+    pindexCacheVotes = nullptr;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
@@ -10,8 +10,9 @@
 #include <test/test_navcoin.h>
 #include <main.h>
 
-#include <vector>
 #include <map>
+#include <set>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -432,5 +433,183 @@ BOOST_AUTO_TEST_CASE(cfunddb_state)
     }
 }
 
+BOOST_AUTO_TEST_CASE(cfunddb_state_accumulator)
+{
+    CCoinsViewDB *pcoinsdbview = new CCoinsViewDB(1<<23, true);
+    CCoinsViewCache *base = new CCoinsViewCache(pcoinsdbview);
+    CCoinsViewCache view(base);
+
+    BOOST_CHECK(view.GetCFundStateAccumulator() == uint256());
+
+    std::vector<uint256> vHashes;
+    CAmount nFee = Params().GetConsensus().nProposalMinimalFee;
+
+    for (unsigned int i = 0; i < 50; i++) {
+        CProposal proposal;
+        std::string strDZeel = "{\"n\":5000000000,\"a\":\"NP3h1uzYuZX9k3xmT5sZsrEceRFW5kxo2N\",\"d\":604800,\"s\":\"test\",\"v\":2}";
+        BOOST_CHECK(TxToProposal(strDZeel, GetRandHash(), GetRandHash(), nFee, proposal));
+        proposal.fDirty = true;
+        BOOST_CHECK(view.AddProposal(proposal));
+        vHashes.push_back(proposal.hash);
+
+        CPaymentRequest prequest;
+        std::string strDZeel2 = "{\"h\":\"e8b46f55fd222cf269ab2eb935ba38cc7c9d19b775d9dd781fb6c7b88059bdde\",\"n\":500000000000,\"s\":\"HxYeRn96t7B4H6G2FB11N/8ZpxJ9JhzSLIdn/kqQDV8ZGtfW0EdGS0kUJaoji+RGyBIH1MeA1yctQq4+QC+54lA=\",\"r\":\"eI852p895a9EfFAy\",\"i\":\"test\",\"v\":2}";
+        BOOST_CHECK(TxToPaymentRequest(strDZeel2, GetRandHash(), GetRandHash(), prequest, view));
+        prequest.fDirty = true;
+        BOOST_CHECK(view.AddPaymentRequest(prequest));
+
+        BOOST_CHECK(view.GetCFundStateAccumulator() == view.ComputeCFundStateAccumulator());
+
+        // Modify and remove some of the entries of previous rounds
+        if (i % 3 == 1) {
+            CProposalModifier mproposal = view.ModifyProposal(vHashes[i - 1]);
+            mproposal->nVotesYes++;
+            mproposal->fDirty = true;
+        }
+        if (i % 7 == 6) {
+            BOOST_CHECK(view.RemoveProposal(vHashes[i - 2]));
+        }
+        BOOST_CHECK(view.GetCFundStateAccumulator() == view.ComputeCFundStateAccumulator());
+
+        // Every layer keeps its own accumulator consistent with its entries
+        if (i % 5 == 4)
+            BOOST_CHECK(view.Flush());
+        if (i % 10 == 9)
+            BOOST_CHECK(base->Flush());
+        BOOST_CHECK(view.GetCFundStateAccumulator() == view.ComputeCFundStateAccumulator());
+        BOOST_CHECK(base->GetCFundStateAccumulator() == base->ComputeCFundStateAccumulator());
+    }
+
+    // The state hash commits to the accumulator and the fund amounts
+    BOOST_CHECK(view.GetCFundDBStateHash(0, 0) != view.GetCFundDBStateHash(0, 1));
+    uint256 hashState = view.GetCFundDBStateHash(0, 0);
+    {
+        CProposalModifier mproposal = view.ModifyProposal(vHashes[0]);
+        mproposal->nVotesNo++;
+    }
+    BOOST_CHECK(view.GetCFundDBStateHash(0, 0) != hashState);
+
+    delete base;
+    delete pcoinsdbview;
+}
+
+// Payment requests of proposal pid, found by scanning every entry
+static std::set<uint256> ScanProposalPaymentRequests(CCoinsViewCache& view, const uint256& pid)
+{
+    std::set<uint256> setRet;
+    CPaymentRequestMap mapPaymentRequests;
+    BOOST_CHECK(view.GetAllPaymentRequests(mapPaymentRequests));
+    for (auto &it: mapPaymentRequests)
+        if (it.second.proposalhash == pid)
+            setRet.insert(it.first);
+    return setRet;
+}
+
+BOOST_AUTO_TEST_CASE(cfunddb_indexes)
+{
+    LOCK(cs_main);
+
+    CCoinsViewDB *pcoinsdbview = new CCoinsViewDB(1<<23, true);
+    CCoinsViewCache *base = new CCoinsViewCache(pcoinsdbview);
+    CCoinsViewCache view(base);
+
+    // A block known to the block index, so states set on it are found by GetLastState
+    CBlockIndex index;
+    index.nHeight = 10;
+    uint256 hashStateBlock = GetRandHash();
+    mapBlockIndex[hashStateBlock] = &index;
+
+    std::vector<uint256> vProposals;
+    std::vector<uint256> vPaymentRequests;
+    CAmount nFee = Params().GetConsensus().nProposalMinimalFee;
+
+    for (unsigned int i = 0; i < 5; i++) {
+        CProposal proposal;
+        std::string strDZeel = "{\"n\":5000000000,\"a\":\"NP3h1uzYuZX9k3xmT5sZsrEceRFW5kxo2N\",\"d\":604800,\"s\":\"test\",\"v\":2}";
+        BOOST_CHECK(TxToProposal(strDZeel, GetRandHash(), GetRandHash(), nFee, proposal));
+        proposal.fDirty = true;
+        BOOST_CHECK(view.AddProposal(proposal));
+        vProposals.push_back(proposal.hash);
+    }
+
+    for (unsigned int i = 0; i < 40; i++) {
+        CPaymentRequest prequest;
+        std::string strDZeel = "{\"h\":\"e8b46f55fd222cf269ab2eb935ba38cc7c9d19b775d9dd781fb6c7b88059bdde\",\"n\":500000000000,\"s\":\"HxYeRn96t7B4H6G2FB11N/8ZpxJ9JhzSLIdn/kqQDV8ZGtfW0EdGS0kUJaoji+RGyBIH1MeA1yctQq4+QC+54lA=\",\"r\":\"eI852p895a9EfFAy\",\"i\":\"test\",\"v\":2}";
+        BOOST_CHECK(TxToPaymentRequest(strDZeel, GetRandHash(), GetRandHash(), prequest, view));
+        prequest.proposalhash = vProposals[i % vProposals.size()];
+        prequest.fDirty = true;
+        BOOST_CHECK(view.AddPaymentRequest(prequest));
+        vPaymentRequests.push_back(prequest.hash);
+
+        if (i % 4 == 3 && (i - 2) % 9 != 7) {
+            CPaymentRequestModifier mprequest = view.ModifyPaymentRequest(vPaymentRequests[i - 2]);
+            mprequest->mapState[hashStateBlock] = CFund::ACCEPTED;
+            mprequest->fDirty = true;
+        }
+        if (i % 9 == 8) {
+            BOOST_CHECK(view.RemovePaymentRequest(vPaymentRequests[i - 1]));
+        }
+        if (i % 6 == 5) {
+            CProposalModifier mproposal = view.ModifyProposal(vProposals[i % vProposals.size()]);
+            mproposal->mapState[hashStateBlock] = CFund::ACCEPTED;
+            mproposal->fDirty = true;
+        }
+
+        // Each layer answers from its own entries and the index of the layer below
+        if (i % 5 == 4)
+            BOOST_CHECK(view.Flush());
+        if (i % 10 == 9)
+            BOOST_CHECK(base->Flush());
+
+        for (const uint256& pid: vProposals) {
+            std::set<uint256> setPaymentRequests;
+            BOOST_CHECK(view.GetProposalPaymentRequests(pid, setPaymentRequests));
+            BOOST_CHECK(setPaymentRequests == ScanProposalPaymentRequests(view, pid));
+            BOOST_CHECK(base->GetProposalPaymentRequests(pid, setPaymentRequests));
+            BOOST_CHECK(setPaymentRequests == ScanProposalPaymentRequests(*base, pid));
+        }
+
+        for (flags nState: {CFund::NIL, CFund::ACCEPTED}) {
+            CProposalMap mapProposals, mapProposalsInState;
+            CPaymentRequestMap mapPaymentRequests, mapPaymentRequestsInState;
+            BOOST_CHECK(view.GetAllProposals(mapProposals));
+            BOOST_CHECK(view.GetAllPaymentRequests(mapPaymentRequests));
+            BOOST_CHECK(CFund::GetProposalsByState(view, nState, mapProposalsInState));
+            BOOST_CHECK(CFund::GetPaymentRequestsByState(view, nState, mapPaymentRequestsInState));
+
+            unsigned int nProposals = 0, nPaymentRequests = 0;
+            for (auto &it: mapProposals) {
+                if (it.second.GetLastState() == nState) {
+                    BOOST_CHECK(mapProposalsInState.count(it.first));
+                    nProposals++;
+                }
+            }
+            for (auto &it: mapPaymentRequests) {
+                if (it.second.GetLastState() == nState) {
+                    BOOST_CHECK(mapPaymentRequestsInState.count(it.first));
+                    nPaymentRequests++;
+                }
+            }
+            BOOST_CHECK_EQUAL(mapProposalsInState.size(), nProposals);
+            BOOST_CHECK_EQUAL(mapPaymentRequestsInState.size(), nPaymentRequests);
+        }
+    }
+
+    // Entries which reached the database are found through its own indexes
+    BOOST_CHECK(view.Flush());
+    BOOST_CHECK(base->Flush());
+    std::set<uint256> setAccepted;
+    BOOST_CHECK(pcoinsdbview->GetPaymentRequestStateCandidates(CFund::ACCEPTED, setAccepted));
+    CPaymentRequestMap mapAccepted;
+    BOOST_CHECK(CFund::GetPaymentRequestsByState(view, CFund::ACCEPTED, mapAccepted));
+    BOOST_CHECK(!mapAccepted.empty());
+    BOOST_CHECK_EQUAL(setAccepted.size(), mapAccepted.size());
+
+    mapBlockIndex.erase(hashStateBlock);
+
+    delete base;
+    delete pcoinsdbview;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
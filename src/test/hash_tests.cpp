@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <chainparams.h>
 #include <hash.h>
+#include <hashblock.h>
 #include <utilstrencodings.h>
 #include <test/test_navcoin.h>
 
@@ -124,4 +126,52 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(hash9_hasher)
+{
+    std::vector<unsigned char> vData(200);
+    for (size_t i = 0; i < vData.size(); i++)
+        vData[i] = (i * 31 + 7) & 0xff;
+
+    // A reused hasher fed in pieces matches the one shot hash
+    CHash9 hasher;
+    for (size_t nLen = 0; nLen <= vData.size(); nLen += 13) {
+        uint256 hash;
+        hasher.Reset();
+        for (size_t nPos = 0; nPos < nLen; nPos += 7)
+            hasher.Write(&vData[nPos], std::min<size_t>(7, nLen - nPos));
+        hasher.Finalize(hash.begin());
+        BOOST_CHECK(hash == Hash9(vData.begin(), vData.begin() + nLen));
+    }
+
+    // Genesis block header
+    BOOST_CHECK(Params().GenesisBlock().GetPoWHash() == uint256S("0x00006a4e3e18c71c6d48ad6c261e2254fa764cf29607a4357c99b712dfbb8e6a"));
+}
+
+BOOST_AUTO_TEST_CASE(hash9_batch)
+{
+    Hash9AutoDetect();
+
+    // Headers and an odd length, which takes the generic path
+    const size_t vLens[] = {80, 37};
+    for (size_t nLen : vLens) {
+        std::vector<unsigned char> vBuffers(nLen * 13);
+        for (size_t i = 0; i < vBuffers.size(); i++)
+            vBuffers[i] = (i * 7 + 3) & 0xff;
+
+        // Every batch size up to a few multiples of the lane count, so the
+        // partial batches are covered
+        for (size_t nCount = 0; nCount <= 13; nCount++) {
+            std::vector<const unsigned char*> vData;
+            for (size_t i = 0; i < nCount; i++)
+                vData.push_back(&vBuffers[i * nLen]);
+            std::vector<uint256> vHashes(nCount + 1);
+            Hash9Batch(vData.empty() ? NULL : &vData[0], nLen, &vHashes[0], nCount);
+
+            for (size_t i = 0; i < nCount; i++)
+                BOOST_CHECK(vHashes[i] == Hash9(vBuffers.begin() + i * nLen, vBuffers.begin() + (i + 1) * nLen));
+            BOOST_CHECK(vHashes[nCount].IsNull());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
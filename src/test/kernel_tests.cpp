@@ -0,0 +1,186 @@
+// Copyright (c) 2018 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <kernel.h>
+#include <main.h>
+#include <random.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+static const unsigned int KERNEL_TEST_BITS = 0x1d00ffff;
+static const unsigned int KERNEL_TEST_TIME = 1500000000;
+
+static void BuildKernelCoins(std::vector<CStakeKernelCoin>& vCoins, std::vector<CTransaction>& vTxPrev, std::vector<CBlockIndex>& vBlockFrom)
+{
+    for (unsigned int i = 0; i < 500; i++) {
+        CStakeKernelCoin coin(COutPoint(GetRandHash(), i % 3), KERNEL_TEST_TIME - 3 * 24 * 60 * 60 - i,
+                              KERNEL_TEST_TIME - 3 * 24 * 60 * 60 - i, (1 + i % 5) * COIN);
+        vCoins.push_back(coin);
+
+        CMutableTransaction tx;
+        tx.nTime = coin.nTimeTxPrev;
+        tx.vout.resize(coin.prevout.n + 1);
+        tx.vout[coin.prevout.n].nValue = coin.nValue;
+        vTxPrev.push_back(CTransaction(tx));
+    }
+    vBlockFrom.resize(vCoins.size());
+    for (unsigned int i = 0; i < vCoins.size(); i++)
+        vBlockFrom[i].nTime = vCoins[i].nTimeBlockFrom;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_matches_consensus)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 100;
+    indexPrev.nTime = KERNEL_TEST_TIME;
+    indexPrev.nStakeModifier = 0x0123456789abcdefULL;
+
+    std::vector<CStakeKernelCoin> vCoins;
+    std::vector<CTransaction> vTxPrev;
+    std::vector<CBlockIndex> vBlockFrom;
+    BuildKernelCoins(vCoins, vTxPrev, vBlockFrom);
+
+    CStakeKernelSearch search(&indexPrev, KERNEL_TEST_BITS);
+
+    // Every single check agrees with the consensus kernel check
+    int nFirstKernel = -1;
+    unsigned int nKernels = 0;
+    for (unsigned int i = 0; i < vCoins.size(); i++) {
+        arith_uint256 hashProofOfStake, targetProofOfStake;
+        bool fKernel = CheckStakeKernelHash(&indexPrev, KERNEL_TEST_BITS, vBlockFrom[i], vTxPrev[i], vCoins[i].prevout,
+                                            KERNEL_TEST_TIME, hashProofOfStake, targetProofOfStake);
+        BOOST_CHECK_EQUAL(search.CheckKernel(vCoins[i], KERNEL_TEST_TIME), fKernel);
+        BOOST_CHECK(ArithToUint256(hashProofOfStake) == GetStakeKernelHash(indexPrev.nStakeModifier, vCoins[i].nTimeBlockFrom,
+                                                                           vCoins[i].nTimeTxPrev, vCoins[i].prevout, KERNEL_TEST_TIME));
+        if (fKernel) {
+            nKernels++;
+            if (nFirstKernel < 0)
+                nFirstKernel = i;
+        }
+    }
+    BOOST_CHECK(nKernels > 0 && nKernels < vCoins.size());
+
+    // A serial search returns the first kernel in coin order
+    size_t nKernel;
+    unsigned int nTimeKernel;
+    BOOST_CHECK(search.Search(vCoins, KERNEL_TEST_TIME, 1, nKernel, nTimeKernel));
+    BOOST_CHECK_EQUAL((int)nKernel, nFirstKernel);
+    BOOST_CHECK_EQUAL(nTimeKernel, KERNEL_TEST_TIME);
+
+    // Searching a window returns a valid kernel inside the window
+    BOOST_CHECK(search.Search(vCoins, KERNEL_TEST_TIME, MAX_STAKE_SEARCH_INTERVAL, nKernel, nTimeKernel));
+    BOOST_CHECK(nTimeKernel <= KERNEL_TEST_TIME && nTimeKernel > KERNEL_TEST_TIME - MAX_STAKE_SEARCH_INTERVAL);
+    BOOST_CHECK(search.CheckKernel(vCoins[nKernel], nTimeKernel));
+
+    // Coins younger than the minimum stake age are never kernels
+    std::vector<CStakeKernelCoin> vYoung(1, CStakeKernelCoin(vCoins[nFirstKernel].prevout, KERNEL_TEST_TIME,
+                                                             vCoins[nFirstKernel].nTimeTxPrev, vCoins[nFirstKernel].nValue));
+    BOOST_CHECK(!search.Search(vYoung, KERNEL_TEST_TIME, 1, nKernel, nTimeKernel));
+}
+
+BOOST_AUTO_TEST_CASE(kernel_prepared_coins)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 100;
+    indexPrev.nTime = KERNEL_TEST_TIME;
+    indexPrev.nStakeModifier = 0x0123456789abcdefULL;
+
+    std::vector<CStakeKernelCoin> vCoins;
+    std::vector<CTransaction> vTxPrev;
+    std::vector<CBlockIndex> vBlockFrom;
+    BuildKernelCoins(vCoins, vTxPrev, vBlockFrom);
+
+    CStakeKernelSearch search(&indexPrev, KERNEL_TEST_BITS);
+    std::vector<CStakeKernelCoin> vPrepared(vCoins);
+    for (unsigned int i = 0; i < vPrepared.size(); i++) {
+        BOOST_CHECK(!search.IsPrepared(vPrepared[i]));
+        search.Prepare(vPrepared[i]);
+        BOOST_CHECK(search.IsPrepared(vPrepared[i]));
+    }
+
+    // Prepared coins give the same answers as unprepared ones at any time
+    for (unsigned int i = 0; i < vCoins.size(); i++)
+        for (unsigned int nTime = KERNEL_TEST_TIME; nTime > KERNEL_TEST_TIME - 8; nTime--)
+            BOOST_CHECK_EQUAL(search.CheckKernel(vPrepared[i], nTime), search.CheckKernel(vCoins[i], nTime));
+
+    // A new target only needs the weighted target to be rebuilt
+    CStakeKernelSearch searchBits(&indexPrev, 0x1c00ffff);
+    BOOST_CHECK(!searchBits.IsPrepared(vPrepared[0]));
+    searchBits.Prepare(vPrepared[0]);
+    BOOST_CHECK(searchBits.IsPrepared(vPrepared[0]) && !search.IsPrepared(vPrepared[0]));
+
+    // A new stake modifier changes the kernel prefix
+    CBlockIndex indexNext(indexPrev);
+    indexNext.nStakeModifier = 0xfedcba9876543210ULL;
+    CStakeKernelSearch searchModifier(&indexNext, KERNEL_TEST_BITS);
+    for (unsigned int i = 0; i < vPrepared.size(); i++) {
+        BOOST_CHECK(!searchModifier.IsPrepared(vPrepared[i]));
+        searchModifier.Prepare(vPrepared[i]);
+        BOOST_CHECK_EQUAL(searchModifier.CheckKernel(vPrepared[i], KERNEL_TEST_TIME), searchModifier.CheckKernel(vCoins[i], KERNEL_TEST_TIME));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_candidate_window)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    // A few hours of blocks with timestamps slightly out of order
+    std::vector<int64_t> vTime;
+    for (unsigned int i = 0; i < 1500; i++)
+        vTime.push_back(KERNEL_TEST_TIME + 30 * i + (int64_t)GetRand(121) - 60);
+
+    std::vector<CBlockIndex> vIndex, vIndexCopy, vIndexOther;
+    std::vector<uint256> vHash, vHashCopy, vHashOther;
+    BuildModifierChain(vIndex, vHash, vTime, true);
+    BuildModifierChain(vIndexOther, vHashOther, vTime, true);
+    // Same blocks, hence the same modifiers
+    vIndexCopy = vIndex;
+    vHashCopy = vHash;
+    for (unsigned int i = 0; i < vIndexCopy.size(); i++) {
+        vIndexCopy[i].phashBlock = &vHashCopy[i];
+        vIndexCopy[i].pprev = i ? &vIndexCopy[i - 1] : NULL;
+        vIndexCopy[i].BuildSkip();
+    }
+    vIndexCopy[0].BuildStakeModifierCheckpoint();
+
+    // Sliding the candidate window along the chain, with modifier checkpoints
+    unsigned int nGenerated = 0;
+    for (unsigned int i = 1; i < vIndex.size(); i++) {
+        uint64_t nStakeModifier;
+        bool fGenerated;
+        BOOST_CHECK(ComputeNextStakeModifier(&vIndex[i - 1], nStakeModifier, fGenerated));
+        vIndex[i].SetStakeModifier(nStakeModifier, fGenerated);
+        vIndex[i].BuildStakeModifierCheckpoint();
+        BOOST_CHECK(vIndex[i].pstakemodifier->GeneratedStakeModifier());
+        if (fGenerated)
+            nGenerated++;
+    }
+
+    // Rebuilding the window from scratch every time, as both chains take turns,
+    // and walking back to the last modifier
+    for (unsigned int i = 1; i < vIndexCopy.size(); i++) {
+        uint64_t nStakeModifier;
+        bool fGenerated;
+        BOOST_CHECK(ComputeNextStakeModifier(&vIndexOther[i - 1], nStakeModifier, fGenerated));
+        vIndexOther[i].SetStakeModifier(nStakeModifier, fGenerated);
+        BOOST_CHECK(ComputeNextStakeModifier(&vIndexCopy[i - 1], nStakeModifier, fGenerated));
+        vIndexCopy[i].SetStakeModifier(nStakeModifier, fGenerated);
+
+        BOOST_CHECK_EQUAL(vIndex[i].nStakeModifier, vIndexCopy[i].nStakeModifier);
+        BOOST_CHECK_EQUAL(vIndex[i].GeneratedStakeModifier(), vIndexCopy[i].GeneratedStakeModifier());
+    }
+    BOOST_CHECK(nGenerated > 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,71 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <mappedfile.h>
+#include <streams.h>
+#include <version.h>
+#include <test/test_navcoin.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mappedfile_tests, BasicTestingSetup)
+
+static void AppendToFile(const boost::filesystem::path& path, const CDataStream& ss)
+{
+    boost::filesystem::ofstream file(path, std::ios_base::binary | std::ios_base::app);
+    file.write(&ss[0], ss.size());
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(mappedfile_span)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    CBlock genesis = Params().GenesisBlock();
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << genesis;
+    AppendToFile(path, ssBlock);
+
+    CMappedFileCache cache(1);
+    std::shared_ptr<const CMappedFile> pfile = cache.Get(0, path, ssBlock.size());
+    BOOST_REQUIRE(pfile);
+    BOOST_CHECK_EQUAL(pfile->size(), ssBlock.size());
+
+    // A span serializes to the exact bytes it covers, block signature included
+    CMappedFileSpan span(pfile, 0, ssBlock.size());
+    CDataStream ssSpan(SER_NETWORK, PROTOCOL_VERSION);
+    ssSpan << span;
+    BOOST_CHECK(ssSpan.str() == ssBlock.str());
+
+    CBlock block;
+    CSpanReader(span.begin(), span.end(), SER_DISK, CLIENT_VERSION) >> block;
+    BOOST_CHECK(block.GetHash() == genesis.GetHash());
+    BOOST_CHECK(block.vchBlockSig == genesis.vchBlockSig);
+    BOOST_CHECK_THROW(CSpanReader(span.begin(), span.end() - 1, SER_DISK, CLIENT_VERSION) >> block, std::ios_base::failure);
+
+    // The file grew past the mapping, which gets mapped again
+    AppendToFile(path, ssBlock);
+    BOOST_CHECK(cache.Get(0, path, ssBlock.size()) == pfile);
+    std::shared_ptr<const CMappedFile> pfileGrown = cache.Get(0, path, 2 * ssBlock.size());
+    BOOST_REQUIRE(pfileGrown);
+    BOOST_CHECK(pfileGrown != pfile);
+    BOOST_CHECK_EQUAL(pfileGrown->size(), 2 * ssBlock.size());
+
+    // Evicted mappings stay valid for as long as a span holds them
+    CMappedFileSpan spanSecond(pfileGrown, ssBlock.size(), ssBlock.size());
+    pfileGrown.reset();
+    BOOST_CHECK(cache.Get(1, path, 0));
+    BOOST_CHECK(std::string(spanSecond.begin(), spanSecond.end()) == ssBlock.str());
+
+    // Files which do not exist or are too short are not mapped
+    BOOST_CHECK(!cache.Get(2, path, 3 * ssBlock.size()));
+    BOOST_CHECK(!cache.Get(3, path / "missing", 0));
+
+    boost::filesystem::remove(path);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/navcoin-config.h>
+#endif
+
 #include <test/testutil.h>
 
+#include <main.h>
+#include <random.h>
+#ifdef ENABLE_WALLET
+#include <wallet/wallet.h>
+#endif
+
 #ifdef WIN32
 #include <shlobj.h>
 #endif
@@ -31,3 +41,73 @@ boost::filesystem::path GetTempPath() {
     return path;
 #endif
 }
+
+FakeActiveChain::FakeActiveChain(int nBlocks) : vHashes(nBlocks), vIndex(nBlocks)
+{
+    LOCK(cs_main);
+    for (int i = 0; i < nBlocks; i++) {
+        vHashes[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = 1500000000 + i * 64;
+        vIndex[i].BuildSkip();
+        mapBlockIndex[vHashes[i]] = &vIndex[i];
+    }
+    chainActive.SetTip(&vIndex.back());
+}
+
+FakeActiveChain::~FakeActiveChain()
+{
+    LOCK(cs_main);
+    chainActive.SetTip(NULL);
+    for (unsigned int i = 0; i < vHashes.size(); i++)
+        mapBlockIndex.erase(vHashes[i]);
+    versionbitscache.Clear();
+}
+
+void BuildModifierChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHash, const std::vector<int64_t>& vTime, bool fMixProofOfWork)
+{
+    vIndex.resize(vTime.size());
+    vHash.resize(vTime.size());
+    for (unsigned int i = 0; i < vTime.size(); i++) {
+        vHash[i] = GetRandHash();
+        vIndex[i].phashBlock = &vHash[i];
+        vIndex[i].pprev = i ? &vIndex[i - 1] : NULL;
+        vIndex[i].nHeight = i;
+        vIndex[i].nTime = vTime[i];
+        vIndex[i].hashProof = UintToArith256(GetRandHash());
+        vIndex[i].SetStakeEntropyBit(vHash[i].GetCheapHash() & 1);
+        if (!fMixProofOfWork || i % 3)
+            vIndex[i].SetProofOfStake();
+        vIndex[i].BuildSkip();
+    }
+    vIndex[0].SetStakeModifier(0, true);
+    vIndex[0].BuildStakeModifierCheckpoint();
+}
+
+CTransaction MakeTx(const COutPoint& prevout, const CScript& scriptPubKey, CAmount nValue, const CScript& scriptChange, CAmount nChange)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vout.push_back(CTxOut(nValue, scriptPubKey));
+    if (nChange > 0)
+        tx.vout.push_back(CTxOut(nChange, scriptChange));
+    return tx;
+}
+
+#ifdef ENABLE_WALLET
+bool AddTx(CWallet& wallet, const CTransaction& tx, const CBlockIndex* pindex)
+{
+    CWalletTx wtx(&wallet, tx);
+    if (pindex) {
+        wtx.hashBlock = pindex->GetBlockHash();
+        wtx.nIndex = 1;
+    }
+    if (!wallet.AddToWallet(wtx, true, NULL))
+        return false;
+    wallet.SyncTransaction(tx, chainActive.Tip(), NULL);
+    return true;
+}
+#endif
@@ -8,8 +8,51 @@
 #ifndef NAVCOIN_TEST_TESTUTIL_H
 #define NAVCOIN_TEST_TESTUTIL_H
 
+#include <amount.h>
+#include <chain.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
+class CWallet;
+
 boost::filesystem::path GetTempPath();
 
+/**
+ * A chain of nBlocks placeholder block indexes, added to mapBlockIndex and
+ * made the active chain. Both are cleared again when it is destroyed.
+ */
+struct FakeActiveChain
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+
+    FakeActiveChain(int nBlocks);
+    ~FakeActiveChain();
+};
+
+/**
+ * Fill vIndex with a chain of block indexes with the given timestamps and
+ * random proof hashes, ready to compute stake modifiers for. Every third
+ * block is proof of work if fMixProofOfWork, and the genesis block carries
+ * the first modifier. vIndex and vHash must not be resized afterwards.
+ */
+void BuildModifierChain(std::vector<CBlockIndex>& vIndex, std::vector<uint256>& vHash, const std::vector<int64_t>& vTime, bool fMixProofOfWork);
+
+/**
+ * A transaction spending prevout to an output of nValue to scriptPubKey,
+ * plus an output of nChange to scriptChange if nChange is positive
+ */
+CTransaction MakeTx(const COutPoint& prevout, const CScript& scriptPubKey, CAmount nValue, const CScript& scriptChange = CScript(), CAmount nChange = 0);
+
+/**
+ * Add a transaction to the wallet, confirmed in pindex if given, and sync it
+ * as the wallet would. Needs the wallet to be built.
+ */
+bool AddTx(CWallet& wallet, const CTransaction& tx, const CBlockIndex* pindex);
+
 #endif // NAVCOIN_TEST_TESTUTIL_H
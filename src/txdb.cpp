@@ -7,6 +7,7 @@
 
 #include <chainparams.h>
 #include <hash.h>
+#include <memusage.h>
 #include <pow.h>
 #include <uint256.h>
 
@@ -23,6 +24,8 @@ static const char DB_PROPINDEX = 'o';
 static const char DB_PREQINDEX = 'r';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSBALANCEINDEX = 'A';
+static const char DB_ADDRESSBALANCE_BEST_BLOCK = 'E';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'q';
@@ -32,9 +35,31 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_CFUND_STATE = 'C';
+static const char DB_PREQ_PROPOSAL_INDEX = 'p';
+static const char DB_PROP_STATE_INDEX = 'P';
+static const char DB_PREQ_STATE_INDEX = 'Q';
+static const char DB_CFUND_INDEX_VERSION = 'I';
+
+//! Version of the community fund secondary indexes, bumped to rebuild them on startup
+static const int CFUND_INDEX_VERSION = 1;
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, false, 64)
 {
+    uint256 hashCFundState;
+    if (db.Read(DB_CFUND_STATE, hashCFundState)) {
+        nCFundState = UintToArith256(hashCFundState);
+    } else {
+        // Databases written before the accumulator existed need one full pass
+        CProposalMap mapProposals;
+        CPaymentRequestMap mapPaymentRequests;
+        if (GetAllProposals(mapProposals) && GetAllPaymentRequests(mapPaymentRequests)) {
+            for (auto &it: mapProposals)
+                nCFundState += GetCFundStateContribution(it.second);
+            for (auto &it: mapPaymentRequests)
+                nCFundState += GetCFundStateContribution(it.second);
+        }
+    }
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
@@ -61,6 +86,10 @@ bool CCoinsViewDB::HavePaymentRequest(const uint256 &prid) const {
     return db.Exists(make_pair(DB_PREQINDEX, prid));
 }
 
+uint256 CCoinsViewDB::GetCFundStateAccumulator() const {
+    return ArithToUint256(nCFundState);
+}
+
 uint256 CCoinsViewDB::GetBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
@@ -120,6 +149,28 @@ bool CCoinsViewDB::GetAllPaymentRequests(CPaymentRequestMap &map) {
     return true;
 }
 
+static void EraseCFundIndexes(CDBBatch& batch, const uint256& hash, const CProposal& proposal)
+{
+    batch.Erase(make_pair(DB_PROP_STATE_INDEX, make_pair(proposal.GetLastState(), hash)));
+}
+
+static void WriteCFundIndexes(CDBBatch& batch, const uint256& hash, const CProposal& proposal)
+{
+    batch.Write(make_pair(DB_PROP_STATE_INDEX, make_pair(proposal.GetLastState(), hash)), '1');
+}
+
+static void EraseCFundIndexes(CDBBatch& batch, const uint256& hash, const CPaymentRequest& prequest)
+{
+    batch.Erase(make_pair(DB_PREQ_PROPOSAL_INDEX, make_pair(prequest.proposalhash, hash)));
+    batch.Erase(make_pair(DB_PREQ_STATE_INDEX, make_pair(prequest.GetLastState(), hash)));
+}
+
+static void WriteCFundIndexes(CDBBatch& batch, const uint256& hash, const CPaymentRequest& prequest)
+{
+    batch.Write(make_pair(DB_PREQ_PROPOSAL_INDEX, make_pair(prequest.proposalhash, hash)), '1');
+    batch.Write(make_pair(DB_PREQ_STATE_INDEX, make_pair(prequest.GetLastState(), hash)), '1');
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                               CPaymentRequestMap &mapPaymentRequests, const uint256 &hashBlock) {
     CDBBatch batch(db);
@@ -138,13 +189,24 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
         mapCoins.erase(itOld);
     }
 
+    arith_uint256 nCFundStateNew = nCFundState;
+
     for (CProposalMap::iterator it = mapProposals.begin(); it != mapProposals.end();) {
         if (it->second.fDirty)
         {
-            if (it->second.IsNull())
+            CProposal proposal;
+            if (GetProposal(it->first, proposal)) {
+                nCFundStateNew -= GetCFundStateContribution(proposal);
+                EraseCFundIndexes(batch, it->first, proposal);
+            }
+            nCFundStateNew += GetCFundStateContribution(it->second);
+
+            if (it->second.IsNull()) {
                 batch.Erase(make_pair(DB_PROPINDEX, it->first));
-            else
+            } else {
                 batch.Write(make_pair(DB_PROPINDEX, it->first), it->second);
+                WriteCFundIndexes(batch, it->first, it->second);
+            }
         }
         CProposalMap::iterator itOld = it++;
         mapProposals.erase(itOld);
@@ -153,23 +215,130 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
     for (CPaymentRequestMap::iterator it = mapPaymentRequests.begin(); it != mapPaymentRequests.end();) {
         if (it->second.fDirty)
         {
-            if (it->second.IsNull())
+            CPaymentRequest prequest;
+            if (GetPaymentRequest(it->first, prequest)) {
+                nCFundStateNew -= GetCFundStateContribution(prequest);
+                EraseCFundIndexes(batch, it->first, prequest);
+            }
+            nCFundStateNew += GetCFundStateContribution(it->second);
+
+            if (it->second.IsNull()) {
                 batch.Erase(make_pair(DB_PREQINDEX, it->first));
-            else
+            } else {
                 batch.Write(make_pair(DB_PREQINDEX, it->first), it->second);
+                WriteCFundIndexes(batch, it->first, it->second);
+            }
         }
         CPaymentRequestMap::iterator itOld = it++;
         mapPaymentRequests.erase(itOld);
     }
 
+    batch.Write(DB_CFUND_STATE, ArithToUint256(nCFundStateNew));
+
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    nCFundState = nCFundStateNew;
+    return true;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, compression, maxOpenFiles), nIndexCacheUsage(0) {
+}
+
+static size_t IndexCacheEntryUsage(const std::string& strKey, const std::string& strValue)
+{
+    // Strings short enough for the small string optimization do not allocate
+    size_t nUsage = memusage::MallocUsage(sizeof(memusage::stl_tree_node<std::pair<const std::string, std::string> >));
+    if (strKey.capacity() > 15)
+        nUsage += memusage::MallocUsage(strKey.capacity() + 1);
+    if (strValue.capacity() > 15)
+        nUsage += memusage::MallocUsage(strValue.capacity() + 1);
+    return nUsage;
+}
+
+void CBlockTreeDB::WriteIndexCache(const std::string& strKey, const std::string& strValue) {
+    LOCK(cs_indexcache);
+    std::pair<std::map<std::string, std::string>::iterator, bool> ret = mapIndexCache.insert(make_pair(strKey, strValue));
+    if (!ret.second) {
+        nIndexCacheUsage -= IndexCacheEntryUsage(ret.first->first, ret.first->second);
+        ret.first->second = strValue;
+    }
+    nIndexCacheUsage += IndexCacheEntryUsage(ret.first->first, ret.first->second);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, bool compression, int maxOpenFiles) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, compression, maxOpenFiles) {
+void CBlockTreeDB::FlushIndexCache(CDBBatch& batch) {
+    AssertLockHeld(cs_indexcache);
+    for (std::map<std::string, std::string>::const_iterator it = mapIndexCache.begin(); it != mapIndexCache.end(); it++) {
+        if (it->second.empty())
+            batch.EraseSerialized(it->first);
+        else
+            batch.WriteSerialized(it->first, it->second);
+    }
+    LogPrint("coindb", "Committing %u index entries to the block tree database...\n", (unsigned int)mapIndexCache.size());
+    mapIndexCache.clear();
+    nIndexCacheUsage = 0;
+}
+
+size_t CBlockTreeDB::IndexCacheUsage() const {
+    LOCK(cs_indexcache);
+    return nIndexCacheUsage;
+}
+
+bool CBlockTreeDB::FlushIndexCache() {
+    // Hold the lock until the batch is written, so readers never miss an entry
+    LOCK(cs_indexcache);
+    if (mapIndexCache.empty())
+        return true;
+    CDBBatch batch(*this);
+    FlushIndexCache(batch);
+    return WriteBatch(batch);
+}
+
+CBlockTreeDB::CIndexIterator::CIndexIterator(const CBlockTreeDB& db, const std::string& strPrefix) : fPending(false) {
+    LOCK(db.cs_indexcache);
+    pcursor.reset(const_cast<CBlockTreeDB&>(db).NewIterator());
+    std::map<std::string, std::string>::const_iterator it = db.mapIndexCache.lower_bound(strPrefix);
+    for (; it != db.mapIndexCache.end() && it->first.compare(0, strPrefix.size(), strPrefix) == 0; it++)
+        mapPending.insert(*it);
+    itPending = mapPending.end();
+}
+
+void CBlockTreeDB::CIndexIterator::SetCurrent() {
+    // The pending entry wins over the database one with the same key, and
+    // a pending erase hides both
+    while (true) {
+        strKeyCursor = pcursor->Valid() ? pcursor->GetKeySerialized() : std::string();
+        if (itPending == mapPending.end() || (pcursor->Valid() && strKeyCursor < itPending->first)) {
+            fPending = false;
+            return;
+        }
+        fPending = true;
+        if (!itPending->second.empty())
+            return;
+        Advance();
+    }
+}
+
+void CBlockTreeDB::CIndexIterator::Advance() {
+    if (pcursor->Valid() && strKeyCursor == itPending->first)
+        pcursor->Next();
+    itPending++;
+}
+
+bool CBlockTreeDB::CIndexIterator::Valid() const {
+    return fPending || pcursor->Valid();
+}
+
+void CBlockTreeDB::CIndexIterator::Next() {
+    if (fPending)
+        Advance();
+    else
+        pcursor->Next();
+    SetCurrent();
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -192,6 +361,106 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+bool CCoinsViewDB::GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests) {
+    setPaymentRequests.clear();
+
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(make_pair(DB_PREQ_PROPOSAL_INDEX, make_pair(pid, uint256())));
+
+    while (pcursor->Valid()) {
+        std::pair<char, std::pair<uint256, uint256>> key;
+        if (pcursor->GetKey(key) && key.first == DB_PREQ_PROPOSAL_INDEX && key.second.first == pid) {
+            setPaymentRequests.insert(key.second.second);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void GetCFundStateIndex(CDBWrapper& db, char chIndex, flags nState, std::set<uint256>& setHashes)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(make_pair(chIndex, make_pair(nState, uint256())));
+
+    while (pcursor->Valid()) {
+        std::pair<char, std::pair<flags, uint256>> key;
+        if (pcursor->GetKey(key) && key.first == chIndex && key.second.first == nState) {
+            setHashes.insert(key.second.second);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+}
+
+bool CCoinsViewDB::GetProposalStateCandidates(flags nState, std::set<uint256>& setProposals) {
+    setProposals.clear();
+    GetCFundStateIndex(db, DB_PROP_STATE_INDEX, nState, setProposals);
+    return true;
+}
+
+bool CCoinsViewDB::GetPaymentRequestStateCandidates(flags nState, std::set<uint256>& setPaymentRequests) {
+    setPaymentRequests.clear();
+    GetCFundStateIndex(db, DB_PREQ_STATE_INDEX, nState, setPaymentRequests);
+    return true;
+}
+
+template<typename K>
+static void EraseCFundIndex(CDBWrapper& db, CDBBatch& batch, char chIndex)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(chIndex);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        if (pcursor->GetKey(key) && key.first == chIndex) {
+            batch.Erase(key);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+}
+
+bool CCoinsViewDB::UpgradeCFundIndexes() {
+    int nVersion = 0;
+    if (db.Read(DB_CFUND_INDEX_VERSION, nVersion) && nVersion >= CFUND_INDEX_VERSION)
+        return true;
+
+    CProposalMap mapProposals;
+    CPaymentRequestMap mapPaymentRequests;
+
+    if (!GetAllProposals(mapProposals) || !GetAllPaymentRequests(mapPaymentRequests))
+        return false;
+
+    LogPrintf("Building the community fund indexes of %u proposals and %u payment requests...\n",
+              mapProposals.size(), mapPaymentRequests.size());
+
+    CDBBatch batch(db);
+
+    // Drop whatever was indexed by a previous version before writing the new entries
+    EraseCFundIndex<std::pair<uint256, uint256>>(db, batch, DB_PREQ_PROPOSAL_INDEX);
+    EraseCFundIndex<std::pair<flags, uint256>>(db, batch, DB_PROP_STATE_INDEX);
+    EraseCFundIndex<std::pair<flags, uint256>>(db, batch, DB_PREQ_STATE_INDEX);
+
+    for (auto &it: mapProposals)
+        WriteCFundIndexes(batch, it.first, it.second);
+
+    for (auto &it: mapPaymentRequests)
+        WriteCFundIndexes(batch, it.first, it.second);
+
+    batch.Write(DB_CFUND_INDEX_VERSION, CFUND_INDEX_VERSION);
+
+    return db.WriteBatch(batch);
+}
+
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
@@ -245,18 +514,19 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    LOCK(cs_indexcache);
+    FlushIndexCache(batch);
     return WriteBatch(batch, true);
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(make_pair(DB_TXINDEX, txid), pos);
+    return ReadIndex(make_pair(DB_TXINDEX, txid), pos);
 }
 
 bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
+        WriteIndex(make_pair(DB_TXINDEX, it->first), it->second);
+    return true;
 }
 
 bool CBlockTreeDB::ReadProposalIndex(const uint256 &proposalid, CFund::CProposal &proposal) {
@@ -384,44 +654,56 @@ bool CBlockTreeDB::GetPaymentRequestIndex(std::vector<CFund::CPaymentRequest>&ve
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+    return ReadIndex(make_pair(DB_SPENTINDEX, key), value);
 }
 
 bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_SPENTINDEX, it->first));
+            EraseIndex(make_pair(DB_SPENTINDEX, it->first));
         } else {
-            batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
+            WriteIndex(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return true;
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+            EraseIndex(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
         } else {
-            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            WriteIndex(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return true;
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                           const CAddressUnspentKey *pkeyFrom, size_t nLimit, CAddressUnspentKey *pkeyNext) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CIndexIterator> pcursor(new CIndexIterator(*this, SerializeIndexKey(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)))));
+
+    if (pkeyFrom) {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, *pkeyFrom));
+    } else {
+        pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
 
-    pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    if (pkeyNext)
+        pkeyNext->SetNull();
 
+    size_t nCount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+            if (nLimit > 0 && nCount++ == nLimit) {
+                if (pkeyNext)
+                    *pkeyNext = key.second;
+                break;
+            }
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(make_pair(key.second, nValue));
@@ -438,31 +720,36 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
 }
 
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+        WriteIndex(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    return true;
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+        EraseIndex(make_pair(DB_ADDRESSINDEX, it->first));
+    return true;
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+                                    int start, int end,
+                                    const CAddressIndexKey *pkeyFrom, size_t nLimit, CAddressIndexKey *pkeyNext) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CIndexIterator> pcursor(new CIndexIterator(*this, SerializeIndexKey(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)))));
 
-    if (start > 0 && end > 0) {
+    if (pkeyFrom) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEX, *pkeyFrom));
+    } else if (start > 0 && end > 0) {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
     }
 
+    if (pkeyNext)
+        pkeyNext->SetNull();
+
+    size_t nCount = 0;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
@@ -470,6 +757,11 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            if (nLimit > 0 && nCount++ == nLimit) {
+                if (pkeyNext)
+                    *pkeyNext = key.second;
+                break;
+            }
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(make_pair(key.second, nValue));
@@ -485,15 +777,181 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalance &balance) {
+    if (!ReadIndex(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), balance))
+        balance.SetNull();
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressBalanceBestBlock(uint256 &hashBlock) {
+    return ReadIndex(DB_ADDRESSBALANCE_BEST_BLOCK, hashBlock);
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fUndo) {
+    typedef std::pair<unsigned int, uint160> CAddressId;
+
+    // The rows reach the database with any write of the block tree, while the
+    // chainstate may be flushed much later. Replaying the blocks past the
+    // chainstate must not count them twice, so only apply a block when the
+    // last block applied is its parent, or revert it when that is the block.
+    bool fCounted = false;
+    uint256 hashBest;
+    if (ReadAddressBalanceBestBlock(hashBest)) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashBest);
+        fCounted = mi != mapBlockIndex.end() && mi->second->GetAncestor(pindex->nHeight) == pindex;
+    }
+    if (fCounted != fUndo) {
+        LogPrint("addressindex", "%s: skipping block %s, %s by the address balance index\n", __func__,
+                 pindex->GetBlockHash().ToString(), fUndo ? "not counted" : "already counted");
+        return true;
+    }
+    int nHeight = pindex->nHeight;
+
+    // Sum the deltas of the block per address, counting each transaction once
+    std::map<CAddressId, CAddressBalance> mapDeltas;
+    std::set<std::pair<CAddressId, uint256> > setAddressTxs;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CAddressId id(it->first.type, it->first.hashBytes);
+        CAddressBalance& delta = mapDeltas[id];
+        delta.balance += it->second;
+        if (it->second > 0)
+            delta.received += it->second;
+        if (setAddressTxs.insert(make_pair(id, it->first.txhash)).second)
+            delta.txcount++;
+    }
+
+    for (std::map<CAddressId, CAddressBalance>::const_iterator it=mapDeltas.begin(); it!=mapDeltas.end(); it++) {
+        std::pair<char, CAddressIndexIteratorKey> key = make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(it->first.first, it->first.second));
+        CAddressBalance balance;
+        if (!ReadIndex(key, balance))
+            balance.SetNull();
+
+        if (fUndo) {
+            balance.balance -= it->second.balance;
+            balance.received -= it->second.received;
+            balance.txcount -= it->second.txcount;
+            balance.nHeight = nHeight - 1;
+        } else {
+            balance.balance += it->second.balance;
+            balance.received += it->second.received;
+            balance.txcount += it->second.txcount;
+            balance.nHeight = nHeight;
+        }
+
+        if (balance.IsNull())
+            EraseIndex(key);
+        else
+            WriteIndex(key, balance);
+    }
+
+    // Through the index cache as well, so it is written atomically with the rows
+    if (fUndo && pindex->pprev)
+        WriteIndex(DB_ADDRESSBALANCE_BEST_BLOCK, pindex->pprev->GetBlockHash());
+    else if (fUndo)
+        EraseIndex(DB_ADDRESSBALANCE_BEST_BLOCK);
+    else
+        WriteIndex(DB_ADDRESSBALANCE_BEST_BLOCK, pindex->GetBlockHash());
+    return true;
+}
+
+bool CBlockTreeDB::SyncAddressBalanceIndex(bool fEnabled, const CBlockIndex* pindexTip) {
+    bool fIndexed = false;
+    uint256 hashBest;
+    ReadFlag("addressbalanceindex", fIndexed);
+    if (fIndexed == fEnabled && (!fEnabled || ReadAddressBalanceBestBlock(hashBest)))
+        return true;
+
+    if (!FlushIndexCache())
+        return false;
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBBatch> pbatch(new CDBBatch(*this));
+    size_t nBatchSize = 0;
+
+    // Drop the entries of a previous build first
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        pbatch->Erase(key);
+        pcursor->Next();
+    }
+    pbatch->Erase(DB_ADDRESSBALANCE_BEST_BLOCK);
+
+    if (fEnabled && pindexTip) {
+        LogPrintf("Building the address balance index...\n");
+
+        // The address index is sorted by address then height, and the rows of a
+        // transaction are adjacent, so each address is summed in a single pass.
+        // Rows above the tip belong to blocks which will be connected again.
+        std::pair<char, CAddressIndexIteratorKey> keyBalance;
+        CAddressBalance balance;
+        uint256 hashLastTx;
+        size_t nAddresses = 0;
+
+        pcursor->Seek(DB_ADDRESSINDEX);
+        while (true) {
+            boost::this_thread::interruption_point();
+            std::pair<char, CAddressIndexKey> key;
+            bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+            if (!balance.IsNull() && (!fValid || key.second.type != keyBalance.second.type || key.second.hashBytes != keyBalance.second.hashBytes)) {
+                pbatch->Write(keyBalance, balance);
+                nAddresses++;
+                if (++nBatchSize >= 10000) {
+                    if (!WriteBatch(*pbatch))
+                        return false;
+                    pbatch.reset(new CDBBatch(*this));
+                    nBatchSize = 0;
+                }
+                balance.SetNull();
+            }
+            if (!fValid)
+                break;
+
+            if (key.second.blockHeight > pindexTip->nHeight) {
+                pcursor->Next();
+                continue;
+            }
+
+            CAmount nValue;
+            if (!pcursor->GetValue(nValue))
+                return error("failed to get address index value");
+
+            keyBalance = make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(key.second.type, key.second.hashBytes));
+            balance.balance += nValue;
+            if (nValue > 0)
+                balance.received += nValue;
+            if (balance.txcount == 0 || key.second.txhash != hashLastTx)
+                balance.txcount++;
+            balance.nHeight = std::max(balance.nHeight, key.second.blockHeight);
+            hashLastTx = key.second.txhash;
+
+            pcursor->Next();
+        }
+
+        pbatch->Write(DB_ADDRESSBALANCE_BEST_BLOCK, pindexTip->GetBlockHash());
+        LogPrintf("Indexed the balance of %u addresses\n", nAddresses);
+    } else if (fEnabled) {
+        LogPrintf("Building the address balance index as blocks get connected\n");
+    } else {
+        LogPrintf("Dropping the address balance index\n");
+    }
+
+    if (!WriteBatch(*pbatch))
+        return false;
+
+    return WriteFlag("addressbalanceindex", fEnabled);
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+    WriteIndex(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    return true;
 }
 
 bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CIndexIterator> pcursor(new CIndexIterator(*this, SerializeIndexKey(DB_TIMESTAMPINDEX)));
 
     pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
 
@@ -519,15 +977,14 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
 }
 
 bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
+    WriteIndex(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    return true;
 }
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+    if (!ReadIndex(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
 	return false;
 
     ltimestamp = lts.ltimestamp;
@@ -546,45 +1003,75 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+/** Number of block index entries whose hashes are computed together while loading */
+static const size_t BLOCK_INDEX_LOAD_BATCH = 256;
+
+static void InsertBlockIndexBatch(std::vector<CDiskBlockIndex>& vDiskIndex, boost::function<CBlockIndex*(const uint256&)>& insertBlockIndex)
+{
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<const CBlockHeader*> vpHeaders;
+    std::vector<uint256> vHashes;
+    vHeaders.reserve(vDiskIndex.size());
+    vpHeaders.reserve(vDiskIndex.size());
+    for (const CDiskBlockIndex& diskindex : vDiskIndex)
+        vHeaders.push_back(diskindex.GetBlockHeader());
+    for (const CBlockHeader& header : vHeaders)
+        vpHeaders.push_back(&header);
+    GetBlockHeaderHashes(vpHeaders, vHashes);
+
+    for (size_t i = 0; i < vDiskIndex.size(); i++) {
+        const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+        // Construct block index object
+        CBlockIndex* pindexNew = insertBlockIndex(vHashes[i]);
+        pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+        pindexNew->nHeight        = diskindex.nHeight;
+        pindexNew->nFile          = diskindex.nFile;
+        pindexNew->nDataPos       = diskindex.nDataPos;
+        pindexNew->nUndoPos       = diskindex.nUndoPos;
+        pindexNew->nVersion       = diskindex.nVersion;
+        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+        pindexNew->nTime          = diskindex.nTime;
+        pindexNew->nBits          = diskindex.nBits;
+        pindexNew->nNonce         = diskindex.nNonce;
+        pindexNew->nStatus        = diskindex.nStatus;
+        pindexNew->nTx            = diskindex.nTx;
+        pindexNew->nMint          = diskindex.nMint;
+        pindexNew->nCFSupply      = diskindex.nCFSupply;
+        pindexNew->vPaymentRequestVotes
+                                  = diskindex.vPaymentRequestVotes;
+        pindexNew->vProposalVotes = diskindex.vProposalVotes;
+        pindexNew->nCFLocked      = diskindex.nCFLocked;
+        pindexNew->strDZeel       = diskindex.strDZeel;
+        pindexNew->nFlags         = diskindex.nFlags;
+        pindexNew->nStakeModifier = diskindex.nStakeModifier;
+        pindexNew->prevoutStake   = diskindex.prevoutStake;
+        pindexNew->nStakeTime     = diskindex.nStakeTime;
+        pindexNew->hashProof      = diskindex.hashProof;
+    }
+
+    vDiskIndex.clear();
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load mapBlockIndex
+    // Load mapBlockIndex. The entries are read in batches, so the X13 hashes
+    // of their headers can be computed by the multi-buffer kernels.
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    vDiskIndex.reserve(BLOCK_INDEX_LOAD_BATCH);
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         std::pair<char, uint256> key;
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nMint          = diskindex.nMint;
-                pindexNew->nCFSupply      = diskindex.nCFSupply;
-                pindexNew->vPaymentRequestVotes
-                                          = diskindex.vPaymentRequestVotes;
-                pindexNew->vProposalVotes = diskindex.vProposalVotes;
-                pindexNew->nCFLocked      = diskindex.nCFLocked;
-                pindexNew->strDZeel       = diskindex.strDZeel;
-                pindexNew->nFlags         = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake   = diskindex.prevoutStake;
-                pindexNew->nStakeTime     = diskindex.nStakeTime;
-                pindexNew->hashProof      = diskindex.hashProof;
+                vDiskIndex.push_back(diskindex);
+                if (vDiskIndex.size() >= BLOCK_INDEX_LOAD_BATCH)
+                    InsertBlockIndexBatch(vDiskIndex, insertBlockIndex);
 
                 pcursor->Next();
             } else {
@@ -594,6 +1081,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
             break;
         }
     }
+    InsertBlockIndexBatch(vDiskIndex, insertBlockIndex);
 
     return true;
 }
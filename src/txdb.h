@@ -12,6 +12,7 @@
 #include <chain.h>
 #include <addressindex.h>
 #include <spentindex.h>
+#include <sync.h>
 #include <timestampindex.h>
 
 #include <functional>
@@ -21,6 +22,7 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
@@ -97,6 +99,8 @@ class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Community fund state accumulator of the entries in db
+    arith_uint256 nCFundState;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -106,12 +110,19 @@ public:
     bool HaveProposal(const uint256 &pid) const;
     bool GetPaymentRequest(const uint256 &prid, CPaymentRequest &coins) const;
     bool HavePaymentRequest(const uint256 &prid) const;
+    uint256 GetCFundStateAccumulator() const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                     CPaymentRequestMap &mapPaymentRequests, const uint256 &hashBlock);
     bool GetAllProposals(CProposalMap& map);
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
+    bool GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests);
+    bool GetProposalStateCandidates(CFund::flags nState, std::set<uint256>& setProposals);
+    bool GetPaymentRequestStateCandidates(CFund::flags nState, std::set<uint256>& setPaymentRequests);
     CCoinsViewCursor *Cursor() const;
+
+    //! Build the community fund secondary indexes if the database predates them. Needs the block index.
+    bool UpgradeCFundIndexes();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -144,7 +155,143 @@ public:
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    /**
+     * Writes to the transaction, address, spent and timestamp indexes, held in
+     * memory until the next WriteBatchSync like CCoinsViewCache holds the UTXO
+     * set, so a block costs no database write of its own. Keys and values are
+     * kept serialized, which sorts them like the database does; an empty value
+     * marks an erased key, as no index value serializes to nothing.
+     */
+    mutable CCriticalSection cs_indexcache;
+    std::map<std::string, std::string> mapIndexCache;
+    size_t nIndexCacheUsage;
+
+    void WriteIndexCache(const std::string& strKey, const std::string& strValue);
+
+    template <typename K, typename V>
+    void WriteIndex(const K& key, const V& value)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        ssValue << value;
+        WriteIndexCache(ssKey.str(), ssValue.str());
+    }
+
+    template <typename K>
+    void EraseIndex(const K& key)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        WriteIndexCache(ssKey.str(), std::string());
+    }
+
+    /** Read an index entry, looking at the pending writes before the database */
+    template <typename K, typename V>
+    bool ReadIndex(const K& key, V& value) const
+    {
+        {
+            LOCK(cs_indexcache);
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << key;
+            std::map<std::string, std::string>::const_iterator it = mapIndexCache.find(ssKey.str());
+            if (it != mapIndexCache.end()) {
+                if (it->second.empty())
+                    return false;
+                try {
+                    CDataStream ssValue(it->second.data(), it->second.data() + it->second.size(), SER_DISK, CLIENT_VERSION);
+                    ssValue >> value;
+                } catch (const std::exception&) {
+                    return false;
+                }
+                return true;
+            }
+        }
+        return Read(key, value);
+    }
+
+    /** Move the pending index writes to batch */
+    void FlushIndexCache(CDBBatch& batch);
+
+    /**
+     * Iterates over the entries of an index with keys starting with a prefix
+     * as if the pending index writes were written, without writing them, so
+     * range reads do not need cs_main and leave the cache to FlushStateToDisk.
+     * The pending writes with the prefix are copied along with the database
+     * iterator being made, so neither misses a concurrent flush.
+     */
+    class CIndexIterator
+    {
+    private:
+        boost::scoped_ptr<CDBIterator> pcursor;
+        std::map<std::string, std::string> mapPending;
+        std::map<std::string, std::string>::const_iterator itPending;
+        std::string strKeyCursor;
+        bool fPending;
+
+        void SetCurrent();
+        void Advance();
+
+    public:
+        CIndexIterator(const CBlockTreeDB& db, const std::string& strPrefix);
+
+        template <typename K>
+        void Seek(const K& key)
+        {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            ssKey << key;
+            pcursor->Seek(key);
+            itPending = mapPending.lower_bound(ssKey.str());
+            SetCurrent();
+        }
+
+        bool Valid() const;
+        void Next();
+
+        template <typename K>
+        bool GetKey(K& key)
+        {
+            if (!fPending)
+                return pcursor->GetKey(key);
+            try {
+                CDataStream ssKey(itPending->first.data(), itPending->first.data() + itPending->first.size(), SER_DISK, CLIENT_VERSION);
+                ssKey >> key;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
+
+        template <typename V>
+        bool GetValue(V& value)
+        {
+            if (!fPending)
+                return pcursor->GetValue(value);
+            try {
+                CDataStream ssValue(itPending->second.data(), itPending->second.data() + itPending->second.size(), SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
+    };
+
+    template <typename K>
+    static std::string SerializeIndexKey(const K& key)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << key;
+        return ssKey.str();
+    }
+
 public:
+    /** Memory used by the pending index writes */
+    size_t IndexCacheUsage() const;
+    /** Write the pending index writes to the database, as done at startup before an index is rebuilt */
+    bool FlushIndexCache();
+
+    /** Write the block file information and block index entries, along with the pending index writes */
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
@@ -155,13 +302,34 @@ public:
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    /**
+     * Read the unspent outputs of an address. With nLimit, at most nLimit outputs are read, from pkeyFrom
+     * on if it is passed; pkeyNext is then set to the key of the next output, or nulled when there is none.
+     */
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CAddressUnspentKey *pkeyFrom = NULL, size_t nLimit = 0, CAddressUnspentKey *pkeyNext = NULL);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    /** Read the address index rows of an address, optionally by pages (see ReadAddressUnspentIndex) */
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0,
+                          const CAddressIndexKey *pkeyFrom = NULL, size_t nLimit = 0, CAddressIndexKey *pkeyNext = NULL);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalance &balance);
+    /** The last block applied to the address balance index, written along with its rows */
+    bool ReadAddressBalanceBestBlock(uint256 &hashBlock);
+    /**
+     * Apply (or with fUndo, revert) the address index deltas of the block pindex to the address balance
+     * index. Blocks it already counts, or no longer counts, are skipped, as the index may be ahead of the
+     * chainstate when blocks get replayed after an unclean shutdown.
+     */
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, const CBlockIndex* pindex, bool fUndo);
+    /**
+     * Build the address balance index from the address index up to pindexTip, or drop it, when fEnabled
+     * changed since the last run or the index does not know which block it was last updated for
+     */
+    bool SyncAddressBalanceIndex(bool fEnabled, const CBlockIndex* pindexTip);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
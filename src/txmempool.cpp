@@ -1170,6 +1170,27 @@ bool CCoinsViewMemPool::GetAllPaymentRequests(CPaymentRequestMap& mapPaymentRequ
     return true;
 }
 
+bool CCoinsViewMemPool::GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests) {
+    if (!base->GetProposalPaymentRequests(pid, setPaymentRequests))
+        return false;
+
+    for (auto &it: mempool.mapPaymentRequest)
+        if (it.second.proposalhash == pid)
+            setPaymentRequests.insert(it.first);
+
+    return true;
+}
+
+bool CCoinsViewMemPool::GetPaymentRequestStateCandidates(flags nState, std::set<uint256>& setPaymentRequests) {
+    if (!base->GetPaymentRequestStateCandidates(nState, setPaymentRequests))
+        return false;
+
+    for (auto &it: mempool.mapPaymentRequest)
+        setPaymentRequests.insert(it.first);
+
+    return true;
+}
+
 bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
     return mempool.exists(txid) || base->HaveCoins(txid);
 }
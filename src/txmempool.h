@@ -726,6 +726,8 @@ public:
     bool GetProposal(const uint256 &txid, CProposal &proposal) const;
     bool GetPaymentRequest(const uint256 &txid, CPaymentRequest &prequest) const;
     bool GetAllPaymentRequests(CPaymentRequestMap& mapPaymentRequests);
+    bool GetProposalPaymentRequests(const uint256 &pid, std::set<uint256>& setPaymentRequests);
+    bool GetPaymentRequestStateCandidates(CFund::flags nState, std::set<uint256>& setPaymentRequests);
     bool AddProposal(const CProposal& proposal) const;
     bool AddPaymentRequest(const CPaymentRequest& prequest) const;
 };
@@ -852,6 +852,17 @@ void FileCommit(FILE *file)
 #endif
 }
 
+void DirectoryCommit(const boost::filesystem::path &dirname)
+{
+#ifndef WIN32
+    FILE* file = fopen(dirname.string().c_str(), "r");
+    if (file) {
+        fsync(fileno(file));
+        fclose(file);
+    }
+#endif
+}
+
 bool TruncateFile(FILE *file, unsigned int length) {
 #if defined(WIN32)
     return _chsize(_fileno(file), length) == 0;
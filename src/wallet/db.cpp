@@ -240,7 +240,7 @@ void CDBEnv::CheckpointLSN(const std::string& strFile)
 }
 
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), plog(NULL), activeTxn(NULL), fLogTxn(false)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -249,6 +249,22 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
         return;
 
     bool fCreate = strchr(pszMode, 'c') != nullptr;
+
+    if (walletlog.Exists(strFilename)) {
+        plog = walletlog.Open(strFilename);
+        if (!plog)
+            throw runtime_error(strprintf("CDB: Can't open wallet log %s", strFilename));
+        strFile = strFilename;
+
+        if (fCreate && !Exists(string("version"))) {
+            bool fTmp = fReadOnly;
+            fReadOnly = false;
+            WriteVersion(CLIENT_VERSION);
+            fReadOnly = fTmp;
+        }
+        return;
+    }
+
     unsigned int nFlags = DB_THREAD;
     if (fCreate)
         nFlags |= DB_CREATE;
@@ -301,9 +317,15 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (activeTxn || fLogTxn)
         return;
 
+    if (plog) {
+        // Leave it to the next writer or to the flush thread if the log was synced a moment ago
+        plog->Sync(false);
+        return;
+    }
+
     // Flush database activity from memory pool to disk log
     unsigned int nMinutes = 0;
     if (fReadOnly)
@@ -314,6 +336,15 @@ void CDB::Flush()
 
 void CDB::Close()
 {
+    if (plog) {
+        logTxn.clear();
+        fLogTxn = false;
+        if (fFlushOnClose)
+            Flush();
+        plog = nullptr;
+        walletlog.Release(strFile);
+        return;
+    }
     if (!pdb)
         return;
     if (activeTxn)
@@ -330,6 +361,73 @@ void CDB::Close()
     }
 }
 
+bool CDB::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    if (fLogTxn) {
+        int nFound = logTxn.Find(ssKey, &ssValue);
+        if (nFound >= 0)
+            return nFound == 1;
+    }
+    return plog->Read(ssKey, ssValue);
+}
+
+bool CDB::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+
+    if (fLogTxn) {
+        logTxn.Write(ssKey, ssValue);
+        return true;
+    }
+    CWalletLogBatch batch;
+    batch.Write(ssKey, ssValue);
+    return plog->Write(batch);
+}
+
+bool CDB::EraseLog(const CDataStream& ssKey)
+{
+    if (fLogTxn) {
+        logTxn.Erase(ssKey);
+        return true;
+    }
+    if (!plog->Exists(ssKey))
+        return true;
+    CWalletLogBatch batch;
+    batch.Erase(ssKey);
+    return plog->Write(batch);
+}
+
+bool CDB::ExistsLog(const CDataStream& ssKey)
+{
+    if (fLogTxn) {
+        int nFound = logTxn.Find(ssKey, NULL);
+        if (nFound >= 0)
+            return nFound == 1;
+    }
+    return plog->Exists(ssKey);
+}
+
+int CDB::ReadAtLogCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags)
+{
+    // The cursor only remembers the last key it read, so it keeps working while records are written
+    bool fFound;
+    if (fFlags == DB_SET || fFlags == DB_SET_RANGE) {
+        CWalletLogData vchKeySet(ssKey.begin(), ssKey.end());
+        fFound = plog->Seek(vchKeySet, false, pcursor->vchKey, ssKey, ssValue);
+        if (fFound && fFlags == DB_SET && pcursor->vchKey != vchKeySet)
+            fFound = false;
+    } else if (fFlags == DB_FIRST || (fFlags == DB_NEXT && !pcursor->fStarted)) {
+        fFound = plog->Seek(CWalletLogData(), false, pcursor->vchKey, ssKey, ssValue);
+    } else if (fFlags == DB_NEXT) {
+        fFound = plog->Seek(pcursor->vchKey, true, pcursor->vchKey, ssKey, ssValue);
+    } else
+        return EINVAL;
+
+    pcursor->fStarted = true;
+    return fFound ? 0 : DB_NOTFOUND;
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
@@ -355,6 +453,14 @@ bool CDBEnv::RemoveDb(const string& strFile)
 
 bool CDB::Rewrite(const string& strFile, const char* pszSkip)
 {
+    if (walletlog.Exists(strFile)) {
+        {
+            CDB db(strFile, "r+");
+            db.WriteVersion(CLIENT_VERSION);
+        }
+        return walletlog.Rewrite(strFile, pszSkip);
+    }
+
     while (true) {
         {
             LOCK(bitdb.cs_db);
@@ -382,17 +488,17 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
                             int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
                             if (ret == DB_NOTFOUND) {
-                                pcursor->close();
+                                delete pcursor;
                                 break;
                             } else if (ret != 0) {
-                                pcursor->close();
+                                delete pcursor;
                                 fSuccess = false;
                                 break;
                             }
@@ -436,6 +542,88 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
     return false;
 }
 
+bool CDB::MigrateToLog(const std::string& strFile, std::string& strError)
+{
+    int64_t nStart = GetTimeMillis();
+    boost::filesystem::path pathLog = CWalletLogEnv::GetPath(strFile);
+    boost::filesystem::path pathTmp = pathLog.string() + ".new";
+    LogPrintf("CDB::MigrateToLog: Migrating %s to %s...\n", strFile, pathLog.string());
+
+    size_t nRecords = 0;
+    {
+        CWalletLog log;
+        if (!log.Create(pathTmp)) {
+            strError = strprintf("Unable to create %s", pathTmp.string());
+            return false;
+        }
+
+        CDB db(strFile, "r");
+        CDBCursor* pcursor = db.GetCursor();
+        if (!pcursor) {
+            strError = strprintf("Unable to read %s", strFile);
+            return false;
+        }
+
+        bool fSuccess = true;
+        CWalletLogBatch batch;
+        while (fSuccess) {
+            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            int ret = db.ReadAtCursor(pcursor, ssKey, ssValue, DB_NEXT);
+            if (ret == DB_NOTFOUND)
+                break;
+            if (ret != 0) {
+                fSuccess = false;
+                break;
+            }
+            batch.Write(ssKey, ssValue);
+            nRecords++;
+            if (batch.size() >= 1000) {
+                fSuccess = log.Write(batch);
+                batch.clear();
+            }
+        }
+        delete pcursor;
+        fSuccess = fSuccess && log.Write(batch) && log.Sync(true);
+        log.Close();
+        db.Close();
+        if (!fSuccess) {
+            boost::filesystem::remove(pathTmp);
+            strError = strprintf("Unable to copy the records of %s", strFile);
+            return false;
+        }
+    }
+
+    {
+        LOCK(bitdb.cs_db);
+        bitdb.CloseDb(strFile);
+        bitdb.CheckpointLSN(strFile);
+        bitdb.mapFileUseCount.erase(strFile);
+    }
+
+    // The log is used whenever it exists, so it is put in place before the
+    // Berkeley DB file is moved: a crash in between leaves both behind,
+    // never neither
+    if (!RenameOver(pathTmp, pathLog)) {
+        boost::filesystem::remove(pathTmp);
+        strError = strprintf("Unable to rename %s to %s", pathTmp.string(), pathLog.string());
+        return false;
+    }
+    DirectoryCommit(pathLog.parent_path());
+
+    // Keep the Berkeley DB file as a backup under a name nothing opens
+    std::string strBackup = strprintf("%s.%d.bdb.bak", strFile, GetTime());
+    {
+        LOCK(bitdb.cs_db);
+        if (bitdb.dbenv->dbrename(NULL, strFile.c_str(), nullptr, strBackup.c_str(), DB_AUTO_COMMIT) != 0) {
+            LogPrintf("CDB::MigrateToLog: Unable to rename %s to %s, it is left in place but not used anymore\n", strFile, strBackup);
+            strBackup = strFile;
+        }
+    }
+
+    LogPrintf("CDB::MigrateToLog: Migrated %u records in %dms, %s kept as %s\n", nRecords, GetTimeMillis() - nStart, strFile, strBackup);
+    return true;
+}
 
 void CDBEnv::Flush(bool fShutdown)
 {
@@ -11,6 +11,7 @@
 #include <streams.h>
 #include <sync.h>
 #include <version.h>
+#include <wallet/walletlog.h>
 
 #include <map>
 #include <string>
@@ -22,6 +23,7 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
 
 extern unsigned int nWalletDBUpdated;
 
@@ -90,13 +92,41 @@ public:
 extern CDBEnv bitdb;
 
 
-/** RAII class that provides access to a Berkeley database */
+/** A cursor over the records of a CDB, in either storage engine */
+class CDBCursor
+{
+private:
+    // Disallow copies
+    CDBCursor(const CDBCursor&);
+    CDBCursor& operator=(const CDBCursor&);
+
+public:
+    Dbc* pcursor;
+    CWalletLog* plog;
+    //! Key of the last record read from the log, if any
+    CWalletLogData vchKey;
+    bool fStarted;
+
+    explicit CDBCursor(Dbc* pcursorIn) : pcursor(pcursorIn), plog(NULL), fStarted(false) {}
+    explicit CDBCursor(CWalletLog* plogIn) : pcursor(NULL), plog(plogIn), fStarted(false) {}
+    ~CDBCursor()
+    {
+        if (pcursor)
+            pcursor->close();
+    }
+};
+
+/** RAII class that provides access to a Berkeley database, or to a wallet log standing in for one */
 class CDB
 {
 protected:
     Db* pdb;
+    CWalletLog* plog;
     std::string strFile;
     DbTxn* activeTxn;
+    //! Writes of the active transaction on a wallet log, appended on commit
+    CWalletLogBatch logTxn;
+    bool fLogTxn;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -111,17 +141,35 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!ReadLog(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+            } catch (const std::exception&) {
+                return false;
+            }
+            return true;
+        }
+
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Read
@@ -149,7 +197,7 @@ protected:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -158,12 +206,16 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
-        Dbt datKey(&ssKey[0], ssKey.size());
 
         // Value
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+
+        if (plog)
+            return WriteLog(ssKey, ssValue, fOverwrite);
+
+        Dbt datKey(&ssKey[0], ssKey.size());
         Dbt datValue(&ssValue[0], ssValue.size());
 
         // Write
@@ -178,7 +230,7 @@ protected:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -187,6 +239,8 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plog)
+            return EraseLog(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Erase
@@ -200,13 +254,15 @@ protected:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plog)
+            return ExistsLog(ssKey);
         Dbt datKey(&ssKey[0], ssKey.size());
 
         // Exists
@@ -217,19 +273,29 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    /** A cursor to read the records with, which must be deleted when done */
+    CDBCursor* GetCursor()
     {
+        if (plog)
+            return new CDBCursor(plog);
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
         int ret = pdb->cursor(NULL, &pcursor, 0);
         if (ret != 0)
             return NULL;
-        return pcursor;
+        return new CDBCursor(pcursor);
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
+    /** Read at a wallet log cursor; only DB_FIRST, DB_NEXT, DB_SET and DB_SET_RANGE are supported */
+    int ReadAtLogCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags);
+
+    int ReadAtCursor(CDBCursor* pdbcursor, CDataStream& ssKey, CDataStream& ssValue, unsigned int fFlags = DB_NEXT)
     {
+        if (pdbcursor->plog)
+            return ReadAtLogCursor(pdbcursor, ssKey, ssValue, fFlags);
+        Dbc* pcursor = pdbcursor->pcursor;
+
         // Read at cursor
         Dbt datKey;
         if (fFlags == DB_SET || fFlags == DB_SET_RANGE || fFlags == DB_GET_BOTH || fFlags == DB_GET_BOTH_RANGE) {
@@ -268,6 +334,12 @@ protected:
 public:
     bool TxnBegin()
     {
+        if (plog) {
+            if (fLogTxn)
+                return false;
+            fLogTxn = true;
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -279,6 +351,15 @@ public:
 
     bool TxnCommit()
     {
+        if (plog) {
+            if (!fLogTxn)
+                return false;
+            // Transactions are rare and group records which belong together, so they are synced right away
+            bool fSuccess = plog->Write(logTxn) && plog->Sync(true);
+            logTxn.clear();
+            fLogTxn = false;
+            return fSuccess;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -288,6 +369,13 @@ public:
 
     bool TxnAbort()
     {
+        if (plog) {
+            if (!fLogTxn)
+                return false;
+            logTxn.clear();
+            fLogTxn = false;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
@@ -295,6 +383,17 @@ public:
         return (ret == 0);
     }
 
+    /**
+     * Sync the writes made so far to disk right away, rather than with the next
+     * group commit of a wallet log. Berkeley DB writes need nothing more.
+     */
+    bool Sync()
+    {
+        if (!plog || fLogTxn)
+            return true;
+        return plog->Sync(true);
+    }
+
     bool ReadVersion(int& nVersion)
     {
         nVersion = 0;
@@ -307,6 +406,8 @@ public:
     }
 
     bool static Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+    /** Copy all the records of Berkeley DB file strFile to a new wallet log, and move the file out of the way */
+    bool static MigrateToLog(const std::string& strFile, std::string& strError);
 };
 
 #endif // NAVCOIN_WALLET_DB_H
@@ -34,7 +34,6 @@
 using namespace std;
 
 int64_t nWalletUnlockTime;
-int64_t nWalletFirstStakeTime = -1;
 static CCriticalSection cs_nWalletUnlockTime;
 Navtech navtech;
 
@@ -1308,8 +1307,6 @@ UniValue getunconfirmedbalance(const UniValue &params, bool fHelp)
                 "getunconfirmedbalance\n"
                 "Returns the server's total unconfirmed balance\n");
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
     return ValueFromAmount(pwalletMain->GetUnconfirmedBalance());
 }
 
@@ -2882,14 +2879,17 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getwalletinfo", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // Taken first, as refreshing the totals may need cs_main
+    CWalletBalances balances = pwalletMain->GetBalances();
+
+    LOCK(pwalletMain->cs_wallet);
 
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("walletversion", pwalletMain->GetVersion());
-    obj.pushKV("balance",       ValueFromAmount(pwalletMain->GetBalance()));
-    obj.pushKV("coldstaking_balance",       ValueFromAmount(pwalletMain->GetColdStakingBalance()));
-    obj.pushKV("unconfirmed_balance", ValueFromAmount(pwalletMain->GetUnconfirmedBalance()));
-    obj.pushKV("immature_balance",    ValueFromAmount(pwalletMain->GetImmatureBalance()));
+    obj.pushKV("balance",       ValueFromAmount(balances.nAvailable));
+    obj.pushKV("coldstaking_balance",       ValueFromAmount(balances.nColdStaking));
+    obj.pushKV("unconfirmed_balance", ValueFromAmount(balances.nUnconfirmed));
+    obj.pushKV("immature_balance",    ValueFromAmount(balances.nImmature));
     obj.pushKV("txcount",       (int)pwalletMain->mapWallet.size());
     obj.pushKV("keypoololdest", pwalletMain->GetOldestKeyPoolTime());
     obj.pushKV("keypoolsize",   (int)pwalletMain->GetKeyPoolSize());
@@ -3180,116 +3180,48 @@ struct StakePeriodRange_T {
 
 typedef std::vector<StakePeriodRange_T> vStakePeriodRange_T;
 
-// Check if we have a Tx that can be counted in staking report
-bool IsTxCountedAsStaked(const CWalletTx* tx)
-{
-    // Make sure we have a lock
-    LOCK(cs_main);
-
-    // orphan block or immature
-    if ((!tx->GetDepthInMainChain()) || (tx->GetBlocksToMaturity() > 0) || !tx->IsInMainChain())
-        return false;
-
-    // abandoned transactions
-    if (tx->isAbandoned())
-        return false;
-
-    // transaction other than POS block
-    return tx->IsCoinStake();
-}
-
-// Get the amount for a staked tx used in staking report
-CAmount GetTxStakeAmount(const CWalletTx* tx)
-{
-    // use the cached amount if available
-    if ((tx->fCreditCached || tx->fColdStakingCreditCached) && (tx->fDebitCached || tx->fColdStakingDebitCached))
-        return tx->nCreditCached + tx->nColdStakingCreditCached - tx->nDebitCached - tx->nColdStakingDebitCached;
-    // Check for cold staking
-    else if (tx->vout[1].scriptPubKey.IsColdStaking())
-        return tx->GetCredit(pwalletMain->IsMine(tx->vout[1])) - tx->GetDebit(pwalletMain->IsMine(tx->vout[1]));
-
-    return tx->GetCredit(ISMINE_SPENDABLE) + tx->GetCredit(ISMINE_STAKABLE) - tx->GetDebit(ISMINE_SPENDABLE) - tx->GetDebit(ISMINE_STAKABLE);
-}
-
 // Gets timestamp for first stake
 // Returns -1 (Zero) if has not staked yet
 int64_t GetFirstStakeTime()
 {
-    // Check if we already know when
-    if (nWalletFirstStakeTime > 0)
-        return nWalletFirstStakeTime;
+    LOCK(pwalletMain->cs_wallet);
 
-    // Need a pointer for the tx
-    const CWalletTx* tx;
+    CStakeReward reward;
+    if (!pwalletMain->GetFirstStakeReward(reward))
+        return -1;
 
-    // scan the entire wallet transactions
-    for(auto& it: pwalletMain->wtxOrdered)
-    {
-        tx = it.second.first;
-
-        // Check if we have a useable tx
-        if (IsTxCountedAsStaked(tx)) {
-            nWalletFirstStakeTime = tx->nTime; // Save it for later use
-            return nWalletFirstStakeTime;
-        }
-    }
-
-    // Did not find the first stake
-    return nWalletFirstStakeTime;
+    return reward.nTime;
 }
 
 // **em52: Get total coins staked on given period
-// inspired from CWallet::GetStake()
+// Answered from the stake reward ledger of the wallet
 // Parameter aRange = Vector with given limit date, and result
 // return int =  Number of Wallet's elements analyzed
 int GetsStakeSubTotal(vStakePeriodRange_T& aRange)
 {
-    // Lock cs_main before we try to call GetTxStakeAmount
-    LOCK(cs_main);
-
-    int nElement = 0;
-    int64_t nAmount = 0;
-
-    const CWalletTx* pcoin;
+    LOCK(pwalletMain->cs_wallet);
 
     vStakePeriodRange_T::iterator vIt;
 
-    // scan the entire wallet transactions
-    for (map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin();
-         it != pwalletMain->mapWallet.end();
-         ++it)
+    for(vIt=aRange.begin(); vIt != aRange.end(); vIt++)
     {
-        pcoin = &(*it).second;
-
-        // Check if we have a useable tx
-        if (!IsTxCountedAsStaked(pcoin))
-            continue;
-
-        nElement++;
-
-        // Get the stake tx amount from pcoin
-        nAmount = GetTxStakeAmount(pcoin);
-
-        // scan the range
-        for(vIt=aRange.begin(); vIt != aRange.end(); vIt++)
-        {
-            if (pcoin->nTime >= vIt->Start)
+        if (! vIt->End)
+        {   // Manage Special case
+            CStakeReward reward;
+            if (pwalletMain->GetLatestStakeReward(reward))
             {
-                if (! vIt->End)
-                {   // Manage Special case
-                    vIt->Start = pcoin->nTime;
-                    vIt->Total = nAmount;
-                }
-                else if (pcoin->nTime <= vIt->End)
-                {
-                    vIt->Count++;
-                    vIt->Total += nAmount;
-                }
+                vIt->Start = reward.nTime;
+                vIt->Total = reward.nAmount;
             }
+            continue;
         }
+
+        CStakeRewardTotal total = pwalletMain->GetStakeRewards(vIt->Start, vIt->End);
+        vIt->Count = total.nCount;
+        vIt->Total = total.nAmount;
     }
 
-    return nElement;
+    return pwalletMain->GetStakeRewards(0, std::numeric_limits<int64_t>::max()).nCount;
 }
 
 // prepare range for stake report
@@ -3354,17 +3286,98 @@ vStakePeriodRange_T PrepareRangeForStakeReport()
 }
 
 
+// Largest number of periods getstakereport returns for a range
+static const int64_t MAX_STAKE_REPORT_PERIODS = 10000;
+
+// getstakereport with a range: the stake rewards from start to end, in periods of the given length
+static UniValue GetStakeReportForRange(const UniValue& params)
+{
+    int64_t nStart = params[0].get_int64();
+    int64_t nEnd = params.size() > 1 ? params[1].get_int64() : GetTime();
+    int64_t nInterval = params.size() > 2 ? params[2].get_int64() : 24 * 60 * 60;
+
+    if (nStart < 0 || nEnd < nStart)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid range, start must be positive and not after end");
+    if (nInterval <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid interval, must be positive");
+    if ((nEnd - nStart) / nInterval >= MAX_STAKE_REPORT_PERIODS)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many periods, at most %d can be reported at once", MAX_STAKE_REPORT_PERIODS));
+
+    LOCK(pwalletMain->cs_wallet);
+
+    UniValue periods(UniValue::VARR);
+    CStakeRewardTotal total;
+    for (int64_t nPeriodStart = nStart; nPeriodStart <= nEnd; nPeriodStart += nInterval)
+    {
+        // Compared as distances to nEnd, which cannot overflow as nStart is not negative
+        int64_t nPeriodEnd = nEnd - nPeriodStart < nInterval ? nEnd : nPeriodStart + (nInterval - 1);
+        CStakeRewardTotal subtotal = pwalletMain->GetStakeRewards(nPeriodStart, nPeriodEnd);
+        total += subtotal;
+
+        UniValue period(UniValue::VOBJ);
+        period.pushKV("start", nPeriodStart);
+        period.pushKV("end", nPeriodEnd);
+        period.pushKV("amount", ValueFromAmount(subtotal.nAmount));
+        period.pushKV("count", subtotal.nCount);
+        periods.push_back(period);
+
+        if (nPeriodEnd == nEnd)
+            break;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("start", nStart);
+    result.pushKV("end", nEnd);
+    result.pushKV("interval", nInterval);
+    result.pushKV("periods", periods);
+    result.pushKV("amount", ValueFromAmount(total.nAmount));
+    result.pushKV("count", total.nCount);
+
+    return result;
+}
+
 // getstakereport: return SubTotal of the staked coin in last 24H, 7 days, etc.. of all owns address
 UniValue getstakereport(const UniValue& params, bool fHelp)
 {
-    if ((params.size()>0) || (fHelp))
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() > 3)
         throw runtime_error(
-            "getstakereport\n"
-            "List last single 30 day stake subtotal and last 24h, 7, 30, 365 day subtotal.\n");
+            "getstakereport ( start end interval )\n"
+            "List last single 30 day stake subtotal and last 24h, 7, 30, 365 day subtotal.\n"
+            "When start is given, list instead the mature stake rewards from start to end, in periods of interval seconds.\n"
+            "\nArguments:\n"
+            "1. start       (numeric, optional) Start of the report, as a UNIX timestamp\n"
+            "2. end         (numeric, optional, default=now) End of the report (included), as a UNIX timestamp\n"
+            "3. interval    (numeric, optional, default=86400) Length of each period, in seconds\n"
+            "\nResult (when start is given):\n"
+            "{\n"
+            "  \"start\": n,           (numeric) Start of the report\n"
+            "  \"end\": n,             (numeric) End of the report\n"
+            "  \"interval\": n,        (numeric) Length of each period\n"
+            "  \"periods\": [          (array) The periods, in chronological order\n"
+            "    {\n"
+            "      \"start\": n,       (numeric) Start of the period\n"
+            "      \"end\": n,         (numeric) End of the period (included)\n"
+            "      \"amount\": x.xxx,  (numeric) Stake rewards in the period in " + CURRENCY_UNIT + "\n"
+            "      \"count\": n        (numeric) Number of stakes in the period\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"amount\": x.xxx,      (numeric) Stake rewards from start to end in " + CURRENCY_UNIT + "\n"
+            "  \"count\": n            (numeric) Number of stakes from start to end\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakereport", "")
+            + HelpExampleCli("getstakereport", "1546300800 1548979199 604800")
+            + HelpExampleRpc("getstakereport", "1546300800, 1548979199, 604800")
+        );
 
-    vStakePeriodRange_T aRange = PrepareRangeForStakeReport();
+    if (params.size() > 0)
+        return GetStakeReportForRange(params);
 
-    LOCK(cs_main);
+    vStakePeriodRange_T aRange = PrepareRangeForStakeReport();
 
     // get subtotal calc
     int64_t nTook = GetTimeMillis();
@@ -3489,17 +3502,12 @@ UniValue proposalvotelist(const UniValue& params, bool fHelp)
     CProposalMap mapProposals;
     CCoinsViewCache view(pcoinsTip);
 
-    if(view.GetAllProposals(mapProposals))
+    if(CFund::GetProposalsByState(view, CFund::NIL, mapProposals))
     {
         for (CProposalMap::iterator it_ = mapProposals.begin(); it_ != mapProposals.end(); it_++)
         {
-            CFund::CProposal proposal;
-
-            if (!view.GetProposal(it_->first, proposal))
-                continue;
+            const CFund::CProposal& proposal = it_->second;
 
-            if (proposal.GetLastState() != CFund::NIL)
-                continue;
             auto it = std::find_if( vAddedProposalVotes.begin(), vAddedProposalVotes.end(),
                                     [&proposal](const std::pair<std::string, bool>& element){ return element.first == proposal.hash.ToString();} );
             UniValue p(UniValue::VOBJ);
@@ -3613,20 +3621,17 @@ UniValue paymentrequestvotelist(const UniValue& params, bool fHelp)
     UniValue novotes(UniValue::VARR);
     UniValue nullvotes(UniValue::VARR);
 
+    LOCK(cs_main);
+
     CPaymentRequestMap mapPaymentRequests;
     CCoinsViewCache view(pcoinsTip);
 
-    if(view.GetAllPaymentRequests(mapPaymentRequests))
+    if(CFund::GetPaymentRequestsByState(view, CFund::NIL, mapPaymentRequests))
     {
         for (CPaymentRequestMap::iterator it_ = mapPaymentRequests.begin(); it_ != mapPaymentRequests.end(); it_++)
         {
-            CFund::CPaymentRequest prequest;
-
-            if (!view.GetPaymentRequest(it_->first, prequest))
-                continue;
+            const CFund::CPaymentRequest& prequest = it_->second;
 
-            if (prequest.GetLastState() != CFund::NIL)
-                continue;
             auto it = std::find_if( vAddedPaymentRequestVotes.begin(), vAddedPaymentRequestVotes.end(),
                                     [&prequest](const std::pair<std::string, bool>& element){ return element.first == prequest.hash.ToString();} );
             UniValue p(UniValue::VOBJ);
@@ -3760,8 +3765,40 @@ UniValue listproposals(const UniValue& params, bool fHelp)
     }
 
     CProposalMap mapProposals;
+    bool fFound;
+
+    // Filters which only depend on the state of the proposals are answered from the state index
+    if(showAll || showMine || showExpired)
+    {
+        fFound = pcoinsTip->GetAllProposals(mapProposals);
+    }
+    else
+    {
+        std::vector<flags> vStates;
+        if (showPending) {
+            vStates.push_back(CFund::NIL);
+            vStates.push_back(CFund::PENDING_VOTING_PREQ);
+            vStates.push_back(CFund::PENDING_FUNDS);
+        }
+        if (showAccepted)
+            vStates.push_back(CFund::ACCEPTED);
+        if (showRejected)
+            vStates.push_back(CFund::REJECTED);
+
+        fFound = true;
+        for (flags nState: vStates)
+        {
+            CProposalMap mapProposalsInState;
+            if (!CFund::GetProposalsByState(*pcoinsTip, nState, mapProposalsInState))
+            {
+                fFound = false;
+                break;
+            }
+            mapProposals.insert(mapProposalsInState.begin(), mapProposalsInState.end());
+        }
+    }
 
-    if(pcoinsTip->GetAllProposals(mapProposals))
+    if(fFound)
     {
         for (CProposalMap::iterator it = mapProposals.begin(); it != mapProposals.end(); it++)
         {
@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <chain.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <txmempool.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <limits>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakeable_tests, BasicTestingSetup)
+
+static void AddToMempool(CTransaction tx)
+{
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(tx.GetHash(), entry.Time(0).FromTx(tx));
+}
+
+static bool IsStakeable(const CWallet& wallet, const COutPoint& prevout)
+{
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoinsForStaking(vCoins, std::numeric_limits<unsigned int>::max());
+    for (unsigned int i = 0; i < vCoins.size(); i++)
+        if (vCoins[i].tx->GetHash() == prevout.hash && vCoins[i].i == (int)prevout.n)
+            return true;
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(stakeable_spends)
+{
+    FakeActiveChain chain(200);
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.RebuildStakeableOutputs();
+
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    BOOST_REQUIRE(wallet.AddKey(key));
+    CScript scriptOther = CScript() << ToByteVector(keyOther.GetPubKey()) << OP_CHECKSIG;
+
+    CTransaction txReceive = MakeTx(COutPoint(GetRandHash(), 0), CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG, 10 * COIN);
+    COutPoint prevout(txReceive.GetHash(), 0);
+    BOOST_REQUIRE(AddTx(wallet, txReceive, &chain.vIndex[150]));
+    BOOST_CHECK(IsStakeable(wallet, prevout));
+
+    // An unconfirmed spend holds the output back, as it does for IsSpent,
+    // whether or not it is in the mempool
+    CTransaction txSpend = MakeTx(prevout, scriptOther, 9 * COIN);
+    AddToMempool(txSpend);
+    BOOST_REQUIRE(AddTx(wallet, txSpend, NULL));
+    BOOST_CHECK(!IsStakeable(wallet, prevout));
+    BOOST_CHECK_EQUAL(mempool.Expire(1), 1);
+    BOOST_CHECK(wallet.IsSpent(prevout.hash, prevout.n));
+    BOOST_CHECK(!IsStakeable(wallet, prevout));
+
+    // Abandoning it releases the output
+    BOOST_CHECK(wallet.AbandonTransaction(txSpend.GetHash()));
+    BOOST_CHECK(!wallet.IsSpent(prevout.hash, prevout.n));
+    BOOST_CHECK(IsStakeable(wallet, prevout));
+
+    // A confirmed spend holds it back, and still does once disconnected
+    CTransaction txConfirmed = MakeTx(prevout, scriptOther, 8 * COIN);
+    BOOST_REQUIRE(AddTx(wallet, txConfirmed, &chain.vIndex[160]));
+    BOOST_CHECK(!IsStakeable(wallet, prevout));
+
+    chainActive.SetTip(&chain.vIndex[155]);
+    wallet.SyncTransaction(txConfirmed, chainActive.Tip(), NULL, false);
+    BOOST_CHECK(!IsStakeable(wallet, prevout));
+
+    // Outputs confirmed above the tip are left out until it is connected again
+    CTransaction txChange = MakeTx(COutPoint(GetRandHash(), 0), CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG, 3 * COIN);
+    BOOST_REQUIRE(AddTx(wallet, txChange, &chain.vIndex[158]));
+    BOOST_CHECK(!IsStakeable(wallet, COutPoint(txChange.GetHash(), 0)));
+
+    chainActive.SetTip(&chain.vIndex.back());
+    wallet.SyncTransaction(txConfirmed, chainActive.Tip(), NULL, true);
+    BOOST_CHECK(!IsStakeable(wallet, prevout));
+    wallet.SyncTransaction(txChange, chainActive.Tip(), NULL, true);
+    BOOST_CHECK(IsStakeable(wallet, COutPoint(txChange.GetHash(), 0)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <limits>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+static const int64_t DAY = 24 * 60 * 60;
+
+static CStakeReward MakeReward(int64_t nTime, int nHeight, CAmount nAmount)
+{
+    CStakeReward reward;
+    reward.nTime = nTime;
+    reward.nHeight = nHeight;
+    reward.nAmount = nAmount;
+    return reward;
+}
+
+BOOST_FIXTURE_TEST_SUITE(stakereward_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(stakereward_day_totals)
+{
+    FakeActiveChain chain(200);
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.RebuildStakeableOutputs();
+
+    // Rewards on both sides of day boundaries, and one which is not mature yet
+    int nMatureHeight = chain.vIndex.back().nHeight - Params().GetConsensus().nCoinbaseMaturity;
+    std::vector<CStakeReward> vRewards;
+    vRewards.push_back(MakeReward(0, 1, 1));
+    vRewards.push_back(MakeReward(10 * DAY - 1, 2, 2));
+    vRewards.push_back(MakeReward(10 * DAY, 3, 4));
+    vRewards.push_back(MakeReward(10 * DAY + 5, 4, 8));
+    vRewards.push_back(MakeReward(10 * DAY + 6, nMatureHeight + 1, 16));
+    vRewards.push_back(MakeReward(11 * DAY - 1, 5, 32));
+    vRewards.push_back(MakeReward(11 * DAY, 6, 64));
+    vRewards.push_back(MakeReward(12 * DAY + 7, 7, 128));
+    vRewards.push_back(MakeReward(14 * DAY - 1, 8, 256));
+    for (unsigned int i = 0; i < vRewards.size(); i++)
+        wallet.LoadStakeReward(GetRandHash(), vRewards[i]);
+
+    std::vector<int64_t> vTimes;
+    vTimes.push_back(0);
+    vTimes.push_back(1);
+    for (int64_t nDay = 9; nDay <= 15; nDay++) {
+        vTimes.push_back(nDay * DAY - 1);
+        vTimes.push_back(nDay * DAY);
+        vTimes.push_back(nDay * DAY + 1);
+    }
+    vTimes.push_back(10 * DAY + 5);
+    vTimes.push_back(10 * DAY + 6);
+    vTimes.push_back(12 * DAY + 7);
+    vTimes.push_back(std::numeric_limits<int64_t>::max() - 1);
+    vTimes.push_back(std::numeric_limits<int64_t>::max());
+
+    // The daily totals must give the same result as summing the rewards one by one
+    for (unsigned int i = 0; i < vTimes.size(); i++) {
+        for (unsigned int j = 0; j < vTimes.size(); j++) {
+            CStakeRewardTotal expected;
+            for (unsigned int k = 0; k < vRewards.size(); k++)
+                if (vRewards[k].nHeight <= nMatureHeight && vRewards[k].nTime >= vTimes[i] && vRewards[k].nTime <= vTimes[j])
+                    expected += vRewards[k];
+
+            CStakeRewardTotal total = wallet.GetStakeRewards(vTimes[i], vTimes[j]);
+            BOOST_CHECK_EQUAL(total.nAmount, expected.nAmount);
+            BOOST_CHECK_EQUAL(total.nCount, expected.nCount);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stakereward_revalue_and_disconnect)
+{
+    FakeActiveChain chain(200);
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.RebuildStakeableOutputs();
+
+    CKey key;
+    key.MakeNewKey(true);
+
+    CMutableTransaction coinstake;
+    coinstake.nTime = 10 * DAY;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    coinstake.vout.resize(2);
+    coinstake.vout[0] = CTxOut(0, CScript());
+    coinstake.vout[1] = CTxOut(1000 * COIN, CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG);
+    CTransaction tx(coinstake);
+
+    CWalletTx wtx(&wallet, tx);
+    wtx.hashBlock = chain.vHashes[100];
+    wtx.nIndex = 1;
+    BOOST_REQUIRE(wallet.AddToWallet(wtx, true, NULL));
+
+    // Not ours yet, as when found by a rescan before the key gets imported
+    wallet.RebuildStakeRewards();
+    CStakeRewardTotal total = wallet.GetStakeRewards(0, std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_EQUAL(total.nCount, 1);
+    BOOST_CHECK_EQUAL(total.nAmount, 0);
+
+    // Importing the key re-values the reward though its block did not change
+    BOOST_REQUIRE(wallet.AddKey(key));
+    wallet.mapWallet[tx.GetHash()].MarkDirty();
+    wallet.RebuildStakeRewards();
+    total = wallet.GetStakeRewards(0, std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_EQUAL(total.nCount, 1);
+    BOOST_CHECK_EQUAL(total.nAmount, 1000 * COIN);
+
+    // Disconnecting its block removes the reward
+    chainActive.SetTip(&chain.vIndex[99]);
+    wallet.SyncTransaction(tx, chainActive.Tip(), NULL, false);
+    total = wallet.GetStakeRewards(0, std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_EQUAL(total.nCount, 0);
+    BOOST_CHECK_EQUAL(total.nAmount, 0);
+    CStakeReward reward;
+    BOOST_CHECK(!wallet.GetLatestStakeReward(reward));
+
+    // And reconnecting it counts it again, once mature
+    chainActive.SetTip(&chain.vIndex.back());
+    wallet.SyncTransaction(tx, chainActive.Tip(), NULL, true);
+    total = wallet.GetStakeRewards(0, std::numeric_limits<int64_t>::max());
+    BOOST_CHECK_EQUAL(total.nCount, 1);
+    BOOST_CHECK_EQUAL(total.nAmount, 1000 * COIN);
+    BOOST_CHECK(wallet.GetLatestStakeReward(reward));
+    BOOST_CHECK_EQUAL(reward.nHeight, 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <chain.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(walletbalance_tests, BasicTestingSetup)
+
+static CScript GetScriptFor(const CKey& key)
+{
+    return CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+}
+
+/** Move the tip, syncing tx as disconnected or connected, or any transaction of the new block if null */
+static void SetTip(CWallet& wallet, CBlockIndex* pindex, const CTransaction* ptx = NULL, bool fConnect = true)
+{
+    chainActive.SetTip(pindex);
+    wallet.SyncTransaction(ptx ? *ptx : CTransaction(), pindex, NULL, fConnect);
+}
+
+static void CheckBalances(const CWallet& wallet, CAmount nAvailable, CAmount nImmature)
+{
+    CWalletBalances balances = wallet.GetBalances();
+    BOOST_CHECK(balances == wallet.ScanBalances());
+    BOOST_CHECK_EQUAL(balances.nAvailable, nAvailable);
+    BOOST_CHECK_EQUAL(balances.nImmature, nImmature);
+}
+
+BOOST_AUTO_TEST_CASE(walletbalance_running_totals)
+{
+    FakeActiveChain chain(300);
+    CWallet wallet;
+    LOCK2(cs_main, wallet.cs_wallet);
+    SetTip(wallet, &chain.vIndex[199]);
+
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    BOOST_REQUIRE(wallet.AddKey(key));
+    CheckBalances(wallet, 0, 0);
+
+    // Receive
+    CTransaction txReceive = MakeTx(COutPoint(GetRandHash(), 0), GetScriptFor(key), 10 * COIN);
+    BOOST_REQUIRE(AddTx(wallet, txReceive, &chain.vIndex[150]));
+    CheckBalances(wallet, 10 * COIN, 0);
+
+    // Spend it, with change, first unconfirmed and then confirmed
+    CTransaction txSpend = MakeTx(COutPoint(txReceive.GetHash(), 0), GetScriptFor(keyOther), 4 * COIN, GetScriptFor(key), 5 * COIN);
+    BOOST_REQUIRE(AddTx(wallet, txSpend, NULL));
+    CheckBalances(wallet, 0, 0);
+
+    wallet.mapWallet[txSpend.GetHash()].hashBlock = chain.vHashes[160];
+    wallet.mapWallet[txSpend.GetHash()].nIndex = 1;
+    wallet.SyncTransaction(txSpend, chainActive.Tip(), NULL);
+    CheckBalances(wallet, 5 * COIN, 0);
+
+    // Abandoning an unconfirmed spend of the change makes it available again
+    CTransaction txAbandoned = MakeTx(COutPoint(txSpend.GetHash(), 1), GetScriptFor(keyOther), 3 * COIN);
+    BOOST_REQUIRE(AddTx(wallet, txAbandoned, NULL));
+    CheckBalances(wallet, 0, 0);
+    BOOST_CHECK(wallet.AbandonTransaction(txAbandoned.GetHash()));
+    CheckBalances(wallet, 5 * COIN, 0);
+
+    // Disconnecting the spend leaves it unconfirmed, still spending what it received
+    SetTip(wallet, &chain.vIndex[155], &txSpend, false);
+    CheckBalances(wallet, 0, 0);
+    SetTip(wallet, &chain.vIndex[199], &txSpend, true);
+    CheckBalances(wallet, 5 * COIN, 0);
+
+    // Stake rewards are immature until the tip moves far enough past them
+    CMutableTransaction coinstake;
+    coinstake.vin.resize(1);
+    coinstake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    coinstake.vout.push_back(CTxOut(0, CScript()));
+    coinstake.vout.push_back(CTxOut(20 * COIN, GetScriptFor(key)));
+    CTransaction txStake(coinstake);
+    BOOST_REQUIRE(AddTx(wallet, txStake, &chain.vIndex[190]));
+    CheckBalances(wallet, 5 * COIN, 20 * COIN);
+
+    SetTip(wallet, &chain.vIndex[299]);
+    CheckBalances(wallet, 25 * COIN, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
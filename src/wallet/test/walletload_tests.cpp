@@ -0,0 +1,173 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/walletdb.h>
+
+#include <clientversion.h>
+#include <hash.h>
+#include <key.h>
+#include <random.h>
+#include <util.h>
+#include <wallet/wallet.h>
+#include <wallet/walletlog.h>
+#include <test/test_navcoin.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(walletload_tests, TestingSetup)
+
+/** Records of a wallet log, valid unless made corrupt on purpose */
+struct WalletLoadRecords
+{
+    CWalletLogBatch batch;
+    std::vector<CPubKey> vKeys;
+    std::vector<uint256> vTxs;
+
+    void AddKey(bool fCorrupt)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pubkey = key.GetPubKey();
+        CPrivKey privkey = key.GetPrivKey();
+        std::vector<unsigned char> vchKey(pubkey.begin(), pubkey.end());
+        vchKey.insert(vchKey.end(), privkey.begin(), privkey.end());
+
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssKey << std::make_pair(std::string("key"), pubkey);
+        ssValue << std::make_pair(privkey, fCorrupt ? GetRandHash() : Hash(vchKey.begin(), vchKey.end()));
+        batch.Write(ssKey, ssValue);
+        if (!fCorrupt)
+            vKeys.push_back(pubkey);
+    }
+
+    void AddTx(bool fCorrupt)
+    {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        mtx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+        CWalletTx wtx(NULL, CTransaction(mtx));
+
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssKey << std::make_pair(std::string("tx"), wtx.GetHash());
+        if (fCorrupt)
+            ssValue << std::string("not a transaction");
+        else
+            ssValue << wtx;
+        batch.Write(ssKey, ssValue);
+        if (!fCorrupt)
+            vTxs.push_back(wtx.GetHash());
+    }
+};
+
+/** Write records to a new wallet log and load it, checking the valid records made it */
+static DBErrors WriteAndLoad(const std::string& strFile, const WalletLoadRecords& records)
+{
+    BOOST_REQUIRE(walletlog.Create(strFile));
+    CWalletLog* plog = walletlog.Open(strFile);
+    BOOST_REQUIRE(plog);
+    BOOST_CHECK(plog->Write(records.batch));
+    walletlog.Release(strFile);
+
+    DBErrors ret;
+    {
+        CWallet wallet(strFile);
+        ret = CWalletDB(strFile, "cr+").LoadWallet(&wallet);
+
+        LOCK(wallet.cs_wallet);
+        for (unsigned int i = 0; i < records.vKeys.size(); i++)
+            BOOST_CHECK(wallet.HaveKey(records.vKeys[i].GetID()));
+        for (unsigned int i = 0; i < records.vTxs.size(); i++)
+            BOOST_CHECK(wallet.mapWallet.count(records.vTxs[i]));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), records.vTxs.size());
+    }
+    walletlog.Flush(true);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(walletload_corrupt_records)
+{
+    // More keys than fit in a window, so the records are parsed by the workers over several windows
+    BOOST_REQUIRE(nScriptCheckThreads > 1);
+    WalletLoadRecords records;
+    for (unsigned int i = 0; i < WALLET_LOAD_WINDOW_RECORDS + WALLET_LOAD_WINDOW_RECORDS / 2; i++)
+        records.AddKey(false);
+    for (int i = 0; i < 10; i++)
+        records.AddTx(false);
+
+    // A corrupt transaction is skipped, and asks for a rescan
+    records.AddTx(true);
+    BOOST_CHECK_EQUAL(WriteAndLoad("walletload_tx.dat", records), DB_NONCRITICAL_ERROR);
+    BOOST_CHECK(GetBoolArg("-rescan", false));
+    mapArgs.erase("-rescan");
+
+    // A corrupt key fails the load, still loading everything else
+    records.AddKey(true);
+    BOOST_CHECK_EQUAL(WriteAndLoad("walletload_key.dat", records), DB_CORRUPT);
+}
+
+BOOST_AUTO_TEST_CASE(walletload_migrate_to_log)
+{
+    const std::string strFile = "walletmigrate.dat";
+    std::vector<CPubKey> vKeys;
+    std::vector<uint256> vTxs;
+    {
+        CWalletDB walletdb(strFile, "cr+");
+        for (int i = 0; i < 10; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            BOOST_CHECK(walletdb.WriteKey(key.GetPubKey(), key.GetPrivKey(), CKeyMetadata(GetTime())));
+            vKeys.push_back(key.GetPubKey());
+        }
+        for (int i = 0; i < 5; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.resize(1);
+            mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+            mtx.vout.push_back(CTxOut(COIN, CScript() << OP_TRUE));
+            CWalletTx wtx(NULL, CTransaction(mtx));
+            BOOST_CHECK(walletdb.WriteTx(wtx));
+            vTxs.push_back(wtx.GetHash());
+        }
+    }
+    BOOST_REQUIRE(!walletlog.Exists(strFile));
+
+    std::string strError;
+    BOOST_REQUIRE(CDB::MigrateToLog(strFile, strError));
+    BOOST_CHECK(walletlog.Exists(strFile));
+    BOOST_CHECK(!boost::filesystem::exists(CWalletLogEnv::GetPath(strFile).string() + ".new"));
+
+    // The Berkeley DB file is kept aside as a backup
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / strFile));
+    unsigned int nBackups = 0;
+    for (boost::filesystem::directory_iterator it(GetDataDir()); it != boost::filesystem::directory_iterator(); ++it) {
+        std::string strName = it->path().filename().string();
+        if (strName.compare(0, strFile.size() + 1, strFile + ".") == 0 && strName.size() > 8 && strName.compare(strName.size() - 8, 8, ".bdb.bak") == 0)
+            nBackups++;
+    }
+    BOOST_CHECK_EQUAL(nBackups, 1U);
+
+    // Loading through CWalletDB now reads the log, with every record migrated
+    {
+        CWallet wallet(strFile);
+        BOOST_CHECK_EQUAL(CWalletDB(strFile, "cr+").LoadWallet(&wallet), DB_LOAD_OK);
+
+        LOCK(wallet.cs_wallet);
+        for (unsigned int i = 0; i < vKeys.size(); i++)
+            BOOST_CHECK(wallet.HaveKey(vKeys[i].GetID()));
+        for (unsigned int i = 0; i < vTxs.size(); i++)
+            BOOST_CHECK(wallet.mapWallet.count(vTxs[i]));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), vTxs.size());
+    }
+    walletlog.Flush(true);
+    bitdb.Flush(true);
+    bitdb.Reset();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,236 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/walletlog.h>
+
+#include <clientversion.h>
+#include <random.h>
+#include <util.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(walletlog_tests, BasicTestingSetup)
+
+static CDataStream MakeKey(const std::string& strType, int n)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << std::make_pair(strType, n);
+    return ss;
+}
+
+static CDataStream MakeValue(const std::string& str)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << str;
+    return ss;
+}
+
+static void WriteRecord(CWalletLog& log, const std::string& strType, int n, const std::string& strValue)
+{
+    CWalletLogBatch batch;
+    batch.Write(MakeKey(strType, n), MakeValue(strValue));
+    BOOST_CHECK(log.Write(batch));
+}
+
+/** Overwrite the bytes of the file at path from nOffset */
+static void PatchFile(const boost::filesystem::path& path, uint64_t nOffset, const std::vector<unsigned char>& vch)
+{
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, nOffset, SEEK_SET);
+    BOOST_CHECK_EQUAL(fwrite(&vch[0], 1, vch.size(), file), vch.size());
+    fclose(file);
+}
+
+static boost::filesystem::path GetDroppedPath(const boost::filesystem::path& path)
+{
+    return path.string() + ".dropped";
+}
+
+static std::string ReadValue(const CWalletLog& log, const CDataStream& ssKey)
+{
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    std::string str;
+    if (log.Read(ssKey, ssValue))
+        ssValue >> str;
+    return str;
+}
+
+BOOST_AUTO_TEST_CASE(walletlog_roundtrip)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_walletlog_%s.wlog", GetRandHash().ToString());
+    std::string strError;
+
+    {
+        CWalletLog log;
+        BOOST_REQUIRE(log.Create(path));
+
+        CWalletLogBatch batch;
+        for (int i = 0; i < 10; i++)
+            batch.Write(MakeKey("tx", i), MakeValue(strprintf("tx%d", i)));
+        BOOST_CHECK(log.Write(batch));
+
+        batch.clear();
+        batch.Write(MakeKey("tx", 3), MakeValue("overwritten"));
+        batch.Erase(MakeKey("tx", 4));
+        BOOST_CHECK(batch.Find(MakeKey("tx", 4), NULL) == 0);
+        BOOST_CHECK(batch.Find(MakeKey("tx", 5), NULL) == -1);
+        BOOST_CHECK(log.Write(batch));
+        BOOST_CHECK(log.Sync(true));
+    }
+
+    CWalletLog log;
+    BOOST_REQUIRE(log.Load(path, strError));
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 9U);
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("tx", 0)), "tx0");
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("tx", 3)), "overwritten");
+    BOOST_CHECK(!log.Exists(MakeKey("tx", 4)));
+
+    // Records are visited in key order, like a Berkeley DB cursor would
+    CWalletLogData vchKey;
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION);
+    int nCount = 0;
+    bool fFound = log.Seek(CWalletLogData(), false, vchKey, ssKey, ssValue);
+    while (fFound) {
+        std::pair<std::string, int> key;
+        ssKey >> key;
+        BOOST_CHECK_EQUAL(key.first, "tx");
+        nCount++;
+        fFound = log.Seek(vchKey, true, vchKey, ssKey, ssValue);
+    }
+    BOOST_CHECK_EQUAL(nCount, 9);
+
+    // Compaction keeps the live records only, and skips those asked for
+    uint64_t nSize = log.GetFileSize();
+    BOOST_CHECK(log.Compact("\x02tx"));
+    BOOST_CHECK(log.GetFileSize() < nSize);
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 0U);
+    log.Close();
+
+    BOOST_REQUIRE(log.Load(path, strError));
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 0U);
+    log.Close();
+
+    boost::filesystem::remove(path);
+}
+
+BOOST_AUTO_TEST_CASE(walletlog_torn_write)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_walletlog_%s.wlog", GetRandHash().ToString());
+    std::string strError;
+    uint64_t nSize;
+
+    {
+        CWalletLog log;
+        BOOST_REQUIRE(log.Create(path));
+        CWalletLogBatch batch;
+        batch.Write(MakeKey("key", 1), MakeValue("first"));
+        BOOST_CHECK(log.Write(batch));
+        nSize = log.GetFileSize();
+
+        batch.clear();
+        batch.Write(MakeKey("key", 2), MakeValue("second"));
+        batch.Write(MakeKey("key", 3), MakeValue("third"));
+        BOOST_CHECK(log.Write(batch));
+    }
+
+    // Cut the last frame short, as a crash while appending would
+    uint64_t nTornSize = boost::filesystem::file_size(path) - 3;
+    boost::filesystem::resize_file(path, nTornSize);
+
+    CWalletLog log;
+    BOOST_REQUIRE(log.Load(path, strError));
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 1U);
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("key", 1)), "first");
+    BOOST_CHECK_EQUAL(log.GetFileSize(), nSize);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+
+    // The dropped bytes are kept aside rather than lost
+    BOOST_CHECK(boost::filesystem::exists(GetDroppedPath(path)));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(GetDroppedPath(path)), nTornSize - nSize);
+
+    // Appending carries on after the last complete frame
+    CWalletLogBatch batch;
+    batch.Write(MakeKey("key", 2), MakeValue("again"));
+    BOOST_CHECK(log.Write(batch));
+    log.Close();
+
+    BOOST_REQUIRE(log.Load(path, strError));
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("key", 2)), "again");
+
+    // A damaged frame followed by others is not mistaken for a torn write
+    log.Close();
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, nSize - 1, SEEK_SET);
+        int ch = fgetc(file);
+        fseek(file, nSize - 1, SEEK_SET);
+        fputc(ch ^ 0xff, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!log.Load(path, strError));
+
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(GetDroppedPath(path));
+}
+
+BOOST_AUTO_TEST_CASE(walletlog_corrupt_length)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_walletlog_%s.wlog", GetRandHash().ToString());
+    std::string strError;
+    uint64_t nFirst, nSecond, nSize;
+
+    {
+        CWalletLog log;
+        BOOST_REQUIRE(log.Create(path));
+        WriteRecord(log, "key", 1, "first");
+        nFirst = log.GetFileSize();
+        WriteRecord(log, "key", 2, "second");
+        nSecond = log.GetFileSize();
+        WriteRecord(log, "key", 3, "third");
+        nSize = log.GetFileSize();
+    }
+
+    // A size field in the middle of the log pointing past its end is not
+    // mistaken for a torn write, and nothing is cut off
+    std::vector<unsigned char> vchSize(4, 0xff);
+    PatchFile(path, nFirst + 4, vchSize);
+
+    CWalletLog log;
+    BOOST_CHECK(!log.Load(path, strError));
+    BOOST_CHECK(strError.find("corrupt") != std::string::npos);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+    BOOST_CHECK(!boost::filesystem::exists(GetDroppedPath(path)));
+
+    // Neither is a frame zeroed by a lost page
+    PatchFile(path, nFirst, std::vector<unsigned char>(nSecond - nFirst, 0));
+    BOOST_CHECK(!log.Load(path, strError));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nSize);
+
+    // A salvage keeps the frames around it, and the damaged one aside
+    BOOST_REQUIRE(log.Load(path, strError, true));
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 2U);
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("key", 1)), "first");
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("key", 3)), "third");
+    BOOST_CHECK(!log.Exists(MakeKey("key", 2)));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(GetDroppedPath(path)), nSecond - nFirst);
+    log.Close();
+
+    // The salvaged log was rewritten without the damaged frame
+    BOOST_REQUIRE(log.Load(path, strError));
+    BOOST_CHECK_EQUAL(log.GetRecordCount(), 2U);
+    BOOST_CHECK_EQUAL(ReadValue(log, MakeKey("key", 3)), "third");
+    log.Close();
+
+    boost::filesystem::remove(path);
+    boost::filesystem::remove(GetDroppedPath(path));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
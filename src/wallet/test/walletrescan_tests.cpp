@@ -0,0 +1,194 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <addressindex.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <key.h>
+#include <main.h>
+#include <random.h>
+#include <txdb.h>
+#include <util.h>
+#include <test/test_navcoin.h>
+#include <test/testutil.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(walletrescan_tests, TestingSetup)
+
+/**
+ * A chain of blocks written to a block file of their own, with the given
+ * transactions after a coinbase, made the active chain while it exists
+ */
+struct RescanChain
+{
+    std::vector<CBlock> vBlocks;
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    CBlockIndex* pindexTipOld;
+
+    RescanChain(const std::vector<std::vector<CTransaction> >& vTxs, const CScript& scriptCoinbase)
+        : vBlocks(vTxs.size()), vHashes(vTxs.size()), vIndex(vTxs.size())
+    {
+        LOCK(cs_main);
+        pindexTipOld = chainActive.Tip();
+        unsigned int nPos = 0;
+        int64_t nTime = GetTime();
+        for (unsigned int i = 0; i < vTxs.size(); i++) {
+            CMutableTransaction txCoinbase;
+            txCoinbase.vin.resize(1);
+            txCoinbase.vin[0].prevout.SetNull();
+            txCoinbase.vin[0].scriptSig = CScript() << (int64_t)i << OP_0;
+            txCoinbase.vout.push_back(CTxOut(1 * COIN, scriptCoinbase));
+
+            CBlock& block = vBlocks[i];
+            block.hashPrevBlock = i > 0 ? vHashes[i - 1] : uint256();
+            block.nTime = nTime + i;
+            block.vtx.push_back(txCoinbase);
+            block.vtx.insert(block.vtx.end(), vTxs[i].begin(), vTxs[i].end());
+            vHashes[i] = block.GetHash();
+
+            CDiskBlockPos pos(1, nPos);
+            BOOST_REQUIRE(WriteBlockToDisk(block, pos, Params().MessageStart()));
+            nPos = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+
+            vIndex[i].phashBlock = &vHashes[i];
+            vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : NULL;
+            vIndex[i].nHeight = i;
+            vIndex[i].nTime = block.nTime;
+            vIndex[i].nFile = pos.nFile;
+            vIndex[i].nDataPos = pos.nPos;
+            vIndex[i].nStatus = BLOCK_HAVE_DATA;
+            vIndex[i].BuildSkip();
+            mapBlockIndex[vHashes[i]] = &vIndex[i];
+        }
+        chainActive.SetTip(&vIndex.back());
+    }
+
+    ~RescanChain()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTipOld);
+        for (unsigned int i = 0; i < vHashes.size(); i++)
+            mapBlockIndex.erase(vHashes[i]);
+    }
+};
+
+/** Where the transactions of a wallet were found, by hash */
+static std::map<uint256, std::pair<uint256, int> > GetWalletTxs(const CWallet& wallet)
+{
+    LOCK(wallet.cs_wallet);
+    std::map<uint256, std::pair<uint256, int> > mapTxs;
+    for (std::map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end(); ++it)
+        mapTxs[it->first] = std::make_pair(it->second.hashBlock, it->second.nIndex);
+    return mapTxs;
+}
+
+/** A wallet with key, and with the unconfirmed transaction txPending it made before the rescan */
+static void SetupWallet(CWallet& wallet, const CKey& key, const CTransaction& txPending)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    BOOST_REQUIRE(wallet.AddKey(key));
+    BOOST_REQUIRE(AddTx(wallet, txPending, NULL));
+}
+
+/** Scan the active chain the way ScanForWalletTransactions did before reading it in windows */
+static void ScanSerially(CWallet& wallet, CBlockIndex* pindexStart)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+    for (CBlockIndex* pindex = pindexStart; pindex; pindex = chainActive.Next(pindex)) {
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            wallet.AddToWalletIfInvolvingMe(block.vtx[i], &block, true);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(walletrescan_windows)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+    CScript scriptMine = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CScript scriptOther = CScript() << ToByteVector(keyOther.GetPubKey()) << OP_CHECKSIG;
+
+    // Spread over three windows of blocks
+    std::vector<std::vector<CTransaction> > vTxs(2 * RESCAN_WINDOW_BLOCKS + 50);
+    for (unsigned int i = 0; i < vTxs.size(); i += 7)
+        vTxs[i].push_back(MakeTx(COutPoint(GetRandHash(), 0), scriptOther, 1 * COIN));
+    CTransaction txReceive1 = MakeTx(COutPoint(GetRandHash(), 0), scriptMine, 10 * COIN);
+    vTxs[10].push_back(txReceive1);
+    CTransaction txReceive2 = MakeTx(COutPoint(GetRandHash(), 0), scriptMine, 5 * COIN);
+    vTxs[RESCAN_WINDOW_BLOCKS + 2].push_back(txReceive2);
+    // A spend of an output found earlier in the same window, and one found in an earlier window,
+    // neither of them paying the wallet
+    CTransaction txSpend2 = MakeTx(COutPoint(txReceive2.GetHash(), 0), scriptOther, 4 * COIN);
+    vTxs[RESCAN_WINDOW_BLOCKS + 12].push_back(txSpend2);
+    CTransaction txSpend1 = MakeTx(COutPoint(txReceive1.GetHash(), 0), scriptOther, 9 * COIN);
+    vTxs[RESCAN_WINDOW_BLOCKS + 70].push_back(txSpend1);
+    // A transaction unknown to the wallet that conflicts with the pending one through mapTxSpends
+    COutPoint prevoutPending(GetRandHash(), 0);
+    CTransaction txPending = MakeTx(prevoutPending, scriptOther, 2 * COIN);
+    CTransaction txConflict = MakeTx(prevoutPending, scriptOther, 2 * COIN, scriptOther, 1);
+    vTxs[2 * RESCAN_WINDOW_BLOCKS + 10].push_back(txConflict);
+    CTransaction txReceive3 = MakeTx(COutPoint(GetRandHash(), 0), scriptMine, 3 * COIN);
+    vTxs[2 * RESCAN_WINDOW_BLOCKS + 20].push_back(txReceive3);
+
+    RescanChain chain(vTxs, scriptOther);
+    CBlockIndex* pindexStart = &chain.vIndex[0];
+
+    CWallet walletSerial;
+    SetupWallet(walletSerial, key, txPending);
+    ScanSerially(walletSerial, pindexStart);
+    std::map<uint256, std::pair<uint256, int> > mapSerial = GetWalletTxs(walletSerial);
+    BOOST_CHECK_EQUAL(mapSerial.size(), 6U);
+    BOOST_CHECK(mapSerial[txSpend2.GetHash()].first == chain.vHashes[RESCAN_WINDOW_BLOCKS + 12]);
+    BOOST_CHECK(mapSerial[txPending.GetHash()].first == chain.vHashes[2 * RESCAN_WINDOW_BLOCKS + 10]);
+    BOOST_CHECK_EQUAL(mapSerial[txPending.GetHash()].second, -1);
+    BOOST_CHECK(!mapSerial.count(txConflict.GetHash()));
+
+    // With and without the rescan workers
+    int nScriptCheckThreadsOld = nScriptCheckThreads;
+    for (int nThreads = 0; nThreads <= 3; nThreads += 3) {
+        nScriptCheckThreads = nThreads;
+        CWallet wallet;
+        SetupWallet(wallet, key, txPending);
+        wallet.ScanForWalletTransactions(pindexStart, true);
+        BOOST_CHECK(GetWalletTxs(wallet) == mapSerial);
+    }
+
+    // With the address index, only the blocks it lists for the wallet's keys
+    // are read. It lists all the blocks above but the one of txReceive3,
+    // which is then skipped.
+    fAddressIndex = true;
+    mapArgs["-rescanaddressindex"] = "1";
+    uint160 hashMine = key.GetPubKey().GetID();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRows;
+    vRows.push_back(std::make_pair(CAddressIndexKey(1, hashMine, 10, 1, txReceive1.GetHash(), 0, false), 10 * COIN));
+    vRows.push_back(std::make_pair(CAddressIndexKey(1, hashMine, RESCAN_WINDOW_BLOCKS + 2, 1, txReceive2.GetHash(), 0, false), 5 * COIN));
+    vRows.push_back(std::make_pair(CAddressIndexKey(1, hashMine, RESCAN_WINDOW_BLOCKS + 12, 1, txSpend2.GetHash(), 0, true), -5 * COIN));
+    vRows.push_back(std::make_pair(CAddressIndexKey(1, hashMine, RESCAN_WINDOW_BLOCKS + 70, 1, txSpend1.GetHash(), 0, true), -10 * COIN));
+    vRows.push_back(std::make_pair(CAddressIndexKey(1, hashMine, 2 * RESCAN_WINDOW_BLOCKS + 10, 1, txConflict.GetHash(), 0, true), -2 * COIN));
+    BOOST_REQUIRE(pblocktree->WriteAddressIndex(vRows));
+
+    CWallet walletIndexed;
+    SetupWallet(walletIndexed, key, txPending);
+    walletIndexed.ScanForWalletTransactions(pindexStart, true);
+    std::map<uint256, std::pair<uint256, int> > mapIndexed = GetWalletTxs(walletIndexed);
+    BOOST_CHECK(!mapIndexed.count(txReceive3.GetHash()));
+    mapSerial.erase(txReceive3.GetHash());
+    BOOST_CHECK(mapIndexed == mapSerial);
+
+    mapArgs.erase("-rescanaddressindex");
+    fAddressIndex = false;
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include <base58.h>
 #include <checkpoints.h>
 #include <chain.h>
+#include <checkqueue.h>
 #include <coincontrol.h>
 #include <consensus/cfund.h>
 #include <consensus/consensus.h>
@@ -35,6 +36,7 @@
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -45,6 +47,7 @@ CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fSendFreeTransactions = DEFAULT_SEND_FREE_TRANSACTIONS;
+bool fCheckWalletBalances = false;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
@@ -176,28 +179,12 @@ CPubKey CWallet::GenerateNewKey()
 // ppcoin: total coins staked (non-spendable until maturity)
 int64_t CWallet::GetStake() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin,ISMINE_SPENDABLE);
-    }
-    return nTotal;
+    return GetBalances().nStake;
 }
 
 int64_t CWallet::GetNewMint() const
 {
-    int64_t nTotal = 0;
-    LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-    {
-        const CWalletTx* pcoin = &(*it).second;
-        if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
-            nTotal += CWallet::GetCredit(*pcoin,ISMINE_SPENDABLE);
-    }
-    return nTotal;
+    return GetBalances().nNewMint;
 }
 
 uint64_t CWallet::GetStakeWeight() const
@@ -244,34 +231,35 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
     nMinimumInputValue = GetArg("-mininputvalue", 1 * COIN);
 
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        LOCK(cs_wallet);
+        // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
+        std::set<std::pair<int64_t, COutPoint> >::const_iterator it = setStakeableByTime.begin();
+        for (; it != setStakeableByTime.end() && it->first <= (int64_t)nSpendTime; ++it)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            const uint256& wtxid = it->first;
+            const COutPoint& prevout = it->second;
+            const CStakeableOutput& output = mapStakeableOutputs.at(prevout);
 
-            // Filtering by tx timestamp instead of block timestamp may give false positives but never false negatives
-            if (pcoin->nTime + Params().GetConsensus().nStakeMinAge > nSpendTime)
+            if (output.nHeightMature > nStakeTipHeight)
                 continue;
 
-            if (pcoin->GetBlocksToMaturity() > 0)
+            map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(prevout.hash);
+            if (mi == mapWallet.end())
                 continue;
 
-            if (pcoin->isAbandoned())
+            const CWalletTx* pcoin = &(*mi).second;
+            const CTxOut& txout = pcoin->vout[prevout.n];
+            if (txout.nValue < nMinimumInputValue)
                 continue;
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < 1)
+            isminetype mine = IsMine(txout);
+            if (mine == ISMINE_NO)
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-                if (!(IsSpent(wtxid,i)) && IsMine(pcoin->vout[i]) && pcoin->vout[i].nValue >= nMinimumInputValue){
-                    vCoins.push_back(COutput(pcoin, i, nDepth, true,
-                                           ((IsMine(pcoin->vout[i]) & (ISMINE_SPENDABLE)) != ISMINE_NO &&
-                                           !pcoin->vout[i].scriptPubKey.IsColdStaking()) ||
-                                           ((IsMine(pcoin->vout[i]) & (ISMINE_STAKABLE)) != ISMINE_NO &&
-                                           IsColdStakingEnabled(chainActive.Tip(), Params().GetConsensus()))));
-                }
+            vCoins.push_back(COutput(pcoin, prevout.n, nStakeTipHeight - output.nHeight + 1, true,
+                                     ((mine & (ISMINE_SPENDABLE)) != ISMINE_NO &&
+                                     !txout.scriptPubKey.IsColdStaking()) ||
+                                     ((mine & (ISMINE_STAKABLE)) != ISMINE_NO &&
+                                     fStakeTipColdStaking)));
         }
     }
 
@@ -280,6 +268,302 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
     }
 }
 
+void CWallet::UpdateStakeTip(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (pindex == pindexStakeTip)
+        return;
+
+    pindexStakeTip = pindex;
+    nStakeTipHeight = pindex ? pindex->nHeight : -1;
+    fStakeTipColdStaking = pindex && IsColdStakingEnabled(pindex, Params().GetConsensus());
+}
+
+void CWallet::UpdateBalanceTip(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (pindex == pindexBalanceTip)
+        return;
+
+    // Confirmations, maturity and conflicts are relative to the tip
+    pindexBalanceTip = pindex;
+    setBalanceDirty.insert(setBalanceTipDependent.begin(), setBalanceTipDependent.end());
+}
+
+void CWallet::UpdateStakeableOutputs(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::map<COutPoint, CStakeableOutput>::iterator it = mapStakeableOutputs.lower_bound(COutPoint(hash, 0));
+    while (it != mapStakeableOutputs.end() && it->first.hash == hash)
+    {
+        setStakeableByTime.erase(make_pair(it->second.nTimeMature, it->first));
+        mapStakeableOutputs.erase(it++);
+    }
+
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+    if (mi == mapWallet.end())
+        return;
+
+    const CWalletTx& wtx = (*mi).second;
+    if (wtx.isAbandoned())
+        return;
+
+    const CBlockIndex* pindex = NULL;
+    if (wtx.GetDepthInMainChain(pindex) < 1 || !pindex)
+        return;
+
+    CStakeableOutput output;
+    output.nHeight = pindex->nHeight;
+    output.nTimeBlock = pindex->GetBlockTime();
+    output.nHeightMature = pindex->nHeight;
+    if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && !GetBoolArg("-testnet",false))
+        output.nHeightMature += Params().GetConsensus().nCoinbaseMaturity;
+    output.nTimeMature = (int64_t)wtx.nTime + Params().GetConsensus().nStakeMinAge;
+
+    // Ownership is checked when taking a snapshot, as imported keys and
+    // scripts change it without touching the transaction
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        if (IsSpent(hash, i))
+            continue;
+        COutPoint prevout(hash, i);
+        mapStakeableOutputs[prevout] = output;
+        setStakeableByTime.insert(make_pair(output.nTimeMature, prevout));
+    }
+}
+
+void CWallet::UpdateStakeableOutputs(const CTransaction& tx)
+{
+    UpdateStakeableOutputs(tx.GetHash());
+
+    // The outputs it spends may have been spent or released
+    for(const CTxIn& txin: tx.vin)
+        if (mapWallet.count(txin.prevout.hash))
+            UpdateStakeableOutputs(txin.prevout.hash);
+}
+
+void CWallet::RebuildStakeableOutputs()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    mapStakeableOutputs.clear();
+    setStakeableByTime.clear();
+    UpdateStakeTip(chainActive.Tip());
+
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        UpdateStakeableOutputs(it->first);
+}
+
+static const int64_t STAKE_REWARD_DAY = 24 * 60 * 60;
+
+void CWallet::AddStakeRewardToIndex(const uint256& hash, const CStakeReward& reward)
+{
+    mapStakeRewards[hash] = reward;
+    setStakeRewardsByTime.insert(make_pair(reward.nTime, hash));
+    setStakeRewardsByHeight.insert(make_pair(reward.nHeight, hash));
+    mapStakeRewardsByDay[reward.nTime / STAKE_REWARD_DAY] += reward;
+}
+
+void CWallet::RemoveStakeRewardFromIndex(const uint256& hash)
+{
+    std::map<uint256, CStakeReward>::iterator mi = mapStakeRewards.find(hash);
+    if (mi == mapStakeRewards.end())
+        return;
+
+    const CStakeReward& reward = mi->second;
+    setStakeRewardsByTime.erase(make_pair(reward.nTime, hash));
+    setStakeRewardsByHeight.erase(make_pair(reward.nHeight, hash));
+    std::map<int64_t, CStakeRewardTotal>::iterator it = mapStakeRewardsByDay.find(reward.nTime / STAKE_REWARD_DAY);
+    if (it != mapStakeRewardsByDay.end()) {
+        it->second -= reward;
+        if (it->second.nCount == 0)
+            mapStakeRewardsByDay.erase(it);
+    }
+    mapStakeRewards.erase(mi);
+}
+
+void CWallet::LoadStakeReward(const uint256& hash, const CStakeReward& reward)
+{
+    AssertLockHeld(cs_wallet);
+
+    RemoveStakeRewardFromIndex(hash);
+    AddStakeRewardToIndex(hash, reward);
+}
+
+CAmount CWallet::GetStakeRewardAmount(const CWalletTx& wtx) const
+{
+    // Valued regardless of maturity, which is only checked when querying
+    if (wtx.vout.size() > 1 && wtx.vout[1].scriptPubKey.IsColdStaking()) {
+        isminefilter filter = IsMine(wtx.vout[1]);
+        return wtx.GetCredit(filter, false) - wtx.GetDebit(filter);
+    }
+
+    return wtx.GetCredit(ISMINE_SPENDABLE, false) + wtx.GetCredit(ISMINE_STAKABLE, false) -
+           wtx.GetDebit(ISMINE_SPENDABLE) - wtx.GetDebit(ISMINE_STAKABLE);
+}
+
+void CWallet::UpdateStakeReward(const uint256& hash, CWalletDB* pwalletdbIn)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    bool fCounted = false;
+    CStakeReward reward;
+    map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hash);
+    if (mi != mapWallet.end() && mi->second.IsCoinStake() && !mi->second.isAbandoned())
+    {
+        const CBlockIndex* pindex = NULL;
+        if (mi->second.GetDepthInMainChain(pindex) > 0 && pindex)
+        {
+            fCounted = true;
+            reward.nTime = mi->second.nTime;
+            reward.nHeight = pindex->nHeight;
+            reward.nAmount = GetStakeRewardAmount(mi->second);
+        }
+    }
+
+    // The amount changes without the transaction moving when keys or watch-only scripts are added
+    std::map<uint256, CStakeReward>::const_iterator it = mapStakeRewards.find(hash);
+    if (it == mapStakeRewards.end() ? !fCounted : (fCounted && it->second.nHeight == reward.nHeight &&
+                                                   it->second.nTime == reward.nTime && it->second.nAmount == reward.nAmount))
+        return;
+
+    RemoveStakeRewardFromIndex(hash);
+    if (fCounted)
+        AddStakeRewardToIndex(hash, reward);
+
+    if (!fFileBacked)
+        return;
+
+    // Do not flush the wallet here for performance reasons
+    CWalletDB* pwalletdb = pwalletdbIn ? pwalletdbIn : new CWalletDB(strWalletFile, "r+", false);
+    if (fCounted)
+        pwalletdb->WriteStakeReward(hash, reward);
+    else
+        pwalletdb->EraseStakeReward(hash);
+    if (!pwalletdbIn)
+        delete pwalletdb;
+}
+
+void CWallet::RebuildStakeRewards()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    CWalletDB* pwalletdb = fFileBacked ? new CWalletDB(strWalletFile, "r+", false) : NULL;
+
+    std::vector<uint256> vStale;
+    for (std::map<uint256, CStakeReward>::const_iterator it = mapStakeRewards.begin(); it != mapStakeRewards.end(); ++it)
+        if (!mapWallet.count(it->first))
+            vStale.push_back(it->first);
+    for(const uint256& hash: vStale)
+        UpdateStakeReward(hash, pwalletdb);
+
+    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        if (it->second.IsCoinStake())
+            UpdateStakeReward(it->first, pwalletdb);
+
+    delete pwalletdb;
+}
+
+int CWallet::GetStakeRewardMatureHeight() const
+{
+    // Same rule as CMerkleTx::GetBlocksToMaturity, relative to the tip the staking index is at
+    if (GetBoolArg("-testnet", false))
+        return nStakeTipHeight;
+    return nStakeTipHeight - Params().GetConsensus().nCoinbaseMaturity;
+}
+
+void CWallet::AddStakeRewardsByTime(CStakeRewardTotal& total, int64_t nStart, int64_t nEnd) const
+{
+    std::set<std::pair<int64_t, uint256> >::const_iterator it = setStakeRewardsByTime.lower_bound(make_pair(nStart, uint256()));
+    for (; it != setStakeRewardsByTime.end() && it->first <= nEnd; ++it)
+        total += mapStakeRewards.find(it->second)->second;
+}
+
+CStakeRewardTotal CWallet::GetStakeRewards(int64_t nStart, int64_t nEnd) const
+{
+    AssertLockHeld(cs_wallet);
+
+    CStakeRewardTotal total;
+    nStart = std::max<int64_t>(nStart, 0);
+    if (nEnd < nStart)
+        return total;
+
+    // Whole days come from the daily totals, the partial ones at both ends from the rewards themselves
+    int64_t nFirstDay = nStart / STAKE_REWARD_DAY + (nStart % STAKE_REWARD_DAY != 0);
+    int64_t nLastDay = nEnd / STAKE_REWARD_DAY - (nEnd % STAKE_REWARD_DAY != STAKE_REWARD_DAY - 1);
+    if (nFirstDay <= nLastDay)
+    {
+        std::map<int64_t, CStakeRewardTotal>::const_iterator it = mapStakeRewardsByDay.lower_bound(nFirstDay);
+        for (; it != mapStakeRewardsByDay.end() && it->first <= nLastDay; ++it)
+            total += it->second;
+
+        int64_t nWholeStart = nFirstDay * STAKE_REWARD_DAY;
+        int64_t nWholeEnd = nLastDay * STAKE_REWARD_DAY + STAKE_REWARD_DAY - 1;
+        if (nStart < nWholeStart)
+            AddStakeRewardsByTime(total, nStart, nWholeStart - 1);
+        if (nWholeEnd < nEnd)
+            AddStakeRewardsByTime(total, nWholeEnd + 1, nEnd);
+    }
+    else
+    {
+        AddStakeRewardsByTime(total, nStart, nEnd);
+    }
+
+    // Take out the rewards which are not mature yet
+    std::set<std::pair<int, uint256> >::const_iterator it = setStakeRewardsByHeight.upper_bound(make_pair(GetStakeRewardMatureHeight(), uint256()));
+    for (; it != setStakeRewardsByHeight.end(); ++it)
+    {
+        const CStakeReward& reward = mapStakeRewards.find(it->second)->second;
+        if (reward.nTime >= nStart && reward.nTime <= nEnd)
+            total -= reward;
+    }
+
+    return total;
+}
+
+bool CWallet::GetFirstStakeReward(CStakeReward& reward) const
+{
+    AssertLockHeld(cs_wallet);
+
+    int nMatureHeight = GetStakeRewardMatureHeight();
+    for (std::set<std::pair<int64_t, uint256> >::const_iterator it = setStakeRewardsByTime.begin(); it != setStakeRewardsByTime.end(); ++it)
+    {
+        const CStakeReward& rewardFound = mapStakeRewards.find(it->second)->second;
+        if (rewardFound.nHeight <= nMatureHeight)
+        {
+            reward = rewardFound;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CWallet::GetLatestStakeReward(CStakeReward& reward) const
+{
+    AssertLockHeld(cs_wallet);
+
+    int nMatureHeight = GetStakeRewardMatureHeight();
+    for (std::set<std::pair<int64_t, uint256> >::const_reverse_iterator it = setStakeRewardsByTime.rbegin(); it != setStakeRewardsByTime.rend(); ++it)
+    {
+        const CStakeReward& rewardFound = mapStakeRewards.find(it->second)->second;
+        if (rewardFound.nHeight <= nMatureHeight)
+        {
+            reward = rewardFound;
+            return true;
+        }
+    }
+    return false;
+}
+
 // Select some coins without random shuffle or best subset approximation
 bool CWallet::SelectCoinsForStaking(int64_t nTargetValue, unsigned int nSpendTime, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const
 {
@@ -354,92 +638,121 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     CCoinsViewCache view(pcoinsTip);
 
-    int64_t nCredit = 0;
-    CScript scriptPubKeyKernel;
-    for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin: setCoins)
+    // Gather the kernel inputs of every candidate, so the search itself does
+    // not need to look up transactions or block indexes. They are kept
+    // prepared in mapStakeKernelCache between calls.
+    CStakeKernelSearch kernelSearch(pindexPrev, nBits);
+    vector<pair<const CWalletTx*,unsigned int> > vStakeCoins;
+    vector<CStakeKernelCoin> vKernelCoins;
     {
-        static int nMaxStakeSearchInterval = 60;
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == chainActive.Tip(); n++)
+        LOCK(cs_wallet);
+        for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin: setCoins)
         {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, view, &nBlockTime))
+            COutPoint prevout(pcoin.first->GetHash(), pcoin.second);
+            std::map<COutPoint, CStakeKernelCoin>::iterator it = mapStakeKernelCache.find(prevout);
+            if (it == mapStakeKernelCache.end())
             {
-                // Found a kernel
-                LogPrint("coinstake", "CreateCoinStake : kernel found\n");
-                vector<std::vector<unsigned char>> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_COLDSTAKING)
-                {
-                    LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_COLDSTAKING) // cold staking
-                {
-                    // try to find staking key
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    } else {
-                        // we keep the same script
-                        scriptPubKeyOut = scriptPubKeyKernel;
-                    }
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
-                }
-                if (whichType == TX_PUBKEY)
-                {
-                    std::vector<unsigned char>& vchPubKey = vSolutions[0];
-                    if (!keystore.GetKey(Hash160(vchPubKey), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
+                std::map<COutPoint, CStakeableOutput>::const_iterator mi = mapStakeableOutputs.find(prevout);
+                if (mi == mapStakeableOutputs.end())
+                    continue;
+                it = mapStakeKernelCache.insert(make_pair(prevout, CStakeKernelCoin(prevout, mi->second.nTimeBlock,
+                                                                                    pcoin.first->nTime, pcoin.first->vout[pcoin.second].nValue))).first;
+            }
+            kernelSearch.Prepare(it->second);
+            vStakeCoins.push_back(pcoin);
+            vKernelCoins.push_back(it->second);
+        }
+    }
 
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    }
+    int64_t nCredit = 0;
+    CScript scriptPubKeyKernel;
+    unsigned int nSearchWindow = min(nSearchInterval, (int64_t)MAX_STAKE_SEARCH_INTERVAL);
+    while (!vKernelCoins.empty() && pindexPrev == chainActive.Tip())
+    {
+        boost::this_thread::interruption_point();
+        // Search backward in time from the given txNew timestamp
+        // Search nSearchInterval seconds back up to MAX_STAKE_SEARCH_INTERVAL
+        size_t nKernel;
+        unsigned int nTimeKernel;
+        if (!kernelSearch.Search(vKernelCoins, txNew.nTime, nSearchWindow, nKernel, nTimeKernel))
+            break;
 
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
+        // Candidates which turn out to be unusable are dropped before searching again
+        PAIRTYPE(const CWalletTx*, unsigned int) pcoin = vStakeCoins[nKernel];
+        vStakeCoins.erase(vStakeCoins.begin() + nKernel);
+        vKernelCoins.erase(vKernelCoins.begin() + nKernel);
 
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.insert(make_pair(pcoin.first,pcoin.second));
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        // Found a kernel
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        if (!CheckKernel(pindexPrev, nBits, nTimeKernel, prevoutStake, view))
+        {
+            LogPrint("coinstake", "CreateCoinStake : kernel rejected by CheckKernel\n");
+            continue;
+        }
+        LogPrint("coinstake", "CreateCoinStake : kernel found\n");
+        vector<std::vector<unsigned char>> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
+            continue;
+        }
+        LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH && whichType != TX_COLDSTAKING)
+        {
+            LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            continue;  // only support pay to public key and pay to address
+        }
+        if (whichType == TX_COLDSTAKING) // cold staking
+        {
+            // try to find staking key
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
+            {
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            } else {
+                // we keep the same script
+                scriptPubKeyOut = scriptPubKeyKernel;
+            }
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
+            {
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
+            scriptPubKeyOut << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+        }
+        if (whichType == TX_PUBKEY)
+        {
+            std::vector<unsigned char>& vchPubKey = vSolutions[0];
+            if (!keystore.GetKey(Hash160(vchPubKey), key))
+            {
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
 
-                LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+            if (key.GetPubKey() != vchPubKey)
+            {
+                LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                continue; // keys mismatch
             }
+
+            scriptPubKeyOut = scriptPubKeyKernel;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        txNew.nTime = nTimeKernel;
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.insert(make_pair(pcoin.first,pcoin.second));
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
@@ -920,6 +1233,7 @@ set<uint256> CWallet::GetConflicts(const uint256& txid) const
 void CWallet::Flush(bool shutdown)
 {
     bitdb.Flush(shutdown);
+    walletlog.Flush(shutdown);
 }
 
 bool CWallet::Verify()
@@ -953,6 +1267,19 @@ bool CWallet::Verify()
         }
     }
 
+    std::string strBackend = GetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    if (strBackend != "bdb" && strBackend != "log")
+        return InitError(strprintf(_("Unknown wallet backend: %s"), strBackend));
+
+    if (walletlog.Exists(walletFile))
+    {
+        // Loading the log drops a write torn by a crash, a salvage also skips corrupt frames
+        std::string strError;
+        if (!walletlog.Verify(walletFile, strError, GetBoolArg("-salvagewallet", false)))
+            return InitError(strprintf(_("Error loading wallet log: %s"), strError));
+        return true;
+    }
+
     if (GetBoolArg("-salvagewallet", false))
     {
         // Recover readable keypairs:
@@ -975,6 +1302,21 @@ bool CWallet::Verify()
             return InitError(strprintf(_("%s corrupt, salvage failed"), walletFile));
     }
 
+    if (strBackend == "log")
+    {
+        std::string strError;
+        if (boost::filesystem::exists(GetDataDir() / walletFile))
+        {
+            uiInterface.InitMessage(_("Migrating wallet..."));
+            if (!CDB::MigrateToLog(walletFile, strError))
+                return InitError(strprintf(_("Error migrating %s to a wallet log: %s"), walletFile, strError));
+        }
+        else if (!walletlog.Create(walletFile))
+            return InitError(strprintf(_("Error creating wallet log %s"), CWalletLogEnv::GetPath(walletFile).string()));
+        if (!walletlog.Verify(walletFile, strError))
+            return InitError(strprintf(_("Error loading wallet log: %s"), strError));
+    }
+
     return true;
 }
 
@@ -1038,9 +1380,11 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
-void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
+void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid, bool fSyncMetaData)
 {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    if (!fSyncMetaData)
+        return;
 
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1048,7 +1392,7 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 }
 
 
-void CWallet::AddToSpends(const uint256& wtxid)
+void CWallet::AddToSpends(const uint256& wtxid, bool fSyncMetaData)
 {
     assert(mapWallet.count(wtxid));
     CWalletTx& thisTx = mapWallet[wtxid];
@@ -1056,7 +1400,21 @@ void CWallet::AddToSpends(const uint256& wtxid)
         return;
 
     for(const CTxIn& txin: thisTx.vin)
-        AddToSpends(txin.prevout, wtxid);
+        AddToSpends(txin.prevout, wtxid, fSyncMetaData);
+}
+
+void CWallet::SyncLoadedMetaData()
+{
+    AssertLockHeld(cs_wallet);
+
+    TxSpends::iterator it = mapTxSpends.begin();
+    while (it != mapTxSpends.end())
+    {
+        pair<TxSpends::iterator, TxSpends::iterator> range = mapTxSpends.equal_range(it->first);
+        if (std::distance(range.first, range.second) > 1)
+            SyncMetaData(range);
+        it = range.second;
+    }
 }
 
 bool CWallet::EncryptWallet(const SecureString& strWalletPassphrase)
@@ -1262,7 +1620,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
         CWalletTx& wtx = mapWallet[hash];
         wtx.BindWallet(this);
         wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
-        AddToSpends(hash);
+        // The metadata of conflicting spends is synced once, after the whole wallet is loaded
+        AddToSpends(hash, false);
         for(const CTxIn& txin: wtx.vin) {
             if (mapWallet.count(txin.prevout.hash)) {
                 CWalletTx& prevtx = mapWallet[txin.prevout.hash];
@@ -1466,6 +1825,9 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            EraseStakeKernelCache(wtx);
+            UpdateStakeableOutputs(wtx);
+            UpdateStakeReward(now, &walletdb);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1528,6 +1890,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            EraseStakeKernelCache(wtx);
+            UpdateStakeableOutputs(wtx);
+            UpdateStakeReward(now, &walletdb);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1552,9 +1917,18 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
 {
     LOCK2(cs_main, cs_wallet);
 
+    if (pindex) {
+        UpdateStakeTip(chainActive.Tip());
+        UpdateBalanceTip(chainActive.Tip());
+    }
+
     if (!AddToWalletIfInvolvingMe(tx, pblock, true))
        return; // Not one of ours
 
+    EraseStakeKernelCache(tx);
+    UpdateStakeableOutputs(tx);
+    UpdateStakeReward(tx.GetHash());
+
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
     // recomputed, also:
@@ -1565,6 +1939,20 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
     }
 }
 
+void CWallet::EraseStakeKernelCache(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+
+    // Its outputs may now be confirmed in a different block, or not at all
+    std::map<COutPoint, CStakeKernelCoin>::iterator it = mapStakeKernelCache.lower_bound(COutPoint(tx.GetHash(), 0));
+    while (it != mapStakeKernelCache.end() && it->first.hash == tx.GetHash())
+        mapStakeKernelCache.erase(it++);
+
+    // The coins it spends can not be staked anymore
+    for(const CTxIn& txin: tx.vin)
+        mapStakeKernelCache.erase(txin.prevout);
+}
+
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
@@ -1948,10 +2336,114 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+namespace {
+
+/** A block of a rescan, with which of its transactions pay to the wallet */
+struct CWalletRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    std::vector<bool> vMatch;
+
+    CWalletRescanBlock() : pindex(NULL), fRead(false) {}
+};
+
 /**
- * Scan the block chain (starting in pindexStart) for transactions
- * from or to us. If fUpdate is true, found transactions that already
- * exist in the wallet will be updated.
+ * Reads a block of a rescan from disk and matches the outputs of its
+ * transactions against the keys and scripts of the wallet, which only
+ * takes the keystore lock. Inputs are matched when the block is added, as
+ * they may spend transactions found earlier in the same rescan.
+ */
+class CWalletRescanCheck
+{
+private:
+    const CWallet* pwallet;
+    CWalletRescanBlock* prescanblock;
+
+public:
+    CWalletRescanCheck() : pwallet(NULL), prescanblock(NULL) {}
+    CWalletRescanCheck(const CWallet* pwalletIn, CWalletRescanBlock* prescanblockIn) : pwallet(pwalletIn), prescanblock(prescanblockIn) {}
+
+    bool operator()()
+    {
+        prescanblock->fRead = ReadBlockFromDisk(prescanblock->block, prescanblock->pindex, Params().GetConsensus());
+        const std::vector<CTransaction>& vtx = prescanblock->block.vtx;
+        prescanblock->vMatch.assign(vtx.size(), false);
+        for (unsigned int i = 0; i < vtx.size(); i++)
+        {
+            for(const CTxOut& txout: vtx[i].vout)
+            {
+                if (pwallet->IsMine(txout) != ISMINE_NO)
+                {
+                    prescanblock->vMatch[i] = true;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    void swap(CWalletRescanCheck& check)
+    {
+        std::swap(pwallet, check.pwallet);
+        std::swap(prescanblock, check.prescanblock);
+    }
+};
+
+} // anon namespace
+
+static void ThreadWalletRescan(CCheckQueue<CWalletRescanCheck>* pqueue)
+{
+    RenameThread("navcoin-rescan");
+    pqueue->Thread();
+}
+
+bool CWallet::GetRescanHeightsFromAddressIndex(int nStartHeight, std::set<int>& setHeights) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    {
+        LOCK(cs_KeyStore);
+        std::set<CKeyID> setKeys;
+        GetKeys(setKeys);
+        for(const CKeyID& keyID: setKeys)
+            vAddresses.push_back(make_pair(uint160(keyID), 1));
+        for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it)
+            vAddresses.push_back(make_pair(uint160(it->first), 2));
+        for(const CScript& script: setWatchOnly)
+        {
+            uint160 hashBytes;
+            int type = GetAddressIndexKey(script, hashBytes);
+            if (type == 0)
+                return false; // A script the index does not know about
+            vAddresses.push_back(make_pair(hashBytes, type));
+        }
+    }
+
+    for (unsigned int i = 0; i < vAddresses.size(); i++)
+    {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vIndex;
+        if (!GetAddressIndex(vAddresses[i].first, vAddresses[i].second, vIndex, nStartHeight, chainActive.Height()))
+            return false;
+        for (unsigned int j = 0; j < vIndex.size(); j++)
+            setHeights.insert(vIndex[j].first.blockHeight);
+    }
+    return true;
+}
+
+/**
+ * Scan the active chain from pindexStart on for transactions involving the
+ * wallet.
+ *
+ * Blocks are processed in windows of RESCAN_WINDOW_BLOCKS: while the
+ * transactions of a window are added to the wallet in chain order, the
+ * rescan workers read the next window from disk and match its outputs.
+ * Only the transactions with a matching output, or with an input or hash
+ * known to the wallet, go through AddToWalletIfInvolvingMe, which updates
+ * the ones already in the wallet if fUpdate.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -1968,28 +2460,102 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        // With the address index, only the blocks in which the wallet's addresses were active need to be read
+        std::set<int> setHeights;
+        bool fUseAddressIndex = pindex && fAddressIndex && GetBoolArg("-rescanaddressindex", DEFAULT_RESCAN_ADDRESSINDEX);
+        if (fUseAddressIndex && !GetRescanHeightsFromAddressIndex(pindex->nHeight, setHeights)) {
+            LogPrintf("%s: the address index does not cover all the wallet scripts, reading every block\n", __func__);
+            fUseAddressIndex = false;
+        }
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
+
+        int64_t nTimeStart = GetTimeMicros();
+        unsigned int nBlocksRead = 0;
+        unsigned int nBlocksSkipped = 0;
+        unsigned int nTxChecked = 0;
+
+        std::vector<CWalletRescanBlock> vWindow;
+        std::vector<CWalletRescanBlock> vWindowNext;
+        std::vector<CWalletRescanCheck> vChecks;
+        // The workers only run during the rescan
+        CCheckQueue<CWalletRescanCheck> rescanqueue(1);
+        CCheckQueueWorkers<CWalletRescanCheck> workers(&rescanqueue, std::max(nScriptCheckThreads - 1, 0), &ThreadWalletRescan);
+        boost::scoped_ptr<CCheckQueueControl<CWalletRescanCheck> > control;
+        while (true)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            // Hand the next window to the workers, which work on it while the previous one is added
+            vWindowNext.clear();
+            while (pindex && vWindowNext.size() < RESCAN_WINDOW_BLOCKS)
+            {
+                if (!fUseAddressIndex || setHeights.count(pindex->nHeight)) {
+                    vWindowNext.push_back(CWalletRescanBlock());
+                    vWindowNext.back().pindex = pindex;
+                } else {
+                    nBlocksSkipped++;
+                }
+                pindex = chainActive.Next(pindex);
+            }
+
+            vChecks.clear();
+            for (unsigned int i = 0; i < vWindowNext.size(); i++)
+                vChecks.push_back(CWalletRescanCheck(this, &vWindowNext[i]));
+            if (nScriptCheckThreads && !vChecks.empty()) {
+                control.reset(new CCheckQueueControl<CWalletRescanCheck>(&rescanqueue));
+                control->Add(vChecks);
+            } else {
+                for(CWalletRescanCheck& check: vChecks)
+                    check();
+            }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
-            for(CTransaction& tx: block.vtx)
+            for (unsigned int i = 0; i < vWindow.size(); i++)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
-                    ret++;
+                const CWalletRescanBlock& rescanblock = vWindow[i];
+                if (rescanblock.pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), rescanblock.pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                if (!rescanblock.fRead)
+                    LogPrintf("%s: unable to read block %s\n", __func__, rescanblock.pindex->GetBlockHash().ToString());
+
+                const CBlock& block = rescanblock.block;
+                for (unsigned int j = 0; j < block.vtx.size(); j++)
+                {
+                    const CTransaction& tx = block.vtx[j];
+                    bool fCandidate = rescanblock.vMatch[j] || mapWallet.count(tx.GetHash());
+                    for (unsigned int k = 0; k < tx.vin.size() && !fCandidate; k++)
+                        fCandidate = mapWallet.count(tx.vin[k].prevout.hash) || mapTxSpends.count(tx.vin[k].prevout);
+                    if (fCandidate && AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                        ret++;
+                }
+                nBlocksRead++;
+                nTxChecked += block.vtx.size();
+
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    double dElapsed = (GetTimeMicros() - nTimeStart) * 0.000001;
+                    LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", rescanblock.pindex->nHeight,
+                              Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), rescanblock.pindex), dElapsed > 0 ? nBlocksRead / dElapsed : 0.0);
+                }
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+
+            if (control) {
+                control->Wait();
+                control.reset();
             }
+            if (vWindowNext.empty())
+                break;
+            vWindow.swap(vWindowNext);
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        double dElapsed = (GetTimeMicros() - nTimeStart) * 0.000001;
+        LogPrintf("%s: read %u blocks (%u skipped through the address index) and checked %u transactions in %.2fs, %.1f blocks/s, %d wallet transactions found\n",
+                  __func__, nBlocksRead, nBlocksSkipped, nTxChecked, dElapsed, dElapsed > 0 ? nBlocksRead / dElapsed : 0.0, ret);
+
+        RebuildStakeableOutputs();
+        RebuildStakeRewards();
     }
     return ret;
 }
@@ -2265,6 +2831,23 @@ CAmount CWalletTx::GetChange() const
     return nChangeCached;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fColdStakingCreditCached = false;
+    fColdStakingDebitCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 bool CWalletTx::InMempool() const
 {
     LOCK(mempool.cs);
@@ -2374,108 +2957,160 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime)
 
 CAmount CWallet::GetBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nAvailable;
 }
 
 CAmount CWallet::GetColdStakingBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableStakableCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nColdStaking;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
+    return GetBalances().nWatchOnlyAvailable;
+}
+
+CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
+{
+    return GetBalances().nWatchOnlyUnconfirmed;
+}
+
+CAmount CWallet::GetImmatureWatchOnlyBalance() const
+{
+    return GetBalances().nWatchOnlyImmature;
+}
+
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    setBalanceDirty.insert(hash);
+}
+
+CWalletBalances CWallet::GetTxBalances(const CWalletTx& wtx) const
+{
+    CWalletBalances balances;
+    int nDepth = wtx.GetDepthInMainChain();
+    if (wtx.IsTrusted()) {
+        balances.nAvailable = wtx.GetAvailableCredit();
+        balances.nColdStaking = wtx.GetAvailableStakableCredit();
+        balances.nWatchOnlyAvailable = wtx.GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && wtx.InMempool()) {
+        balances.nUnconfirmed = wtx.GetAvailableCredit();
+        balances.nWatchOnlyUnconfirmed = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+    if (nDepth > 0 && wtx.GetBlocksToMaturity() > 0) {
+        if (wtx.IsCoinStake())
+            balances.nStake = GetCredit(wtx, ISMINE_SPENDABLE);
+        if (wtx.IsCoinBase())
+            balances.nNewMint = GetCredit(wtx, ISMINE_SPENDABLE);
+    }
+    return balances;
+}
+
+void CWallet::RefreshBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // Mempool removals are not notified, so recheck the unconfirmed transactions whenever it changed
+    unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
+    if (nMempoolUpdated != nBalanceMempoolUpdated) {
+        setBalanceDirty.insert(setBalanceMempoolDependent.begin(), setBalanceMempoolDependent.end());
+        nBalanceMempoolUpdated = nMempoolUpdated;
+    }
+
+    if (setBalanceDirty.empty())
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    unsigned int nRefreshed = 0;
+    while (!setBalanceDirty.empty()) {
+        uint256 hash = *setBalanceDirty.begin();
+        setBalanceDirty.erase(setBalanceDirty.begin());
+        setBalanceTipDependent.erase(hash);
+        setBalanceMempoolDependent.erase(hash);
+        nRefreshed++;
+
+        CTxBalanceEntry entryOld;
+        std::map<uint256, CTxBalanceEntry>::iterator mi = mapTxBalances.find(hash);
+        if (mi != mapTxBalances.end()) {
+            entryOld = mi->second;
+            balanceTotals -= entryOld.balances;
+            mapTxBalances.erase(mi);
+        }
+
+        map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+        if (it == mapWallet.end())
+            continue;
+        const CWalletTx& wtx = it->second;
+
+        CTxBalanceEntry entry;
+        entry.balances = GetTxBalances(wtx);
+        int nDepth = wtx.GetDepthInMainChain();
+        bool fPending = nDepth == 0 && !wtx.isAbandoned();
+        entry.fSpends = nDepth > 0 || (fPending && !wtx.IsCoinStake());
+        if (!entry.balances.IsNull() || entry.fSpends) {
+            balanceTotals += entry.balances;
+            mapTxBalances[hash] = entry;
+        }
+
+        if (fPending || nDepth < 0 || wtx.GetBlocksToMaturity() > 0)
+            setBalanceTipDependent.insert(hash);
+        if (fPending)
+            setBalanceMempoolDependent.insert(hash);
+
+        // Outputs it spends become available again, or stop being so, without the parents being touched
+        if (entry.fSpends != entryOld.fSpends) {
+            for(const CTxIn& txin: wtx.vin)
+                if (mapWallet.count(txin.prevout.hash))
+                    setBalanceDirty.insert(txin.prevout.hash);
         }
     }
+    LogPrint("bench", "%s: %u transactions in %.2fms\n", __func__, nRefreshed, (GetTimeMicros() - nTimeStart) * 0.001);
 
-    return nTotal;
+    if (fCheckWalletBalances) {
+        CWalletBalances balancesScanned = ScanBalances();
+        if (balancesScanned != balanceTotals)
+            LogPrintf("%s: balance totals do not match the wallet transactions (available %s instead of %s)\n", __func__,
+                      FormatMoney(balanceTotals.nAvailable), FormatMoney(balancesScanned.nAvailable));
+        assert(balancesScanned == balanceTotals);
+    }
 }
 
-CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
+CWalletBalances CWallet::GetBalances() const
 {
-    CAmount nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
+        LOCK(cs_wallet);
+        if (setBalanceDirty.empty() && (setBalanceMempoolDependent.empty() || mempool.GetTransactionsUpdated() == nBalanceMempoolUpdated))
+            return balanceTotals;
     }
-    return nTotal;
+
+    LOCK2(cs_main, cs_wallet);
+    RefreshBalances();
+    return balanceTotals;
 }
 
-CAmount CWallet::GetImmatureWatchOnlyBalance() const
+CWalletBalances CWallet::ScanBalances() const
 {
-    CAmount nTotal = 0;
+    CWalletBalances balances;
     {
         LOCK2(cs_main, cs_wallet);
         for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
+            balances += GetTxBalances(it->second);
     }
-    return nTotal;
+    return balances;
 }
 
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl, bool fIncludeZeroValue, bool fIncludeColdStaking) const
@@ -3137,6 +3772,8 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
             // otherwise just for transaction history.
             AddToWallet(wtxNew, false, pwalletdb);
 
+            UpdateStakeableOutputs(wtxNew);
+
             // Notify that old coins are spent
             set<CWalletTx*> setCoins;
             for(const CTxIn& txin: wtxNew.vin)
@@ -3257,6 +3894,12 @@ DBErrors CWallet::ZapSelectTx(vector<uint256>& vHashIn, vector<uint256>& vHashOu
 
     MarkDirty();
 
+    {
+        LOCK2(cs_main, cs_wallet);
+        for(const uint256& hash: vHashOut)
+            UpdateStakeReward(hash);
+    }
+
     return DB_LOAD_OK;
 
 }
@@ -3926,12 +4569,14 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-rescanaddressindex", strprintf(_("When rescanning with -addressindex enabled, only read the blocks in which the wallet's keys and scripts were active. Outputs the wallet can only stake through cold staking are not found this way (default: %u)"), DEFAULT_RESCAN_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-stakingaddress", strprintf(_("Specify a customised navcoin address to accumulate the staking rewards.")));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), DEFAULT_TX_CONFIRM_TARGET));
     strUsage += HelpMessageOpt("-usehd", _("Use hierarchical deterministic key generation (HD) after BIP32. Only has effect during wallet creation/first start") + " " + strprintf(_("(default: %u)"), DEFAULT_USE_HD_WALLET));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-walletbackend=<engine>", strprintf(_("Storage engine for a new wallet, bdb or log. With log, an existing Berkeley DB wallet is migrated to an append-only log, which is used from then on, and the wallet file is kept as a backup (default: %s)"), DEFAULT_WALLET_BACKEND));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
@@ -3941,6 +4586,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
 
+        strUsage += HelpMessageOpt("-checkwalletbalances", strprintf("Check the running wallet balance totals against a full scan of the wallet transactions whenever they are updated, and abort if they differ (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf("Flush wallet database activity from memory to disk log every <n> megabytes (default: %u)", DEFAULT_WALLET_DBLOGSIZE));
         strUsage += HelpMessageOpt("-flushwallet", strprintf("Run a thread to flush wallet periodically (default: %u)", DEFAULT_FLUSHWALLET));
         strUsage += HelpMessageOpt("-privdb", strprintf("Sets the DB_PRIVATE flag in the wallet db environment (default: %u)", DEFAULT_WALLET_PRIVDB));
@@ -4119,6 +4765,12 @@ bool CWallet::InitLoadWallet()
             }
         }
     }
+    {
+        LOCK2(cs_main, walletInstance->cs_wallet);
+        walletInstance->RebuildStakeableOutputs();
+        walletInstance->RebuildStakeRewards();
+    }
+
     walletInstance->SetBroadcastTransactions(GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
     pwalletMain = walletInstance;
@@ -4175,6 +4827,7 @@ bool CWallet::ParameterInteraction()
     nTxConfirmTarget = GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", DEFAULT_SEND_FREE_TRANSACTIONS);
+    fCheckWalletBalances = GetBoolArg("-checkwalletbalances", Params().DefaultConsistencyChecks());
 
     return true;
 }
@@ -4183,6 +4836,20 @@ bool CWallet::BackupWallet(const std::string& strDest)
 {
     if (!fFileBacked)
         return false;
+
+    if (walletlog.Exists(strWalletFile))
+    {
+        boost::filesystem::path pathSrc = CWalletLogEnv::GetPath(strWalletFile);
+        boost::filesystem::path pathDest(strDest);
+        if (boost::filesystem::is_directory(pathDest))
+            pathDest /= pathSrc.filename();
+
+        if (!walletlog.Backup(strWalletFile, pathDest))
+            return false;
+        LogPrintf("copied %s to %s\n", pathSrc.string(), pathDest.string());
+        return true;
+    }
+
     while (true)
     {
         {
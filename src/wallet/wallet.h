@@ -7,6 +7,7 @@
 #define NAVCOIN_WALLET_WALLET_H
 
 #include <amount.h>
+#include <kernel.h>
 #include <mnemonic/mnemonic.h>
 #include <streams.h>
 #include <tinyformat.h>
@@ -39,6 +40,7 @@ extern CFeeRate payTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
+extern bool fCheckWalletBalances;
 extern int64_t nReserveBalance;
 extern bool fWalletUnlockStakingOnly;
 
@@ -65,6 +67,10 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! Number of blocks read and matched ahead of the ones being added to the wallet during a rescan
+static const unsigned int RESCAN_WINDOW_BLOCKS = 128;
+//! -rescanaddressindex default
+static const bool DEFAULT_RESCAN_ADDRESSINDEX = false;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -371,20 +377,8 @@ public:
         mapValue.erase("timesmart");
     }
 
-    //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fColdStakingCreditCached = false;
-        fColdStakingDebitCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! Break the debit/credit caches, and the wallet's balance totals for this transaction
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -522,6 +516,139 @@ struct sortByCoinAgeDescending
 };
 
 
+/** A confirmed, unspent wallet output, as tracked by the staking index of CWallet */
+struct CStakeableOutput
+{
+    //! Height of the block including the output
+    int nHeight;
+    //! Time of the block including the output
+    unsigned int nTimeBlock;
+    //! Height from which the output is mature (coinbase and coinstake maturity)
+    int nHeightMature;
+    //! Time from which the output satisfies the minimum stake age (based on the tx time)
+    int64_t nTimeMature;
+
+    CStakeableOutput() : nHeight(0), nTimeBlock(0), nHeightMature(0), nTimeMature(0) {}
+};
+
+/** Reward of a coinstake of the wallet in the main chain, as recorded in its stake reward ledger */
+class CStakeReward
+{
+public:
+    //! Time of the coinstake
+    int64_t nTime;
+    //! Height of the block including it
+    int nHeight;
+    //! What it earned the wallet, cold staking rewards included
+    CAmount nAmount;
+
+    CStakeReward() : nTime(0), nHeight(0), nAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nTime);
+        READWRITE(nHeight);
+        READWRITE(nAmount);
+    }
+};
+
+/** Sum of the stake rewards over a period */
+struct CStakeRewardTotal
+{
+    CAmount nAmount;
+    int nCount;
+
+    CStakeRewardTotal() : nAmount(0), nCount(0) {}
+
+    CStakeRewardTotal& operator+=(const CStakeRewardTotal& b)
+    {
+        nAmount += b.nAmount;
+        nCount += b.nCount;
+        return *this;
+    }
+
+    CStakeRewardTotal& operator+=(const CStakeReward& reward)
+    {
+        nAmount += reward.nAmount;
+        nCount++;
+        return *this;
+    }
+
+    CStakeRewardTotal& operator-=(const CStakeReward& reward)
+    {
+        nAmount -= reward.nAmount;
+        nCount--;
+        return *this;
+    }
+};
+
+/** Amounts in each balance of a wallet, or contributed to them by a single transaction */
+struct CWalletBalances
+{
+    CAmount nAvailable;
+    CAmount nColdStaking;
+    CAmount nUnconfirmed;
+    CAmount nImmature;
+    CAmount nWatchOnlyAvailable;
+    CAmount nWatchOnlyUnconfirmed;
+    CAmount nWatchOnlyImmature;
+    //! Immature coinstake and coinbase credit
+    CAmount nStake;
+    CAmount nNewMint;
+
+    CWalletBalances() : nAvailable(0), nColdStaking(0), nUnconfirmed(0), nImmature(0), nWatchOnlyAvailable(0),
+                        nWatchOnlyUnconfirmed(0), nWatchOnlyImmature(0), nStake(0), nNewMint(0) {}
+
+    bool IsNull() const
+    {
+        return nAvailable == 0 && nColdStaking == 0 && nUnconfirmed == 0 && nImmature == 0 && nWatchOnlyAvailable == 0 &&
+               nWatchOnlyUnconfirmed == 0 && nWatchOnlyImmature == 0 && nStake == 0 && nNewMint == 0;
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& b)
+    {
+        nAvailable += b.nAvailable;
+        nColdStaking += b.nColdStaking;
+        nUnconfirmed += b.nUnconfirmed;
+        nImmature += b.nImmature;
+        nWatchOnlyAvailable += b.nWatchOnlyAvailable;
+        nWatchOnlyUnconfirmed += b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature += b.nWatchOnlyImmature;
+        nStake += b.nStake;
+        nNewMint += b.nNewMint;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& b)
+    {
+        nAvailable -= b.nAvailable;
+        nColdStaking -= b.nColdStaking;
+        nUnconfirmed -= b.nUnconfirmed;
+        nImmature -= b.nImmature;
+        nWatchOnlyAvailable -= b.nWatchOnlyAvailable;
+        nWatchOnlyUnconfirmed -= b.nWatchOnlyUnconfirmed;
+        nWatchOnlyImmature -= b.nWatchOnlyImmature;
+        nStake -= b.nStake;
+        nNewMint -= b.nNewMint;
+        return *this;
+    }
+
+    friend bool operator==(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return a.nAvailable == b.nAvailable && a.nColdStaking == b.nColdStaking && a.nUnconfirmed == b.nUnconfirmed &&
+               a.nImmature == b.nImmature && a.nWatchOnlyAvailable == b.nWatchOnlyAvailable &&
+               a.nWatchOnlyUnconfirmed == b.nWatchOnlyUnconfirmed && a.nWatchOnlyImmature == b.nWatchOnlyImmature &&
+               a.nStake == b.nStake && a.nNewMint == b.nNewMint;
+    }
+
+    friend bool operator!=(const CWalletBalances& a, const CWalletBalances& b)
+    {
+        return !(a == b);
+    }
+};
+
 /** Private key that includes an expiration date in case it never gets used. */
 class CWalletKey
 {
@@ -664,14 +791,90 @@ private:
      */
     typedef std::multimap<COutPoint, uint256> TxSpends;
     TxSpends mapTxSpends;
-    void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
-    void AddToSpends(const uint256& wtxid);
+    void AddToSpends(const COutPoint& outpoint, const uint256& wtxid, bool fSyncMetaData = true);
+    void AddToSpends(const uint256& wtxid, bool fSyncMetaData = true);
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Kernel inputs of the staking coins, prepared by previous kernel searches.
+     * Entries are dropped when the transaction creating or spending the coin
+     * changes, and re-prepared when the stake modifier or target moves on.
+     */
+    std::map<COutPoint, CStakeKernelCoin> mapStakeKernelCache;
+    void EraseStakeKernelCache(const CTransaction& tx);
+
+    /**
+     * Index of the outputs which can be staked, ordered by the time they reach
+     * the minimum stake age. It is kept up to date as wallet transactions get
+     * synced, confirmed, disconnected, abandoned or conflicted, so staking can
+     * take a snapshot without scanning mapWallet or holding cs_main.
+     */
+    std::map<COutPoint, CStakeableOutput> mapStakeableOutputs;
+    std::set<std::pair<int64_t, COutPoint> > setStakeableByTime;
+    //! Height and cold staking status of the tip the index was last updated for
+    const CBlockIndex* pindexStakeTip;
+    int nStakeTipHeight;
+    bool fStakeTipColdStaking;
+
+    void UpdateStakeTip(const CBlockIndex* pindex);
+    void UpdateStakeableOutputs(const uint256& hash);
+    void UpdateStakeableOutputs(const CTransaction& tx);
+
+    /**
+     * Ledger of the rewards of the coinstakes in the main chain, persisted in
+     * the wallet database, with per day (UTC) totals so stake reports over
+     * long periods neither walk mapWallet nor hold cs_main. It is updated
+     * along with the staking index. Rewards which are not mature yet at
+     * nStakeTipHeight are kept in it, and left out when querying.
+     */
+    std::map<uint256, CStakeReward> mapStakeRewards;
+    std::set<std::pair<int64_t, uint256> > setStakeRewardsByTime;
+    std::set<std::pair<int, uint256> > setStakeRewardsByHeight;
+    std::map<int64_t, CStakeRewardTotal> mapStakeRewardsByDay;
+
+    void AddStakeRewardToIndex(const uint256& hash, const CStakeReward& reward);
+    void RemoveStakeRewardFromIndex(const uint256& hash);
+    void UpdateStakeReward(const uint256& hash, CWalletDB* pwalletdb = NULL);
+    CAmount GetStakeRewardAmount(const CWalletTx& wtx) const;
+    int GetStakeRewardMatureHeight() const;
+    void AddStakeRewardsByTime(CStakeRewardTotal& total, int64_t nStart, int64_t nEnd) const;
+
+    //! Heights from nStartHeight on at which the address index shows activity of the keys and scripts of the wallet
+    bool GetRescanHeightsFromAddressIndex(int nStartHeight, std::set<int>& setHeights) const;
+
+    /** What a transaction last contributed to balanceTotals */
+    struct CTxBalanceEntry
+    {
+        CWalletBalances balances;
+        //! Whether it counted as spending its inputs (see IsSpent)
+        bool fSpends;
+
+        CTxBalanceEntry() : fSpends(false) {}
+    };
+
+    /**
+     * Running totals of the balances, as the sum of the contributions of the
+     * transactions in mapTxBalances. Only the transactions marked dirty get
+     * re-evaluated: the ones changed through CWalletTx::MarkDirty, plus the
+     * ones whose contribution depends on the tip (unconfirmed, conflicted or
+     * immature) when it moves, and on the mempool (unconfirmed) when it changes.
+     */
+    mutable CWalletBalances balanceTotals;
+    mutable std::map<uint256, CTxBalanceEntry> mapTxBalances;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceTipDependent;
+    mutable std::set<uint256> setBalanceMempoolDependent;
+    mutable unsigned int nBalanceMempoolUpdated;
+    const CBlockIndex* pindexBalanceTip;
+
+    void UpdateBalanceTip(const CBlockIndex* pindex);
+    CWalletBalances GetTxBalances(const CWalletTx& wtx) const;
+    void RefreshBalances() const;
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
@@ -728,6 +931,11 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        pindexStakeTip = NULL;
+        nStakeTipHeight = -1;
+        fStakeTipColdStaking = false;
+        nBalanceMempoolUpdated = 0;
+        pindexBalanceTip = NULL;
     }
 
     bool IsHDEnabled() const;
@@ -761,6 +969,16 @@ public:
      */
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true, const CCoinControl *coinControl = NULL, bool fIncludeZeroValue=false, bool fIncludeColdStaking=false) const;
     void AvailableCoinsForStaking(std::vector<COutput>& vCoins, unsigned int nSpendTime) const;
+    //! Rebuild the index of stakeable outputs from mapWallet
+    void RebuildStakeableOutputs();
+
+    //! Stake reward ledger, see mapStakeRewards
+    void LoadStakeReward(const uint256& hash, const CStakeReward& reward);
+    void RebuildStakeRewards();
+    //! Sum of the mature stake rewards with a time within [nStart, nEnd]
+    CStakeRewardTotal GetStakeRewards(int64_t nStart, int64_t nEnd) const;
+    bool GetFirstStakeReward(CStakeReward& reward) const;
+    bool GetLatestStakeReward(CStakeReward& reward) const;
 
     /**
      * Shuffle and select coins until nTargetValue is reached while avoiding
@@ -847,6 +1065,16 @@ public:
     CAmount GetWatchOnlyBalance() const;
     CAmount GetUnconfirmedWatchOnlyBalance() const;
     CAmount GetImmatureWatchOnlyBalance() const;
+    /**
+     * All the balances, from the running totals. Only takes cs_main when some
+     * transactions need to be re-evaluated, so callers holding cs_wallet must
+     * hold cs_main as well.
+     */
+    CWalletBalances GetBalances() const;
+    //! All the balances, computed from scratch by walking mapWallet
+    CWalletBalances ScanBalances() const;
+    //! Mark the balance totals of a transaction for re-evaluation
+    void MarkBalanceDirty(const uint256& hash) const;
 
     /**
      * Insert additional inputs into the transaction by
@@ -909,6 +1137,8 @@ public:
     void SetBestChain(const CBlockLocator& loc);
 
     DBErrors LoadWallet(bool& fFirstRunRet);
+    /** Give conflicting spends loaded from the wallet file the same metadata, which AddToWallet skips while loading */
+    void SyncLoadedMetaData();
     DBErrors ZapWalletTx(std::vector<CWalletTx>& vWtx);
     DBErrors ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256>& vHashOut);
 
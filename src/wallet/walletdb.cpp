@@ -15,6 +15,8 @@
 #include <utiltime.h>
 #include <wallet/wallet.h>
 
+#include <checkqueue.h>
+
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -66,6 +68,18 @@ bool CWalletDB::EraseTx(uint256 hash)
     return Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WriteStakeReward(const uint256& hash, const CStakeReward& reward)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("stakereward"), hash), reward);
+}
+
+bool CWalletDB::EraseStakeReward(const uint256& hash)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("stakereward"), hash));
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdated++;
@@ -80,7 +94,8 @@ bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, c
     vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
     vchKey.insert(vchKey.end(), vchPrivKey.begin(), vchPrivKey.end());
 
-    return Write(std::make_pair(std::string("key"), vchPubKey), std::make_pair(vchPrivKey, Hash(vchKey.begin(), vchKey.end())), false);
+    // Keys are never written again, so they do not wait for a group commit
+    return Write(std::make_pair(std::string("key"), vchPubKey), std::make_pair(vchPrivKey, Hash(vchKey.begin(), vchKey.end())), false) && Sync();
 }
 
 bool CWalletDB::WriteCryptedKey(const CPubKey& vchPubKey,
@@ -101,13 +116,13 @@ bool CWalletDB::WriteCryptedKey(const CPubKey& vchPubKey,
         Erase(std::make_pair(std::string("key"), vchPubKey));
         Erase(std::make_pair(std::string("wkey"), vchPubKey));
     }
-    return true;
+    return Sync();
 }
 
 bool CWalletDB::WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey)
 {
     nWalletDBUpdated++;
-    return Write(std::make_pair(std::string("mkey"), nID), kMasterKey, true);
+    return Write(std::make_pair(std::string("mkey"), nID), kMasterKey, true) && Sync();
 }
 
 bool CWalletDB::WriteCScript(const uint160& hash, const CScript& redeemScript)
@@ -212,7 +227,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
 {
     bool fAllAccounts = (strAccount == "*");
 
-    Dbc* pcursor = GetCursor();
+    CDBCursor* pcursor = GetCursor();
     if (!pcursor)
         throw runtime_error("CWalletDB::ListAccountCreditDebit(): cannot create DB cursor");
     unsigned int fFlags = DB_SET_RANGE;
@@ -229,7 +244,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
             break;
         else if (ret != 0)
         {
-            pcursor->close();
+            delete pcursor;
             throw runtime_error("CWalletDB::ListAccountCreditDebit(): error scanning DB");
         }
 
@@ -248,7 +263,7 @@ void CWalletDB::ListAccountCreditDebit(const string& strAccount, list<CAccountin
         entries.push_back(acentry);
     }
 
-    pcursor->close();
+    delete pcursor;
 }
 
 DBErrors CWalletDB::ReorderTransactions(CWallet* pwallet)
@@ -345,6 +360,121 @@ public:
     }
 };
 
+/** Unserialize and check a "tx" record, which does not need the wallet */
+static bool ReadWalletTx(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx, bool& fUpgraded, string& strErr)
+{
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    fUpgraded = false;
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+static void LoadWalletTx(CWallet* pwallet, const uint256& hash, const CWalletTx& wtx, bool fUpgraded, CWalletScanState& wss)
+{
+    if (fUpgraded)
+        wss.vWalletUpgrade.push_back(hash);
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->AddToWallet(wtx, true, nullptr);
+}
+
+/** Unserialize and check a "key" or "wkey" record, which does not need the wallet */
+static bool ReadWalletKey(const string& strType, CDataStream& ssKey, CDataStream& ssValue, CPubKey& vchPubKey, CKey& key, string& strErr)
+{
+    ssKey >> vchPubKey;
+    if (!vchPubKey.IsValid())
+    {
+        strErr = "Error reading wallet database: CPubKey corrupt";
+        return false;
+    }
+    CPrivKey pkey;
+    uint256 hash;
+
+    if (strType == "key")
+    {
+        ssValue >> pkey;
+    } else {
+        CWalletKey wkey;
+        ssValue >> wkey;
+        pkey = wkey.vchPrivKey;
+    }
+
+    // Old wallets store keys as "key" [pubkey] => [privkey]
+    // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
+    // using EC operations as a checksum.
+    // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
+    // remaining backwards-compatible.
+    try
+    {
+        ssValue >> hash;
+    }
+    catch (...) {}
+
+    bool fSkipCheck = false;
+
+    if (!hash.IsNull())
+    {
+        // hash pubkey/privkey to accelerate wallet load
+        std::vector<unsigned char> vchKey;
+        vchKey.reserve(vchPubKey.size() + pkey.size());
+        vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
+        vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
+
+        if (Hash(vchKey.begin(), vchKey.end()) != hash)
+        {
+            strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
+            return false;
+        }
+
+        fSkipCheck = true;
+    }
+
+    if (!key.Load(pkey, vchPubKey, fSkipCheck))
+    {
+        strErr = "Error reading wallet database: CPrivKey corrupt";
+        return false;
+    }
+    return true;
+}
+
+static bool LoadWalletKey(CWallet* pwallet, const string& strType, const CPubKey& vchPubKey, const CKey& key, CWalletScanState& wss, string& strErr)
+{
+    if (strType == "key")
+        wss.nKeys++;
+
+    if (!pwallet->LoadKey(key, vchPubKey))
+    {
+        strErr = "Error reading wallet database: LoadKey failed";
+        return false;
+    }
+    return true;
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -369,37 +499,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "tx")
         {
             uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgraded;
+            if (!ReadWalletTx(ssKey, ssValue, hash, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true, nullptr);
+            LoadWalletTx(pwallet, hash, wtx, fUpgraded, wss);
         }
         else if (strType == "acentry")
         {
@@ -434,66 +538,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "key" || strType == "wkey")
         {
             CPubKey vchPubKey;
-            ssKey >> vchPubKey;
-            if (!vchPubKey.IsValid())
-            {
-                strErr = "Error reading wallet database: CPubKey corrupt";
-                return false;
-            }
             CKey key;
-            CPrivKey pkey;
-            uint256 hash;
-
-            if (strType == "key")
-            {
-                wss.nKeys++;
-                ssValue >> pkey;
-            } else {
-                CWalletKey wkey;
-                ssValue >> wkey;
-                pkey = wkey.vchPrivKey;
-            }
-
-            // Old wallets store keys as "key" [pubkey] => [privkey]
-            // ... which was slow for wallets with lots of keys, because the public key is re-derived from the private key
-            // using EC operations as a checksum.
-            // Newer wallets store keys as "key"[pubkey] => [privkey][hash(pubkey,privkey)], which is much faster while
-            // remaining backwards-compatible.
-            try
-            {
-                ssValue >> hash;
-            }
-            catch (...) {}
-
-            bool fSkipCheck = false;
-
-            if (!hash.IsNull())
-            {
-                // hash pubkey/privkey to accelerate wallet load
-                std::vector<unsigned char> vchKey;
-                vchKey.reserve(vchPubKey.size() + pkey.size());
-                vchKey.insert(vchKey.end(), vchPubKey.begin(), vchPubKey.end());
-                vchKey.insert(vchKey.end(), pkey.begin(), pkey.end());
-
-                if (Hash(vchKey.begin(), vchKey.end()) != hash)
-                {
-                    strErr = "Error reading wallet database: CPubKey/CPrivKey corrupt";
-                    return false;
-                }
-
-                fSkipCheck = true;
-            }
-
-            if (!key.Load(pkey, vchPubKey, fSkipCheck))
-            {
-                strErr = "Error reading wallet database: CPrivKey corrupt";
+            if (!ReadWalletKey(strType, ssKey, ssValue, vchPubKey, key, strErr))
                 return false;
-            }
-            if (!pwallet->LoadKey(key, vchPubKey))
-            {
-                strErr = "Error reading wallet database: LoadKey failed";
+            if (!LoadWalletKey(pwallet, strType, vchPubKey, key, wss, strErr))
                 return false;
-            }
         }
         else if (strType == "mkey")
         {
@@ -582,6 +631,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                 return false;
             }
         }
+        else if (strType == "stakereward")
+        {
+            uint256 hash;
+            ssKey >> hash;
+            CStakeReward reward;
+            ssValue >> reward;
+            pwallet->LoadStakeReward(hash, reward);
+        }
         else if (strType == "orderposnext")
         {
             ssValue >> pwallet->nOrderPosNext;
@@ -621,6 +678,101 @@ static bool IsKeyType(string strType)
             strType == "mkey" || strType == "ckey");
 }
 
+namespace {
+
+/**
+ * A record read by LoadWallet. Transactions and unencrypted keys, which are
+ * costly to unserialize and check, are parsed by the wallet load workers
+ * before the record is loaded into the wallet.
+ */
+class CWalletLoadRecord
+{
+public:
+    CDataStream ssKey;
+    CDataStream ssValue;
+    std::string strType;
+    bool fParsed;
+    bool fValid;
+    std::string strErr;
+
+    //! Parsed "tx" record
+    uint256 hash;
+    CWalletTx wtx;
+    bool fUpgraded;
+
+    //! Parsed "key" or "wkey" record
+    CPubKey vchPubKey;
+    CKey key;
+
+    CWalletLoadRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), fParsed(false), fValid(false), fUpgraded(false) {}
+
+    void Parse()
+    {
+        fParsed = true;
+        try {
+            // Peek at the type on a copy, leaving the key as it is for the records ReadKeyValue loads
+            CDataStream ssType(ssKey);
+            ssType >> strType;
+            if (strType != "tx" && strType != "key" && strType != "wkey") {
+                fParsed = false;
+                return;
+            }
+
+            ssKey >> strType;
+            if (strType == "tx")
+                fValid = ReadWalletTx(ssKey, ssValue, hash, wtx, fUpgraded, strErr);
+            else
+                fValid = ReadWalletKey(strType, ssKey, ssValue, vchPubKey, key, strErr);
+        } catch (...) {
+            fValid = false;
+        }
+    }
+
+    bool Load(CWallet* pwallet, CWalletScanState& wss, string& strErrOut)
+    {
+        if (!fParsed)
+            return ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErrOut);
+
+        strErrOut = strErr;
+        if (!fValid)
+            return false;
+        if (strType == "tx") {
+            LoadWalletTx(pwallet, hash, wtx, fUpgraded, wss);
+            return true;
+        }
+        return LoadWalletKey(pwallet, strType, vchPubKey, key, wss, strErrOut);
+    }
+};
+
+class CWalletLoadCheck
+{
+private:
+    CWalletLoadRecord* precord;
+
+public:
+    CWalletLoadCheck() : precord(NULL) {}
+    CWalletLoadCheck(CWalletLoadRecord* precordIn) : precord(precordIn) {}
+
+    bool operator()()
+    {
+        precord->Parse();
+        return true;
+    }
+
+    void swap(CWalletLoadCheck& check)
+    {
+        std::swap(precord, check.precord);
+    }
+};
+
+} // anon namespace
+
+static void ThreadWalletLoad(CCheckQueue<CWalletLoadCheck>* pqueue)
+{
+    RenameThread("navcoin-walletload");
+    pqueue->Thread();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -628,6 +780,10 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
 
+    // Records are read from the cursor, parsed by the wallet load workers and loaded into the wallet in stages
+    int64_t nTimeRead = 0, nTimeParse = 0, nTimeInsert = 0, nTimeSpends = 0;
+    unsigned int nRecords = 0;
+
     try {
         LOCK2(cs_main, pwallet->cs_wallet);
         int nMinVersion = 0;
@@ -639,48 +795,101 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DB_CORRUPT;
         }
 
+        bool fEnd = false;
+
+        std::vector<CWalletLoadRecord> vWindow;
+        std::vector<CWalletLoadRecord> vWindowNext;
+        std::vector<CWalletLoadCheck> vChecks;
+        // The workers only run while the wallet loads
+        CCheckQueue<CWalletLoadCheck> walletloadqueue(128);
+        CCheckQueueWorkers<CWalletLoadCheck> workers(&walletloadqueue, std::max(nScriptCheckThreads - 1, 0), &ThreadWalletLoad);
+        boost::scoped_ptr<CCheckQueueControl<CWalletLoadCheck> > control;
         while (true)
         {
-            // Read next record
-            CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
-                break;
-            else if (ret != 0)
+            // Read the next window of records in database order
+            int64_t nTime = GetTimeMicros();
+            vWindowNext.clear();
+            while (!fEnd && vWindowNext.size() < WALLET_LOAD_WINDOW_RECORDS)
             {
-                LogPrintf("Error reading next record from wallet database\n");
-                return DB_CORRUPT;
+                vWindowNext.push_back(CWalletLoadRecord());
+                int ret = ReadAtCursor(pcursor, vWindowNext.back().ssKey, vWindowNext.back().ssValue);
+                if (ret == DB_NOTFOUND)
+                {
+                    vWindowNext.pop_back();
+                    fEnd = true;
+                }
+                else if (ret != 0)
+                {
+                    LogPrintf("Error reading next record from wallet database\n");
+                    delete pcursor;
+                    return DB_CORRUPT;
+                }
             }
+            nRecords += vWindowNext.size();
+            nTimeRead += GetTimeMicros() - nTime;
+
+            // Hand it to the workers, which parse it while the previous window is loaded into the wallet
+            nTime = GetTimeMicros();
+            vChecks.clear();
+            for (unsigned int i = 0; i < vWindowNext.size(); i++)
+                vChecks.push_back(CWalletLoadCheck(&vWindowNext[i]));
+            if (nScriptCheckThreads && !vChecks.empty()) {
+                control.reset(new CCheckQueueControl<CWalletLoadCheck>(&walletloadqueue));
+                control->Add(vChecks);
+            } else {
+                for(CWalletLoadCheck& check: vChecks)
+                    check();
+            }
+            nTimeParse += GetTimeMicros() - nTime;
 
-            // Try to be tolerant of single corrupt records:
-            string strType, strErr;
-            if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
+            nTime = GetTimeMicros();
+            for(CWalletLoadRecord& record: vWindow)
             {
-                // losing keys is considered a catastrophic error, anything else
-                // we assume the user can live with:
-                if (IsKeyType(strType))
-                    result = DB_CORRUPT;
-                else
+                // Try to be tolerant of single corrupt records:
+                string strErr;
+                if (!record.Load(pwallet, wss, strErr))
                 {
-                    // Leave other errors alone, if we try to fix them we might make things worse.
-                    fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
-                    if (strType == "tx")
-                        // Rescan if there is a bad transaction record:
-                        SoftSetBoolArg("-rescan", true);
+                    // losing keys is considered a catastrophic error, anything else
+                    // we assume the user can live with:
+                    if (IsKeyType(record.strType))
+                        result = DB_CORRUPT;
+                    else
+                    {
+                        // Leave other errors alone, if we try to fix them we might make things worse.
+                        fNoncriticalErrors = true; // ... but do warn the user there is something wrong.
+                        if (record.strType == "tx")
+                            // Rescan if there is a bad transaction record:
+                            SoftSetBoolArg("-rescan", true);
+                    }
                 }
+                if (!strErr.empty())
+                    LogPrintf("%s\n", strErr);
             }
-            if (!strErr.empty())
-                LogPrintf("%s\n", strErr);
+            nTimeInsert += GetTimeMicros() - nTime;
+
+            nTime = GetTimeMicros();
+            if (control) {
+                control->Wait();
+                control.reset();
+            }
+            nTimeParse += GetTimeMicros() - nTime;
+
+            if (vWindowNext.empty())
+                break;
+            vWindow.swap(vWindowNext);
         }
-        pcursor->close();
+        delete pcursor;
+
+        int64_t nTime = GetTimeMicros();
+        pwallet->SyncLoadedMetaData();
+        nTimeSpends = GetTimeMicros() - nTime;
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -689,6 +898,9 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         result = DB_CORRUPT;
     }
 
+    LogPrint("walletload", "%s: read %u records in %.2fms, parsed them on %d threads in %.2fms, loaded them in %.2fms, synced spend metadata in %.2fms\n",
+             __func__, nRecords, nTimeRead * 0.001, std::max(nScriptCheckThreads, 1), nTimeParse * 0.001, nTimeInsert * 0.001, nTimeSpends * 0.001);
+
     if (fNoncriticalErrors && result == DB_LOAD_OK)
         result = DB_NONCRITICAL_ERROR;
 
@@ -716,14 +928,19 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     if (wss.nFileVersion < CLIENT_VERSION) // Update
         WriteVersion(CLIENT_VERSION);
 
+    int64_t nTime = GetTimeMicros();
     if (wss.fAnyUnordered)
         result = ReorderTransactions(pwallet);
+    int64_t nTimeReorder = GetTimeMicros() - nTime;
 
+    nTime = GetTimeMicros();
     pwallet->laccentries.clear();
     ListAccountCreditDebit("*", pwallet->laccentries);
     for(CAccountingEntry& entry: pwallet->laccentries) {
         pwallet->wtxOrdered.insert(make_pair(entry.nOrderPos, CWallet::TxPair((CWalletTx*)0, &entry)));
     }
+    LogPrint("walletload", "%s: reordered transactions in %.2fms, loaded %u accounting entries in %.2fms\n",
+             __func__, nTimeReorder * 0.001, pwallet->laccentries.size(), (GetTimeMicros() - nTime) * 0.001);
 
     return result;
 }
@@ -745,7 +962,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
         }
 
         // Get cursor
-        Dbc* pcursor = GetCursor();
+        CDBCursor* pcursor = GetCursor();
         if (!pcursor)
         {
             LogPrintf("Error getting wallet database cursor\n");
@@ -779,7 +996,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, vector<uint256>& vTxHash, vec
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        delete pcursor;
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -819,6 +1036,7 @@ DBErrors CWalletDB::ZapSelectTx(CWallet* pwallet, vector<uint256>& vTxHashIn, ve
         }
         else if ((*it) == hash) {
             pwallet->mapWallet.erase(hash);
+            pwallet->MarkBalanceDirty(hash);
             if(!EraseTx(hash)) {
                 LogPrint("db", "Transaction was found for deletion but returned database error: %s\n", hash.GetHex());
                 delerror = true;
@@ -875,7 +1093,13 @@ void ThreadFlushWalletDB(const string& strFile)
             nLastWalletUpdate = GetTime();
         }
 
-        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
+        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2 && walletlog.Exists(strFile))
+        {
+            // Wallet logs can be synced and compacted while in use
+            nLastFlushed = nWalletDBUpdated;
+            walletlog.Flush(false);
+        }
+        else if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
         {
             TRY_LOCK(bitdb.cs_db,lockDb);
             if (lockDb)
@@ -1017,5 +1241,5 @@ bool CWalletDB::EraseDestData(const std::string &address, const std::string &key
 bool CWalletDB::WriteHDChain(const CHDChain& chain)
 {
     nWalletDBUpdated++;
-    return Write(std::string("hdchain"), chain);
+    return Write(std::string("hdchain"), chain) && Sync();
 }
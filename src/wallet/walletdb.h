@@ -18,6 +18,8 @@
 #include <vector>
 
 static const bool DEFAULT_FLUSHWALLET = true;
+/** Number of records LoadWallet reads from the database at once, parsed while the previous ones are loaded */
+static const unsigned int WALLET_LOAD_WINDOW_RECORDS = 4096;
 
 class CAccount;
 class CAccountingEntry;
@@ -25,6 +27,7 @@ struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
 class CScript;
+class CStakeReward;
 class CWallet;
 class CWalletTx;
 class uint160;
@@ -131,6 +134,9 @@ public:
     bool WriteTx(const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    bool WriteStakeReward(const uint256& hash, const CStakeReward& reward);
+    bool EraseStakeReward(const uint256& hash);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata &keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata &keyMeta);
     bool WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey);
@@ -0,0 +1,645 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/walletlog.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <mappedfile.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/version.hpp>
+
+CWalletLogEnv walletlog;
+
+/** Tag at the start of every wallet log, followed by its version */
+static const char WALLET_LOG_TAG[8] = {'n', 'a', 'v', 'w', 'l', 'o', 'g', '\0'};
+static const size_t WALLET_LOG_HEADER_SIZE = sizeof(WALLET_LOG_TAG) + 4;
+/** Every frame starts with a magic, then the size and the checksum of its operations */
+static const uint32_t WALLET_LOG_FRAME_MAGIC = 0xd9b4be57;
+static const size_t WALLET_LOG_FRAME_HEADER_SIZE = 12;
+
+static CWalletLogData ToLogData(const CDataStream& ss)
+{
+    return CWalletLogData(ss.begin(), ss.end());
+}
+
+static void FromLogData(const CWalletLogData& vch, CDataStream& ss)
+{
+    ss.SetType(SER_DISK);
+    ss.clear();
+    if (!vch.empty())
+        ss.write((const char*)&vch[0], vch.size());
+}
+
+/** Same test as CDB::Rewrite does on the keys to skip */
+static bool HasPrefix(const CWalletLogData& vchKey, const char* psz, size_t nLen)
+{
+    return nLen && !vchKey.empty() && memcmp(&vchKey[0], psz, std::min(vchKey.size(), nLen)) == 0;
+}
+
+/** Checksum of a frame, which covers its size so a damaged size field is noticed */
+static uint32_t GetFrameChecksum(const unsigned char* pchSize, const char* pops, size_t nSize)
+{
+    uint256 hash;
+    CHash256().Write(pchSize, 4).Write((const unsigned char*)pops, nSize).Finalize(hash.begin());
+    return ReadLE32(hash.begin());
+}
+
+/** Append a frame holding vOps to file, adding its size to nSize */
+static bool WriteFrame(FILE* file, const std::vector<CWalletLogOp>& vOps, uint64_t& nSize)
+{
+    CDataStream ssFrame(SER_DISK, CLIENT_VERSION);
+    ssFrame << uint32_t(0) << uint32_t(0) << uint32_t(0) << vOps;
+
+    unsigned char* pch = (unsigned char*)&ssFrame[0];
+    size_t nOpsSize = ssFrame.size() - WALLET_LOG_FRAME_HEADER_SIZE;
+    WriteLE32(pch, WALLET_LOG_FRAME_MAGIC);
+    WriteLE32(pch + 4, nOpsSize);
+    WriteLE32(pch + 8, GetFrameChecksum(pch + 4, &ssFrame[WALLET_LOG_FRAME_HEADER_SIZE], nOpsSize));
+
+    if (fwrite(&ssFrame[0], 1, ssFrame.size(), file) != ssFrame.size() || fflush(file) != 0)
+        return false;
+    nSize += ssFrame.size();
+    return true;
+}
+
+/** Read the operations of the frame at the start of [pbegin, pend); returns its size, or 0 if there is no valid frame there */
+static size_t ReadFrame(const char* pbegin, const char* pend, std::vector<CWalletLogOp>& vOps)
+{
+    size_t nAvailable = pend - pbegin;
+    const unsigned char* pch = (const unsigned char*)pbegin;
+    if (nAvailable < WALLET_LOG_FRAME_HEADER_SIZE || ReadLE32(pch) != WALLET_LOG_FRAME_MAGIC)
+        return 0;
+    size_t nSize = ReadLE32(pch + 4);
+    if (nAvailable - WALLET_LOG_FRAME_HEADER_SIZE < nSize)
+        return 0;
+
+    const char* pops = pbegin + WALLET_LOG_FRAME_HEADER_SIZE;
+    if (GetFrameChecksum(pch + 4, pops, nSize) != ReadLE32(pch + 8))
+        return 0;
+    try {
+        CDataStream ssOps(pops, pops + nSize, SER_DISK, CLIENT_VERSION);
+        ssOps >> vOps;
+    } catch (const std::exception&) {
+        return 0;
+    }
+    return WALLET_LOG_FRAME_HEADER_SIZE + nSize;
+}
+
+/** Offset of the first valid frame at or after nOffset, or nTotal if there is none */
+static size_t FindFrame(const char* pbegin, size_t nOffset, size_t nTotal)
+{
+    std::vector<CWalletLogOp> vOps;
+    for (; nOffset + WALLET_LOG_FRAME_HEADER_SIZE <= nTotal; nOffset++) {
+        if (ReadFrame(pbegin + nOffset, pbegin + nTotal, vOps))
+            return nOffset;
+    }
+    return nTotal;
+}
+
+/** Append bytes dropped from a log to <log>.dropped, where their frames can still be found by their magic */
+static bool SaveDroppedBytes(const boost::filesystem::path& path, const char* pbegin, size_t nSize)
+{
+    boost::filesystem::path pathDropped = path.string() + ".dropped";
+    FILE* file = fopen(pathDropped.string().c_str(), "ab");
+    if (!file)
+        return false;
+    bool fSuccess = fwrite(pbegin, 1, nSize, file) == nSize;
+    if (fSuccess)
+        FileCommit(file);
+    fclose(file);
+    return fSuccess;
+}
+
+static bool WriteHeader(FILE* file)
+{
+    unsigned char pchVersion[4];
+    WriteLE32(pchVersion, WALLET_LOG_VERSION);
+    return fwrite(WALLET_LOG_TAG, 1, sizeof(WALLET_LOG_TAG), file) == sizeof(WALLET_LOG_TAG) &&
+           fwrite(pchVersion, 1, sizeof(pchVersion), file) == sizeof(pchVersion) &&
+           fflush(file) == 0;
+}
+
+void CWalletLogBatch::Write(const CDataStream& ssKey, const CDataStream& ssValue)
+{
+    vOps.push_back(CWalletLogOp());
+    vOps.back().nOp = CWalletLogOp::WRITE;
+    vOps.back().vchKey = ToLogData(ssKey);
+    vOps.back().vchValue = ToLogData(ssValue);
+}
+
+void CWalletLogBatch::Erase(const CDataStream& ssKey)
+{
+    vOps.push_back(CWalletLogOp());
+    vOps.back().nOp = CWalletLogOp::ERASE;
+    vOps.back().vchKey = ToLogData(ssKey);
+}
+
+int CWalletLogBatch::Find(const CDataStream& ssKey, CDataStream* pssValue) const
+{
+    CWalletLogData vchKey = ToLogData(ssKey);
+    for (std::vector<CWalletLogOp>::const_reverse_iterator it = vOps.rbegin(); it != vOps.rend(); it++) {
+        if (it->vchKey != vchKey)
+            continue;
+        if (it->nOp == CWalletLogOp::ERASE)
+            return 0;
+        if (pssValue)
+            FromLogData(it->vchValue, *pssValue);
+        return 1;
+    }
+    return -1;
+}
+
+CWalletLog::CWalletLog() : file(NULL), nFileSize(0), nLiveSize(0), fUnsynced(false), nLastSync(0)
+{
+}
+
+CWalletLog::~CWalletLog()
+{
+    Close();
+}
+
+void CWalletLog::Apply(const CWalletLogOp& op)
+{
+    std::map<CWalletLogData, CWalletLogData>::iterator it = mapRecords.find(op.vchKey);
+    if (it != mapRecords.end()) {
+        nLiveSize -= it->first.size() + it->second.size();
+        if (op.nOp == CWalletLogOp::ERASE) {
+            mapRecords.erase(it);
+            return;
+        }
+        it->second = op.vchValue;
+        nLiveSize += it->first.size() + it->second.size();
+    } else if (op.nOp == CWalletLogOp::WRITE) {
+        mapRecords.insert(std::make_pair(op.vchKey, op.vchValue));
+        nLiveSize += op.vchKey.size() + op.vchValue.size();
+    }
+}
+
+bool CWalletLog::Append(const std::vector<CWalletLogOp>& vOps)
+{
+    if (!file)
+        return false;
+
+    uint64_t nSize = 0;
+    if (!WriteFrame(file, vOps, nSize)) {
+        // Drop whatever part of the frame made it to the file
+        TruncateFile(file, nFileSize);
+        return error("CWalletLog::Append: Failed to write to %s", path.string());
+    }
+    nFileSize += nSize;
+    fUnsynced = true;
+    return true;
+}
+
+bool CWalletLog::SyncLocked()
+{
+    AssertLockHeld(cs_log);
+    if (!file)
+        return false;
+    if (fUnsynced) {
+        FileCommit(file);
+        fUnsynced = false;
+    }
+    nLastSync = GetTimeMillis();
+    return true;
+}
+
+bool CWalletLog::Create(const boost::filesystem::path& pathIn)
+{
+    LOCK(cs_log);
+    Close();
+
+    FILE* fileNew = fopen(pathIn.string().c_str(), "wb");
+    if (!fileNew)
+        return error("CWalletLog::Create: Failed to create %s", pathIn.string());
+    bool fSuccess = WriteHeader(fileNew);
+    if (fSuccess)
+        FileCommit(fileNew);
+    fclose(fileNew);
+    if (!fSuccess)
+        return error("CWalletLog::Create: Failed to write to %s", pathIn.string());
+
+    std::string strError;
+    return Load(pathIn, strError);
+}
+
+bool CWalletLog::Load(const boost::filesystem::path& pathIn, std::string& strError, bool fSalvage)
+{
+    LOCK(cs_log);
+    Close();
+    mapRecords.clear();
+    nLiveSize = 0;
+
+    size_t nTotal = 0;
+    //! Parts of the file without valid frames, which are dropped
+    std::vector<std::pair<size_t, size_t> > vDropped;
+    int64_t nStart = GetTimeMillis();
+    {
+        // Read the log through a memory mapping, or copy it to memory where mmap is not available
+        CMappedFile mapped(pathIn);
+        std::vector<char> vchFile;
+        const char* pbegin = mapped.data();
+        nTotal = mapped.size();
+        if (mapped.IsNull()) {
+            FILE* fileIn = fopen(pathIn.string().c_str(), "rb");
+            if (!fileIn) {
+                strError = strprintf("Unable to open %s", pathIn.string());
+                return false;
+            }
+            char buf[65536];
+            size_t nRead;
+            while ((nRead = fread(buf, 1, sizeof(buf), fileIn)) > 0)
+                vchFile.insert(vchFile.end(), buf, buf + nRead);
+            fclose(fileIn);
+            pbegin = vchFile.empty() ? NULL : &vchFile[0];
+            nTotal = vchFile.size();
+        }
+
+        if (nTotal < WALLET_LOG_HEADER_SIZE || memcmp(pbegin, WALLET_LOG_TAG, sizeof(WALLET_LOG_TAG)) != 0) {
+            strError = strprintf("%s is not a wallet log", pathIn.string());
+            return false;
+        }
+        int nVersion = ReadLE32((const unsigned char*)pbegin + sizeof(WALLET_LOG_TAG));
+        if (nVersion != WALLET_LOG_VERSION) {
+            strError = strprintf("%s has unsupported wallet log version %d", pathIn.string(), nVersion);
+            return false;
+        }
+
+        size_t nPos = WALLET_LOG_HEADER_SIZE;
+        while (nPos < nTotal) {
+            std::vector<CWalletLogOp> vOps;
+            size_t nFrameSize = ReadFrame(pbegin + nPos, pbegin + nTotal, vOps);
+            if (nFrameSize) {
+                for (const CWalletLogOp& op: vOps)
+                    Apply(op);
+                nPos += nFrameSize;
+                continue;
+            }
+
+            // A crash while appending can only leave a partial frame at the end
+            // of the log, with no complete frame after it. Anything else is
+            // corruption, which only a salvage skips.
+            size_t nNext = FindFrame(pbegin, nPos + 1, nTotal);
+            if (nNext < nTotal && !fSalvage) {
+                strError = strprintf("%s is corrupt at offset %u, start with -salvagewallet to recover the readable records", pathIn.string(), nPos);
+                mapRecords.clear();
+                nLiveSize = 0;
+                return false;
+            }
+            vDropped.push_back(std::make_pair(nPos, nNext));
+            nPos = nNext;
+        }
+
+        for (const std::pair<size_t, size_t>& dropped: vDropped) {
+            LogPrintf("CWalletLog::Load: Dropping %u bytes at offset %u of %s, kept in %s.dropped\n",
+                      dropped.second - dropped.first, dropped.first, pathIn.string(), pathIn.string());
+            if (!SaveDroppedBytes(pathIn, pbegin + dropped.first, dropped.second - dropped.first)) {
+                strError = strprintf("Unable to save the dropped bytes of %s", pathIn.string());
+                mapRecords.clear();
+                nLiveSize = 0;
+                return false;
+            }
+        }
+    }
+
+    file = fopen(pathIn.string().c_str(), "ab");
+    if (!file) {
+        strError = strprintf("Unable to open %s for writing", pathIn.string());
+        return false;
+    }
+
+    // A torn write at the end is cut off, so appends carry on after the last complete frame
+    size_t nGood = nTotal;
+    if (!vDropped.empty() && vDropped.back().second == nTotal) {
+        nGood = vDropped.back().first;
+        vDropped.pop_back();
+        if (!TruncateFile(file, nGood)) {
+            strError = strprintf("Unable to truncate %s", pathIn.string());
+            Close();
+            return false;
+        }
+        FileCommit(file);
+    }
+
+    path = pathIn;
+    nFileSize = nGood;
+    fUnsynced = false;
+    nLastSync = GetTimeMillis();
+
+    // Corrupt parts skipped by a salvage are removed by rewriting the log
+    if (!vDropped.empty() && !Compact()) {
+        strError = strprintf("Unable to rewrite %s", pathIn.string());
+        Close();
+        return false;
+    }
+    LogPrint("db", "CWalletLog::Load: Loaded %u records (%u bytes) from %s in %dms\n",
+             mapRecords.size(), nFileSize, path.string(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CWalletLog::Close()
+{
+    LOCK(cs_log);
+    if (!file)
+        return;
+    SyncLocked();
+    fclose(file);
+    file = NULL;
+}
+
+bool CWalletLog::Read(const CDataStream& ssKey, CDataStream& ssValue) const
+{
+    LOCK(cs_log);
+    std::map<CWalletLogData, CWalletLogData>::const_iterator it = mapRecords.find(ToLogData(ssKey));
+    if (it == mapRecords.end())
+        return false;
+    FromLogData(it->second, ssValue);
+    return true;
+}
+
+bool CWalletLog::Exists(const CDataStream& ssKey) const
+{
+    LOCK(cs_log);
+    return mapRecords.count(ToLogData(ssKey)) > 0;
+}
+
+bool CWalletLog::Seek(const CWalletLogData& vchKey, bool fAfter, CWalletLogData& vchKeyRet, CDataStream& ssKey, CDataStream& ssValue) const
+{
+    LOCK(cs_log);
+    std::map<CWalletLogData, CWalletLogData>::const_iterator it = fAfter ? mapRecords.upper_bound(vchKey) : mapRecords.lower_bound(vchKey);
+    if (it == mapRecords.end())
+        return false;
+    vchKeyRet = it->first;
+    FromLogData(it->first, ssKey);
+    FromLogData(it->second, ssValue);
+    return true;
+}
+
+bool CWalletLog::Write(const CWalletLogBatch& batch)
+{
+    if (batch.IsEmpty())
+        return true;
+
+    LOCK(cs_log);
+    if (!Append(batch.vOps))
+        return false;
+    for (const CWalletLogOp& op: batch.vOps)
+        Apply(op);
+    return true;
+}
+
+bool CWalletLog::Sync(bool fForce)
+{
+    LOCK(cs_log);
+    if (!fUnsynced)
+        return true;
+    if (!fForce && GetTimeMillis() - nLastSync < WALLET_LOG_SYNC_INTERVAL)
+        return true;
+    return SyncLocked();
+}
+
+bool CWalletLog::NeedsCompaction() const
+{
+    LOCK(cs_log);
+    return nFileSize >= WALLET_LOG_COMPACT_MIN_SIZE && nFileSize > 2 * nLiveSize;
+}
+
+bool CWalletLog::Compact(const char* pszSkip)
+{
+    LOCK(cs_log);
+    if (!file)
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    uint64_t nOldSize = nFileSize;
+    size_t nSkip = pszSkip ? strlen(pszSkip) : 0;
+    boost::filesystem::path pathCompact = path.string() + ".compact";
+
+    FILE* fileCompact = fopen(pathCompact.string().c_str(), "wb");
+    if (!fileCompact)
+        return error("CWalletLog::Compact: Failed to create %s", pathCompact.string());
+
+    bool fSuccess = WriteHeader(fileCompact);
+    uint64_t nSize = WALLET_LOG_HEADER_SIZE;
+    std::vector<CWalletLogOp> vOps;
+    size_t nFrameSize = 0;
+    for (std::map<CWalletLogData, CWalletLogData>::const_iterator it = mapRecords.begin(); fSuccess && it != mapRecords.end(); it++) {
+        if (HasPrefix(it->first, pszSkip, nSkip))
+            continue;
+        vOps.push_back(CWalletLogOp());
+        vOps.back().vchKey = it->first;
+        vOps.back().vchValue = it->second;
+        nFrameSize += it->first.size() + it->second.size();
+        if (nFrameSize >= WALLET_LOG_COMPACT_FRAME_SIZE) {
+            fSuccess = WriteFrame(fileCompact, vOps, nSize);
+            vOps.clear();
+            nFrameSize = 0;
+        }
+    }
+    if (fSuccess && !vOps.empty())
+        fSuccess = WriteFrame(fileCompact, vOps, nSize);
+    if (fSuccess)
+        FileCommit(fileCompact);
+    fclose(fileCompact);
+
+    if (!fSuccess) {
+        boost::filesystem::remove(pathCompact);
+        return error("CWalletLog::Compact: Failed to write %s", pathCompact.string());
+    }
+
+    // A file which is open cannot be renamed over on Windows, so the log is
+    // closed until the compacted file is in place
+    SyncLocked();
+    fclose(file);
+    file = NULL;
+    bool fRenamed = RenameOver(pathCompact, path);
+    if (fRenamed)
+        DirectoryCommit(path.parent_path());
+    else
+        boost::filesystem::remove(pathCompact);
+
+    // Appends go to the new file from now on, or still to the old one if it was not replaced
+    file = fopen(path.string().c_str(), "ab");
+    if (!file)
+        return error("CWalletLog::Compact: Failed to reopen %s", path.string());
+    if (!fRenamed)
+        return error("CWalletLog::Compact: Failed to rewrite %s", path.string());
+
+    if (nSkip) {
+        for (std::map<CWalletLogData, CWalletLogData>::iterator it = mapRecords.begin(); it != mapRecords.end(); ) {
+            if (HasPrefix(it->first, pszSkip, nSkip)) {
+                nLiveSize -= it->first.size() + it->second.size();
+                mapRecords.erase(it++);
+            } else
+                it++;
+        }
+    }
+    nFileSize = nSize;
+    fUnsynced = false;
+    nLastSync = GetTimeMillis();
+
+    LogPrint("db", "CWalletLog::Compact: Compacted %s from %u to %u bytes in %dms\n",
+             path.string(), nOldSize, nFileSize, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CWalletLog::Backup(const boost::filesystem::path& pathDest)
+{
+    LOCK(cs_log);
+    if (!SyncLocked())
+        return false;
+
+    try {
+#if BOOST_VERSION >= 104000
+        boost::filesystem::copy_file(path, pathDest, boost::filesystem::copy_option::overwrite_if_exists);
+#else
+        boost::filesystem::copy_file(path, pathDest);
+#endif
+    } catch (const boost::filesystem::filesystem_error& e) {
+        return error("CWalletLog::Backup: Failed to copy %s to %s - %s", path.string(), pathDest.string(), e.what());
+    }
+    return true;
+}
+
+size_t CWalletLog::GetRecordCount() const
+{
+    LOCK(cs_log);
+    return mapRecords.size();
+}
+
+uint64_t CWalletLog::GetFileSize() const
+{
+    LOCK(cs_log);
+    return nFileSize;
+}
+
+CWalletLogEnv::~CWalletLogEnv()
+{
+    for (std::map<std::string, CWalletLog*>::iterator it = mapLogs.begin(); it != mapLogs.end(); it++)
+        delete it->second;
+}
+
+boost::filesystem::path CWalletLogEnv::GetPath(const std::string& strFile)
+{
+    return GetDataDir() / (strFile + ".wlog");
+}
+
+bool CWalletLogEnv::Exists(const std::string& strFile)
+{
+    LOCK(cs_env);
+    return mapLogs.count(strFile) || boost::filesystem::exists(GetPath(strFile));
+}
+
+bool CWalletLogEnv::Create(const std::string& strFile)
+{
+    LOCK(cs_env);
+    if (mapLogs.count(strFile))
+        return false;
+
+    CWalletLog* plog = new CWalletLog();
+    if (!plog->Create(GetPath(strFile))) {
+        delete plog;
+        return false;
+    }
+    mapLogs[strFile] = plog;
+    return true;
+}
+
+bool CWalletLogEnv::Verify(const std::string& strFile, std::string& strError, bool fSalvage)
+{
+    LOCK(cs_env);
+    if (mapLogs.count(strFile))
+        return true;
+
+    boost::filesystem::path path = GetPath(strFile);
+    if (fSalvage) {
+        // Keep the log as it was before the salvage rewrites it
+        boost::filesystem::path pathBackup = path.string() + strprintf(".%d.bak", GetTime());
+        try {
+            boost::filesystem::copy_file(path, pathBackup);
+        } catch (const boost::filesystem::filesystem_error& e) {
+            strError = strprintf("Unable to copy %s to %s - %s", path.string(), pathBackup.string(), e.what());
+            return false;
+        }
+        LogPrintf("CWalletLogEnv::Verify: Salvaging %s, original kept as %s\n", path.string(), pathBackup.string());
+    }
+
+    CWalletLog* plog = new CWalletLog();
+    if (!plog->Load(path, strError, fSalvage)) {
+        delete plog;
+        return false;
+    }
+    mapLogs[strFile] = plog;
+    return true;
+}
+
+CWalletLog* CWalletLogEnv::Open(const std::string& strFile)
+{
+    LOCK(cs_env);
+    if (!mapLogs.count(strFile)) {
+        std::string strError;
+        CWalletLog* plog = new CWalletLog();
+        if (!plog->Load(GetPath(strFile), strError)) {
+            LogPrintf("CWalletLogEnv::Open: %s\n", strError);
+            delete plog;
+            return NULL;
+        }
+        mapLogs[strFile] = plog;
+    }
+    ++mapFileUseCount[strFile];
+    return mapLogs[strFile];
+}
+
+void CWalletLogEnv::Release(const std::string& strFile)
+{
+    LOCK(cs_env);
+    --mapFileUseCount[strFile];
+}
+
+void CWalletLogEnv::Flush(bool fShutdown)
+{
+    LOCK(cs_env);
+    std::map<std::string, CWalletLog*>::iterator it = mapLogs.begin();
+    while (it != mapLogs.end()) {
+        CWalletLog* plog = it->second;
+        plog->Sync(true);
+        if (plog->NeedsCompaction())
+            plog->Compact();
+        if (fShutdown && mapFileUseCount[it->first] == 0) {
+            LogPrint("db", "CWalletLogEnv::Flush: %s closed\n", it->first);
+            delete plog;
+            mapFileUseCount.erase(it->first);
+            mapLogs.erase(it++);
+        } else
+            it++;
+    }
+}
+
+bool CWalletLogEnv::Rewrite(const std::string& strFile, const char* pszSkip)
+{
+    CWalletLog* plog = Open(strFile);
+    if (!plog)
+        return false;
+    LogPrintf("CWalletLogEnv::Rewrite: Rewriting %s...\n", GetPath(strFile).string());
+    bool fSuccess = plog->Compact(pszSkip);
+    Release(strFile);
+    return fSuccess;
+}
+
+bool CWalletLogEnv::Backup(const std::string& strFile, const boost::filesystem::path& pathDest)
+{
+    CWalletLog* plog = Open(strFile);
+    if (!plog)
+        return false;
+    bool fSuccess = plog->Backup(pathDest);
+    Release(strFile);
+    return fSuccess;
+}
@@ -0,0 +1,193 @@
+// Copyright (c) 2019 The NavCoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_WALLET_WALLETLOG_H
+#define NAVCOIN_WALLET_WALLETLOG_H
+
+#include <serialize.h>
+#include <streams.h>
+#include <support/allocators/zeroafterfree.h>
+#include <sync.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+/** Version of the wallet log format */
+static const int WALLET_LOG_VERSION = 2;
+/** Unsynced writes are committed to disk together at most this often (in milliseconds) */
+static const int64_t WALLET_LOG_SYNC_INTERVAL = 500;
+/** Logs smaller than this are never compacted */
+static const uint64_t WALLET_LOG_COMPACT_MIN_SIZE = 1 << 20;
+/** Records are written to a compacted log in frames of about this size */
+static const size_t WALLET_LOG_COMPACT_FRAME_SIZE = 1 << 16;
+
+/** Raw serialized key or value of a wallet record, wiped when freed */
+typedef std::vector<unsigned char, zero_after_free_allocator<unsigned char> > CWalletLogData;
+
+/** A write or an erase of a single wallet record */
+class CWalletLogOp
+{
+public:
+    enum Type {
+        WRITE = 1,
+        ERASE = 2,
+    };
+
+    unsigned char nOp;
+    CWalletLogData vchKey;
+    CWalletLogData vchValue;
+
+    CWalletLogOp() : nOp(WRITE) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nOp);
+        READWRITE(vchKey);
+        if (nOp == WRITE)
+            READWRITE(vchValue);
+    }
+};
+
+/**
+ * Writes and erases applied to a wallet log at once. They are appended as a
+ * single frame, so after a crash either all or none of them are found.
+ */
+class CWalletLogBatch
+{
+private:
+    std::vector<CWalletLogOp> vOps;
+
+    friend class CWalletLog;
+
+public:
+    void Write(const CDataStream& ssKey, const CDataStream& ssValue);
+    void Erase(const CDataStream& ssKey);
+
+    /**
+     * Look for the last operation of the batch on a key: returns 1 and sets
+     * ssValue if it was written, 0 if it was erased and -1 if it is untouched.
+     */
+    int Find(const CDataStream& ssKey, CDataStream* pssValue) const;
+
+    bool IsEmpty() const { return vOps.empty(); }
+    size_t size() const { return vOps.size(); }
+    void clear() { vOps.clear(); }
+};
+
+/**
+ * Wallet records stored as an append-only log of checksummed frames, with
+ * all the live records kept in memory.
+ *
+ * Every batch of writes is appended to the file straight away, but the file
+ * is only synced to disk once per WALLET_LOG_SYNC_INTERVAL, so bursts of
+ * writes share one fsync. Overwritten and erased records stay in the file
+ * until it is compacted, which rewrites it with the live records only.
+ *
+ * Frames start with a magic, and their checksum covers their size. A torn
+ * frame at the end of the file, left by a crash while appending, is dropped
+ * when loading. A bad frame followed by a valid one is corruption, which
+ * fails the load unless salvaging. Dropped bytes are kept in <log>.dropped.
+ */
+class CWalletLog
+{
+private:
+    mutable CCriticalSection cs_log;
+    boost::filesystem::path path;
+    FILE* file;
+    //! Live records in key order, like the Berkeley DB btree
+    std::map<CWalletLogData, CWalletLogData> mapRecords;
+    //! Size of the file and of the live records in it
+    uint64_t nFileSize;
+    uint64_t nLiveSize;
+    bool fUnsynced;
+    int64_t nLastSync;
+
+    // Disallow copies
+    CWalletLog(const CWalletLog&);
+    CWalletLog& operator=(const CWalletLog&);
+
+    void Apply(const CWalletLogOp& op);
+    bool Append(const std::vector<CWalletLogOp>& vOps);
+    bool SyncLocked();
+
+public:
+    CWalletLog();
+    ~CWalletLog();
+
+    /** Create an empty log at pathIn, replacing any file there */
+    bool Create(const boost::filesystem::path& pathIn);
+    /**
+     * Load the log at pathIn, mapping it in memory, and open it for appending.
+     * With fSalvage, corrupt parts are skipped and the log is rewritten without them.
+     */
+    bool Load(const boost::filesystem::path& pathIn, std::string& strError, bool fSalvage = false);
+    void Close();
+
+    bool Read(const CDataStream& ssKey, CDataStream& ssValue) const;
+    bool Exists(const CDataStream& ssKey) const;
+    /**
+     * Find the first record with a key not less than vchKey (or greater than
+     * it if fAfter), like a Berkeley DB cursor with DB_SET_RANGE or DB_NEXT.
+     */
+    bool Seek(const CWalletLogData& vchKey, bool fAfter, CWalletLogData& vchKeyRet, CDataStream& ssKey, CDataStream& ssValue) const;
+    bool Write(const CWalletLogBatch& batch);
+
+    /** Sync appended frames to disk; unless fForce, only once per WALLET_LOG_SYNC_INTERVAL */
+    bool Sync(bool fForce);
+    /** Whether enough of the file is overwritten or erased records for a compaction to pay off */
+    bool NeedsCompaction() const;
+    /** Rewrite the file with the live records only, dropping those whose key starts with pszSkip */
+    bool Compact(const char* pszSkip = NULL);
+    /** Copy the synced log to pathDest */
+    bool Backup(const boost::filesystem::path& pathDest);
+
+    size_t GetRecordCount() const;
+    uint64_t GetFileSize() const;
+};
+
+/**
+ * The wallet logs in use, named after the wallet file they replace. A wallet
+ * is stored in a log instead of Berkeley DB when <wallet>.wlog exists in the
+ * data directory; see -walletbackend.
+ */
+class CWalletLogEnv
+{
+private:
+    CCriticalSection cs_env;
+    std::map<std::string, CWalletLog*> mapLogs;
+    std::map<std::string, int> mapFileUseCount;
+
+public:
+    ~CWalletLogEnv();
+
+    static boost::filesystem::path GetPath(const std::string& strFile);
+
+    /** Whether wallet strFile is stored in a log */
+    bool Exists(const std::string& strFile);
+    /** Create an empty log for wallet strFile */
+    bool Create(const std::string& strFile);
+    /** Load the log of wallet strFile if it is not loaded yet, salvaging it after a backup if fSalvage */
+    bool Verify(const std::string& strFile, std::string& strError, bool fSalvage = false);
+
+    /** The log of wallet strFile, loading it if needed; Release it when done */
+    CWalletLog* Open(const std::string& strFile);
+    void Release(const std::string& strFile);
+
+    /** Sync all logs to disk and compact those that need it; on shutdown, also close those not in use */
+    void Flush(bool fShutdown);
+    bool Rewrite(const std::string& strFile, const char* pszSkip = NULL);
+    bool Backup(const std::string& strFile, const boost::filesystem::path& pathDest);
+};
+
+extern CWalletLogEnv walletlog;
+
+#endif // NAVCOIN_WALLET_WALLETLOG_H